@@ -0,0 +1,93 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <ctime>
+
+#include "log.h"
+#include "gpx2video.h"
+#include "bench.h"
+
+
+// JSON format version, to increase on incompatible change
+#define BENCH_FORMAT 1
+
+
+Bench::Bench() {
+}
+
+
+Bench::~Bench() {
+}
+
+
+double Bench::now(void) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+void Bench::append(const std::string &name, const std::string &input, int64_t items, const std::string &unit, double seconds) {
+	Result result;
+
+	result.name = name;
+	result.input = input;
+	result.items = items;
+	result.unit = unit;
+	result.seconds = seconds;
+
+	results_.push_back(result);
+
+	// Progress (stdout may be the JSON output)
+	std::cerr << std::left << std::setw(24) << name << std::setw(24) << input
+		<< std::right << std::fixed << std::setprecision(3) << std::setw(10) << seconds << " s"
+		<< std::setprecision(1) << std::setw(14) << ((seconds > 0) ? items / seconds : 0) << " " << unit << "/s"
+		<< std::endl;
+}
+
+
+bool Bench::write(const std::string &filename) const {
+	char date[32];
+	struct tm tm;
+
+	time_t now = ::time(NULL);
+
+	std::ofstream file;
+
+	if (filename != "-") {
+		file.open(filename);
+
+		if (!file.is_open()) {
+			log_error("Open '%s' results file failure", filename.c_str());
+			return false;
+		}
+	}
+
+	std::ostream &out = (filename != "-") ? file : std::cout;
+
+	gmtime_r(&now, &tm);
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", &tm);
+
+	out << "{" << std::endl;
+	out << "  \"format\": " << BENCH_FORMAT << "," << std::endl;
+	out << "  \"version\": \"" << GPX2Video::version() << "\"," << std::endl;
+	out << "  \"date\": \"" << date << "\"," << std::endl;
+	out << "  \"results\": [" << std::endl;
+
+	for (size_t i=0; i<results_.size(); i++) {
+		const Result &result = results_[i];
+
+		out << "    { \"name\": \"" << result.name << "\""
+			<< ", \"input\": \"" << result.input << "\""
+			<< ", \"items\": " << result.items
+			<< ", \"unit\": \"" << result.unit << "\""
+			<< std::fixed << std::setprecision(6) << ", \"seconds\": " << result.seconds
+			<< std::setprecision(2) << ", \"rate\": " << ((result.seconds > 0) ? result.items / result.seconds : 0)
+			<< " }" << ((i + 1 < results_.size()) ? "," : "") << std::endl;
+	}
+
+	out << "  ]" << std::endl;
+	out << "}" << std::endl;
+
+	return out.good();
+}
+
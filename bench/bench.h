@@ -0,0 +1,50 @@
+#ifndef __GPX2VIDEO__BENCH_H__
+#define __GPX2VIDEO__BENCH_H__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+
+// Benchmark results
+//
+// Results are written in a stable JSON format, one entry by benchmark
+// & input, so that runs of several versions can be compared:
+//
+// {
+//   "format": 1,
+//   "version": "0.0.0",
+//   "date": "2022-01-01T00:00:00Z",
+//   "results": [
+//     { "name": "gpx_parse", "input": "points=1000", "items": 1000, "unit": "points",
+//       "seconds": 0.012345, "rate": 81004.45 },
+//     ...
+//   ]
+// }
+class Bench {
+public:
+	struct Result {
+		std::string name;
+		std::string input;
+		int64_t items;
+		std::string unit;
+		double seconds;
+	};
+
+	Bench();
+	virtual ~Bench();
+
+	// Monotonic time in seconds
+	static double now(void);
+
+	void append(const std::string &name, const std::string &input, int64_t items, const std::string &unit, double seconds);
+
+	// Write JSON results ('-' for stdout)
+	bool write(const std::string &filename) const;
+
+private:
+	std::vector<Result> results_;
+};
+
+#endif
+
@@ -0,0 +1,515 @@
+#include <iostream>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <event2/event.h>
+#include <event2/thread.h>
+
+#include "log.h"
+#include "macros.h"
+#include "gpx.h"
+#include "decoder.h"
+#include "frame.h"
+#include "media.h"
+#include "renderer.h"
+#include "map.h"
+#include "mapsettings.h"
+#include "projection.h"
+#include "track.h"
+#include "tracksettings.h"
+#include "videowidget.h"
+#include "widgets/gpx.h"
+#include "widgets/date.h"
+#include "widgets/distance.h"
+#include "widgets/duration.h"
+#include "widgets/grade.h"
+#include "widgets/elevation.h"
+#include "widgets/cadence.h"
+#include "widgets/heartrate.h"
+#include "widgets/position.h"
+#include "widgets/speed.h"
+#include "widgets/maxspeed.h"
+#include "widgets/avgspeed.h"
+#include "widgets/time.h"
+#include "widgets/temperature.h"
+#include "gpx2video.h"
+#include "bench.h"
+#include "synthetic.h"
+
+
+static const struct option options[] = {
+	{ "help",    no_argument,       0, 'h' },
+	{ "output",  required_argument, 0, 'o' },
+	{ "workdir", required_argument, 0, 'w' },
+	{ "frames",  required_argument, 0, 'n' },
+	{ "quick",   no_argument,       0, 'q' },
+	{ 0,         0,                 0, 0 }
+};
+
+
+static const struct {
+	const char *name;
+	int width;
+	int height;
+} resolutions[] = {
+	{ "1080p", 1920, 1080 },
+	{ "2.7k",  2704, 1520 },
+	{ "4k",    3840, 2160 },
+	{ NULL,    0,    0 }
+};
+
+
+static const int track_sizes[] = {
+	1000, 10000, 100000, 1000000, 0
+};
+
+
+// Map build: zoom level & max number of tiles (larger tracks are skipped)
+#define BENCH_MAP_ZOOM      12
+#define BENCH_MAP_MAX_TILES 1024
+
+
+static const struct {
+	const char *name;
+	VideoWidget * (*create)(GPX2Video &app);
+} widgets[] = {
+	{ "gpx",         [](GPX2Video &app) -> VideoWidget * { return GPXWidget::create(app); } },
+	{ "date",        [](GPX2Video &app) -> VideoWidget * { return DateWidget::create(app); } },
+	{ "time",        [](GPX2Video &app) -> VideoWidget * { return TimeWidget::create(app); } },
+	{ "distance",    [](GPX2Video &app) -> VideoWidget * { return DistanceWidget::create(app); } },
+	{ "duration",    [](GPX2Video &app) -> VideoWidget * { return DurationWidget::create(app); } },
+	{ "position",    [](GPX2Video &app) -> VideoWidget * { return PositionWidget::create(app); } },
+	{ "speed",       [](GPX2Video &app) -> VideoWidget * { return SpeedWidget::create(app); } },
+	{ "maxspeed",    [](GPX2Video &app) -> VideoWidget * { return MaxSpeedWidget::create(app); } },
+	{ "avgspeed",    [](GPX2Video &app) -> VideoWidget * { return AvgSpeedWidget::create(app); } },
+	{ "grade",       [](GPX2Video &app) -> VideoWidget * { return GradeWidget::create(app); } },
+	{ "elevation",   [](GPX2Video &app) -> VideoWidget * { return ElevationWidget::create(app); } },
+	{ "cadence",     [](GPX2Video &app) -> VideoWidget * { return CadenceWidget::create(app); } },
+	{ "heartrate",   [](GPX2Video &app) -> VideoWidget * { return HeartRateWidget::create(app); } },
+	{ "temperature", [](GPX2Video &app) -> VideoWidget * { return TemperatureWidget::create(app); } },
+	{ NULL,          NULL }
+};
+
+
+static void print_usage(const std::string &name) {
+	std::cout << "Usage: " << name << " [options]" << std::endl;
+	std::cout << std::endl;
+	std::cout << "\t- o, --output=file  : JSON results file, '-' for stdout (default: gpx2video-bench.json)" << std::endl;
+	std::cout << "\t- w, --workdir=dir  : Synthetic inputs directory (default: /tmp/gpx2video-bench)" << std::endl;
+	std::cout << "\t- n, --frames=count : Frames by video benchmark (default: 60)" << std::endl;
+	std::cout << "\t- q, --quick        : 1080p & small tracks only" << std::endl;
+	std::cout << "\t- h, --help         : Show this help screen" << std::endl;
+}
+
+
+static std::string input(const char *key, int value) {
+	return std::string(key) + "=" + std::to_string(value);
+}
+
+
+static std::string input(const char *key, const char *value) {
+	return std::string(key) + "=" + value;
+}
+
+
+// GPX parse & telemetry compute
+static void bench_gpx(Bench &bench, const std::string &filename, int nbr_points) {
+	double start;
+
+	int64_t n = 0;
+
+	GPX *gpx;
+	GPXData data;
+
+	// Parse
+	start = Bench::now();
+	gpx = GPX::open(filename);
+	bench.append("gpx_parse", input("points", nbr_points), nbr_points, "points", Bench::now() - start);
+
+	if (gpx == NULL)
+		return;
+
+	// Compute each point (see Telemetry)
+	start = Bench::now();
+
+	gpx->retrieveFirst(data);
+	gpx->setStartTime(data.time());
+
+	while (gpx->retrieveNext(data, -1) != GPX::DataEof)
+		n++;
+
+	bench.append("telemetry_compute", input("points", nbr_points), n, "points", Bench::now() - start);
+
+	delete gpx;
+}
+
+
+// Track build (path drawing of the map widget, without tiles download)
+static void bench_track(Bench &bench, struct event_base *evbase, const std::string &filename, int nbr_points) {
+	double start;
+
+	GPXData::point p1, p2;
+
+	GPX2Video app(evbase);
+
+	app.setSettings(GPX2Video::Settings(filename));
+
+	GPX *gpx = GPX::open(filename);
+
+	if (gpx == NULL)
+		return;
+
+	gpx->getBoundingBox(&p1, &p2);
+
+	delete gpx;
+
+	OIIO::ImageBuf frame(OIIO::ImageSpec(1920, 1080, 4, OIIO::TypeDesc::UINT8));
+
+	TrackSettings settings;
+	settings.setSize(800, 500);
+	settings.setBoundingBox(p1.lat, p1.lon, p2.lat, p2.lon);
+
+	// Track geometry is computed once by app
+	start = Bench::now();
+
+	Track *track = Track::create(app, settings);
+	track->setPosition(0, 0);
+	track->setSize(800, 500);
+	track->prepare(&frame);
+
+	bench.append("track_build", input("points", nbr_points), nbr_points, "points", Bench::now() - start);
+
+	delete track;
+}
+
+
+// Map build (mosaic assembly from cached tiles, without download)
+static void bench_map(Bench &bench, struct event_base *evbase, const std::string &workdir,
+	const std::string &filename, int nbr_points) {
+	int x1, y1, x2, y2;
+
+	int width = 800;
+	int height = 500;
+	double divider = 2.0;
+
+	double start;
+
+	std::string home;
+
+	GPXData::point p1, p2;
+
+	MapSettings::Source source = MapSettings::SourceOpenStreetMap;
+
+	GPX2Video app(evbase);
+
+	app.setSettings(GPX2Video::Settings(filename));
+
+	GPX *gpx = GPX::open(filename);
+
+	if (gpx == NULL)
+		return;
+
+	gpx->getBoundingBox(&p1, &p2);
+
+	delete gpx;
+
+	// Tiles of the map (see Map::init)
+	x1 = floor(floor(Projection::lon2pixel(BENCH_MAP_ZOOM, p1.lon)) / TILESIZE);
+	y1 = floor(floor(Projection::lat2pixel(BENCH_MAP_ZOOM, p1.lat)) / TILESIZE);
+	x2 = floor(floor(Projection::lon2pixel(BENCH_MAP_ZOOM, p2.lon)) / TILESIZE) + 1;
+	y2 = floor(floor(Projection::lat2pixel(BENCH_MAP_ZOOM, p2.lat)) / TILESIZE) + 1;
+
+	while (((x2 - x1) * TILESIZE * divider) < (2 * width)) {
+		x1 -= 1;
+		x2 += 1;
+	}
+
+	while (((y2 - y1) * TILESIZE * divider) < (2 * height)) {
+		y1 -= 1;
+		y2 += 1;
+	}
+
+	if ((x2 - x1) * (y2 - y1) > BENCH_MAP_MAX_TILES)
+		return;
+
+	// Tile cache in workdir (user cache isn't used)
+	home = std::getenv("HOME");
+	setenv("HOME", workdir.c_str(), 1);
+
+	if (!Synthetic::writeTiles(source, BENCH_MAP_ZOOM, x1, y1, x2, y2))
+		goto exit;
+
+	{
+		MapSettings settings;
+
+		settings.setSource(source);
+		settings.setZoom(BENCH_MAP_ZOOM);
+		settings.setDivider(divider);
+		settings.setSize(width, height);
+		settings.setBoundingBox(p1.lat, p1.lon, p2.lat, p2.lon);
+
+		// Tiles are fresh in cache: map is built on run
+		start = Bench::now();
+
+		Map *map = Map::create(app, settings);
+		map->run();
+
+		bench.append("map_build", input("points", nbr_points), (x2 - x1) * (y2 - y1), "tiles", Bench::now() - start);
+
+		delete map;
+	}
+
+exit:
+	setenv("HOME", home.c_str(), 1);
+}
+
+
+// Each widget render
+static void bench_widgets(Bench &bench, struct event_base *evbase, const std::string &gpxfile,
+	const char *resolution, int width, int height, int nbr_frames) {
+	int i, n;
+
+	double start;
+
+	GPXData data;
+
+	GPX2Video app(evbase);
+
+	app.setSettings(GPX2Video::Settings(gpxfile));
+
+	GPX *gpx = GPX::open(gpxfile);
+
+	if (gpx == NULL)
+		return;
+
+	OIIO::ImageBuf frame(OIIO::ImageSpec(width, height, 4, OIIO::TypeDesc::UINT8));
+
+	for (i=0; widgets[i].name != NULL; i++) {
+		VideoWidget *widget = widgets[i].create(app);
+
+		widget->setPosition(20 * width / 1920, 20 * height / 1080);
+		widget->setSize(400 * width / 1920, 80 * height / 1080);
+		widget->setPadding(5);
+		widget->setLabel(widgets[i].name);
+		widget->setTextShadow(3);
+		widget->setBackgroundColor("#00000066");
+
+		widget->prepare(&frame);
+		widget->createTile(OIIO::TypeDesc::UINT8);
+
+		gpx->retrieveFirst(data);
+		gpx->setStartTime(data.time());
+
+		// A frame by second of track
+		start = Bench::now();
+
+		for (n=0; n<nbr_frames; n++) {
+			gpx->retrieveNext(data, n * 1000);
+
+			widget->clearTile();
+			widget->setTime(data.time());
+			widget->render(widget->tile(), data);
+
+			Blend::over(frame, *widget->tile());
+		}
+
+		bench.append(std::string("widget_render_") + widgets[i].name, input("video", resolution),
+			nbr_frames, "frames", Bench::now() - start);
+
+		delete widget;
+	}
+
+	delete gpx;
+}
+
+
+// Decoder throughput
+static void bench_decoder(Bench &bench, const std::string &filename, const char *resolution) {
+	int64_t n = 0;
+
+	double start;
+
+	MediaContainer *container = Decoder::probe(filename);
+
+	if (container == NULL)
+		return;
+
+	VideoStreamPtr video_stream = container->getVideoStream();
+
+	Decoder *decoder = Decoder::create();
+
+	start = Bench::now();
+
+	decoder->open(video_stream);
+
+	while (decoder->retrieveVideo(av_mul_q(av_make_q(n, 1), av_inv_q(video_stream->frameRate()))) != NULL)
+		n++;
+
+	decoder->close();
+
+	bench.append("decoder", input("video", resolution), n, "frames", Bench::now() - start);
+
+	delete decoder;
+	delete container;
+}
+
+
+// Renderer draw (overlay & widgets over each frame)
+static void bench_renderer(Bench &bench, struct event_base *evbase, const std::string &workdir,
+	const std::string &gpxfile, const std::string &videofile, const std::string &layoutfile,
+	const char *resolution, int width, int height, int nbr_frames) {
+	int n;
+
+	double start;
+
+	GPXData data;
+
+	GPX2Video app(evbase);
+
+	app.setSettings(GPX2Video::Settings(gpxfile, videofile, layoutfile, workdir + "/renderer.mp4"));
+
+	GPX *gpx = GPX::open(gpxfile);
+
+	if (gpx == NULL)
+		return;
+
+	Renderer *renderer = Renderer::create(app);
+
+	renderer->setProgress(false);
+	renderer->start();
+
+	gpx->retrieveFirst(data);
+	gpx->setStartTime(data.time());
+
+	FramePtr frame = Frame::create();
+	frame->setVideoParams(VideoParams(width, height,
+		VideoParams::FormatUnsigned8, VideoParams::RGBAChannelCount,
+		av_make_q(1, 1), VideoParams::InterlaceNone));
+	frame->setData((uint8_t *) calloc(frame->linesizeBytes() * height, sizeof(uint8_t)));
+
+	start = Bench::now();
+
+	for (n=0; n<nbr_frames; n++) {
+		gpx->retrieveNext(data, n * 1000);
+
+		renderer->draw(frame, data);
+	}
+
+	bench.append("renderer_draw", input("video", resolution), nbr_frames, "frames", Bench::now() - start);
+
+	renderer->stop();
+
+	delete renderer;
+	delete gpx;
+}
+
+
+int main(int argc, char *argv[]) {
+	int i;
+	int option;
+
+	int result = -1;
+	int nbr_frames = 60;
+
+	bool quick = false;
+
+	double seconds;
+
+	std::string output = "gpx2video-bench.json";
+	std::string workdir = "/tmp/gpx2video-bench";
+
+	struct event_base *evbase;
+
+	Bench bench;
+
+	const std::string name(argv[0]);
+
+	for (;;) {
+		option = getopt_long(argc, argv, "ho:w:n:q", options, NULL);
+
+		if (option == -1)
+			break;
+
+		switch (option) {
+		case 'o':
+			output = std::string(optarg);
+			break;
+		case 'w':
+			workdir = std::string(optarg);
+			break;
+		case 'n':
+			nbr_frames = MAX(1, atoi(optarg));
+			break;
+		case 'q':
+			quick = true;
+			break;
+		case 'h':
+		default:
+			print_usage(name);
+			return (option == 'h') ? 0 : -1;
+		}
+	}
+
+	mkdir(workdir.c_str(), 0755);
+
+	evthread_use_pthreads();
+
+	evbase = event_base_new();
+
+	av_log_set_level(AV_LOG_ERROR);
+
+	// Telemetry data, GPX track generated once by size
+	for (i=0; track_sizes[i] != 0; i++) {
+		std::string gpxfile = workdir + "/track-" + std::to_string(track_sizes[i]) + ".gpx";
+
+		if (quick && (track_sizes[i] > 10000))
+			break;
+
+		if ((access(gpxfile.c_str(), R_OK) != 0) && !Synthetic::writeTrack(gpxfile, track_sizes[i]))
+			goto exit;
+
+		bench_gpx(bench, gpxfile, track_sizes[i]);
+		bench_track(bench, evbase, gpxfile, track_sizes[i]);
+		bench_map(bench, evbase, workdir, gpxfile, track_sizes[i]);
+	}
+
+	// Video pipeline, for each resolution
+	for (i=0; resolutions[i].name != NULL; i++) {
+		std::string gpxfile = workdir + "/track-1000.gpx";
+		std::string videofile = workdir + "/testsrc-" + resolutions[i].name + ".mp4";
+		std::string layoutfile = workdir + "/layout-" + resolutions[i].name + ".xml";
+
+		if (quick && (i > 0))
+			break;
+
+		// Encoder throughput (video is generated each time)
+		if (!Synthetic::writeVideo(videofile, resolutions[i].width, resolutions[i].height, nbr_frames, &seconds))
+			goto exit;
+
+		bench.append("encoder", input("video", resolutions[i].name), nbr_frames, "frames", seconds);
+
+		if (!Synthetic::writeLayout(layoutfile, resolutions[i].width, resolutions[i].height))
+			goto exit;
+
+		bench_decoder(bench, videofile, resolutions[i].name);
+		bench_widgets(bench, evbase, gpxfile, resolutions[i].name, resolutions[i].width, resolutions[i].height, nbr_frames);
+		bench_renderer(bench, evbase, workdir, gpxfile, videofile, layoutfile,
+			resolutions[i].name, resolutions[i].width, resolutions[i].height, nbr_frames);
+	}
+
+	if (bench.write(output))
+		result = 0;
+
+exit:
+	event_base_free(evbase);
+
+	return result;
+}
+
@@ -0,0 +1,280 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <ctime>
+
+extern "C" {
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersink.h>
+}
+
+#include <OpenImageIO/imageio.h>
+
+#include "log.h"
+#include "utils.h"
+#include "projection.h"
+#include "map.h"
+#include "frame.h"
+#include "videoparams.h"
+#include "encoder.h"
+#include "bench.h"
+#include "synthetic.h"
+
+
+// Widget types (see Renderer::loadWidget)
+static const char *widget_types[] = {
+	"gpx", "date", "time", "distance", "duration", "position", "speed",
+	"maxspeed", "avgspeed", "grade", "elevation", "cadence", "heartrate", "temperature",
+	NULL
+};
+
+
+bool Synthetic::writeTrack(const std::string &filename, int nbr_points) {
+	int i;
+
+	char s[32];
+	struct tm tm;
+
+	double lat = 45.0;
+	double lon = 6.0;
+	double ele = 1000.0;
+	double heading = 0.0;
+	double speed;
+
+	time_t t = 1640995200; // 2022-01-01 00:00:00 UTC
+
+	std::ofstream out(filename);
+
+	if (!out.is_open()) {
+		log_error("Open '%s' GPX file failure", filename.c_str());
+		return false;
+	}
+
+	// Same track for the same size
+	srand(nbr_points);
+
+	out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" << std::endl;
+	out << "<gpx version=\"1.1\" creator=\"gpx2video-bench\" xmlns=\"http://www.topografix.com/GPX/1/1\">" << std::endl;
+	out << " <trk>" << std::endl;
+	out << "  <name>bench</name>" << std::endl;
+	out << "  <trkseg>" << std::endl;
+
+	out << std::fixed;
+
+	for (i=0; i<nbr_points; i++, t++) {
+		gmtime_r(&t, &tm);
+		strftime(s, sizeof(s), "%Y-%m-%dT%H:%M:%SZ", &tm);
+
+		out << "   <trkpt lat=\"" << std::setprecision(7) << lat << "\" lon=\"" << lon << "\">"
+			<< "<ele>" << std::setprecision(1) << ele << "</ele>"
+			<< "<time>" << s << "</time>"
+			<< "</trkpt>" << std::endl;
+
+		// Random walk, 2 to 12 m/s
+		heading += ((rand() % 2001) - 1000) / 10000.0;
+		speed = 2.0 + (rand() % 1001) / 100.0;
+
+		lat += speed * cos(heading) / 111111.0;
+		lon += speed * sin(heading) / (111111.0 * cos(lat * M_PI / 180.0));
+		ele += ((rand() % 2001) - 1000) / 1000.0;
+	}
+
+	out << "  </trkseg>" << std::endl;
+	out << " </trk>" << std::endl;
+	out << "</gpx>" << std::endl;
+
+	return out.good();
+}
+
+
+bool Synthetic::writeVideo(const std::string &filename, int width, int height, int nbr_frames, double *seconds) {
+	int y;
+	int result;
+	int64_t n = 0;
+
+	char args[128];
+
+	bool success = false;
+
+	double start;
+
+	AVFrame *avframe = NULL;
+
+	AVFilterGraph *graph = NULL;
+	AVFilterContext *src = NULL;
+	AVFilterContext *format = NULL;
+	AVFilterContext *sink = NULL;
+
+	Encoder *encoder = NULL;
+
+	*seconds = 0.0;
+
+#if LIBAVFILTER_VERSION_INT < AV_VERSION_INT(7, 14, 100)
+	avfilter_register_all();
+#endif
+
+	// testsrc -> rgba -> sink
+	graph = avfilter_graph_alloc();
+
+	snprintf(args, sizeof(args), "size=%dx%d:rate=%d:duration=%f", width, height, FrameRate, (double) nbr_frames / FrameRate);
+
+	if ((avfilter_graph_create_filter(&src, avfilter_get_by_name("testsrc"), "src", args, NULL, graph) < 0)
+		|| (avfilter_graph_create_filter(&format, avfilter_get_by_name("format"), "format", "pix_fmts=rgba", NULL, graph) < 0)
+		|| (avfilter_graph_create_filter(&sink, avfilter_get_by_name("buffersink"), "sink", NULL, NULL, graph) < 0)) {
+		log_error("Create testsrc filter graph failure");
+		goto done;
+	}
+
+	if ((avfilter_link(src, 0, format, 0) < 0)
+		|| (avfilter_link(format, 0, sink, 0) < 0)
+		|| (avfilter_graph_config(graph, NULL) < 0)) {
+		log_error("Configure testsrc filter graph failure");
+		goto done;
+	}
+
+	// Output video
+	{
+		VideoParams video_params(width, height, av_make_q(1, FrameRate),
+			VideoParams::FormatUnsigned8,
+			VideoParams::RGBAChannelCount,
+			av_make_q(1, 1),
+			VideoParams::InterlaceNone);
+		video_params.setPixelFormat(AV_PIX_FMT_YUV420P);
+
+		EncoderSettings settings;
+		settings.setFilename(filename);
+		settings.setVideoParams(video_params, AV_CODEC_ID_H264);
+
+		encoder = Encoder::create(settings);
+	}
+
+	if (!encoder->open()) {
+		log_error("Open '%s' synthetic video failure", filename.c_str());
+		goto done;
+	}
+
+	avframe = av_frame_alloc();
+
+	while ((result = av_buffersink_get_frame(sink, avframe)) >= 0) {
+		FramePtr frame = Frame::create();
+
+		frame->setVideoParams(encoder->settings().videoParams());
+
+		uint8_t *data = (uint8_t *) malloc(frame->linesizeBytes() * height);
+
+		for (y=0; y<height; y++)
+			memcpy(data + y * frame->linesizeBytes(), avframe->data[0] + y * avframe->linesize[0], width * 4);
+
+		frame->setData(data);
+
+		av_frame_unref(avframe);
+
+		// Encoder throughput only
+		start = Bench::now();
+		encoder->writeFrame(frame, av_make_q(n++, FrameRate));
+		*seconds += Bench::now() - start;
+	}
+
+	start = Bench::now();
+	encoder->close();
+	*seconds += Bench::now() - start;
+
+	success = (n > 0);
+
+done:
+	if (encoder)
+		delete encoder;
+	if (avframe)
+		av_frame_free(&avframe);
+	if (graph)
+		avfilter_graph_free(&graph);
+
+	return success;
+}
+
+
+bool Synthetic::writeLayout(const std::string &filename, int width, int height) {
+	int i;
+
+	// Widgets on both sides, sized as 1080p samples layout
+	int w = 400 * width / 1920;
+	int h = 80 * height / 1080;
+	int margin = 10 * height / 1080;
+
+	std::ofstream out(filename);
+
+	if (!out.is_open()) {
+		log_error("Open '%s' layout file failure", filename.c_str());
+		return false;
+	}
+
+	out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>" << std::endl;
+	out << "<layout>" << std::endl;
+
+	for (i=0; widget_types[i] != NULL; i++) {
+		out << "\t<widget width=\"" << w << "\" height=\"" << h << "\" align=\"" << ((i % 2) ? "right" : "left") << "\">" << std::endl;
+		out << "\t\t<type>" << widget_types[i] << "</type>" << std::endl;
+		out << "\t\t<name>" << widget_types[i] << "</name>" << std::endl;
+		out << "\t\t<margin>" << margin << "</margin>" << std::endl;
+		out << "\t\t<padding>5</padding>" << std::endl;
+		out << "\t\t<text-shadow>3</text-shadow>" << std::endl;
+		out << "\t\t<background-color>#00000066</background-color>" << std::endl;
+		out << "\t</widget>" << std::endl;
+	}
+
+	out << "\t<track align=\"bottom\">" << std::endl;
+	out << "\t\t<margin>" << margin << "</margin>" << std::endl;
+	out << "\t\t<border>6</border>" << std::endl;
+	out << "\t\t<border-color>#000000ff</border-color>" << std::endl;
+	out << "\t\t<background-color>#00000066</background-color>" << std::endl;
+	out << "\t</track>" << std::endl;
+
+	out << "</layout>" << std::endl;
+
+	return out.good();
+}
+
+
+bool Synthetic::writeTiles(const MapSettings::Source &source, int zoom, int x1, int y1, int x2, int y2) {
+	int x, y;
+	int i, j;
+
+	std::vector<uint8_t> pixels(TILESIZE * TILESIZE * 3);
+
+	OIIO::ImageSpec spec(TILESIZE, TILESIZE, 3, OIIO::TypeDesc::UINT8);
+
+	// Same pattern for each tile (16 px squares)
+	for (j=0; j<TILESIZE; j++) {
+		for (i=0; i<TILESIZE; i++) {
+			uint8_t value = (((i / 16) + (j / 16)) % 2) ? 0xe0 : 0xa0;
+
+			pixels[3 * (j * TILESIZE + i) + 0] = value;
+			pixels[3 * (j * TILESIZE + i) + 1] = value;
+			pixels[3 * (j * TILESIZE + i) + 2] = value;
+		}
+	}
+
+	for (y=y1; y<y2; y++) {
+		for (x=x1; x<x2; x++) {
+			std::string path = Map::buildPath(source, zoom, x, y);
+			std::string filename = path + "/" + Map::buildFilename(source, zoom, x, y);
+
+			::mkpath(path, 0700);
+
+			std::unique_ptr<OIIO::ImageOutput> out = OIIO::ImageOutput::create(filename);
+
+			if (!out || !out->open(filename, spec)) {
+				log_error("Open '%s' synthetic tile failure", filename.c_str());
+				return false;
+			}
+
+			out->write_image(OIIO::TypeDesc::UINT8, pixels.data());
+			out->close();
+		}
+	}
+
+	return true;
+}
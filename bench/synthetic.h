@@ -0,0 +1,31 @@
+#ifndef __GPX2VIDEO__SYNTHETIC_H__
+#define __GPX2VIDEO__SYNTHETIC_H__
+
+#include <string>
+
+#include "mapsettings.h"
+
+
+// Synthetic benchmark inputs, generated locally
+class Synthetic {
+public:
+	// Frame rate of synthetic videos
+	static const int FrameRate = 30;
+
+	// Random walk GPX track, a point each second
+	static bool writeTrack(const std::string &filename, int nbr_points);
+
+	// H.264 video of the lavfi 'testsrc' pattern, 'seconds' is the time spent
+	// in the encoder
+	static bool writeVideo(const std::string &filename, int width, int height, int nbr_frames, double *seconds);
+
+	// Layout with each widget type & a track, sized for the video
+	static bool writeLayout(const std::string &filename, int width, int height);
+
+	// Checkerboard PNG tiles [x1, x2[ x [y1, y2[ in the tile cache (see
+	// Map::buildPath), so that map is built without download
+	static bool writeTiles(const MapSettings::Source &source, int zoom, int x1, int y1, int x2, int y2);
+};
+
+#endif
+
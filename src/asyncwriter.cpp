@@ -0,0 +1,285 @@
+#include <iostream>
+#include <string>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include "log.h"
+#include "macros.h"
+#include "asyncwriter.h"
+
+
+// Muxer I/O buffer, chunks are built from it
+#define IO_BUFFER_SIZE (256 * 1024)
+
+// Disk space is reserved by steps, to keep the file contiguous
+#define PREALLOCATE_SIZE (64 * 1024 * 1024)
+
+
+AsyncWriter::AsyncWriter(const std::string &filename, size_t size)
+	: filename_(filename)
+	, fd_(-1)
+	, avio_ctx_(NULL)
+	, size_(size)
+	, pos_(0)
+	, end_(0)
+	, allocated_(0)
+	, pending_(0)
+	, done_(false)
+	, error_(false) {
+	chunk_size_ = MAX((size_t) IO_BUFFER_SIZE, MIN((size_t) (4 * 1024 * 1024), size / 8));
+
+	chunk_.offset = 0;
+}
+
+
+AsyncWriter::~AsyncWriter() {
+	if (writer_.joinable())
+		close();
+
+	if (avio_ctx_) {
+		av_freep(&avio_ctx_->buffer);
+		avio_context_free(&avio_ctx_);
+	}
+
+	if (fd_ >= 0)
+		::close(fd_);
+}
+
+
+AsyncWriter * AsyncWriter::open(const std::string &filename, size_t size) {
+	AsyncWriter *writer = new AsyncWriter(filename, size);
+
+	if (!writer->init()) {
+		delete writer;
+		return NULL;
+	}
+
+	return writer;
+}
+
+
+bool AsyncWriter::init(void) {
+	uint8_t *buffer = NULL;
+
+	log_call();
+
+	fd_ = ::open(filename_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+	if (fd_ < 0) {
+		log_error("Open '%s' output file failure: %s", filename_.c_str(), strerror(errno));
+		goto error;
+	}
+
+	buffer = (uint8_t *) av_malloc(IO_BUFFER_SIZE);
+
+	if (buffer == NULL)
+		goto error;
+
+	avio_ctx_ = avio_alloc_context(buffer, IO_BUFFER_SIZE, 1, this, NULL, writePacket, seek);
+
+	if (avio_ctx_ == NULL) {
+		av_free(buffer);
+		goto error;
+	}
+
+	chunk_.data.reserve(chunk_size_);
+
+	writer_ = std::thread(&AsyncWriter::work, this);
+
+	return true;
+
+error:
+	return false;
+}
+
+
+bool AsyncWriter::close(void) {
+	log_call();
+
+	if (!writer_.joinable())
+		return !error_;
+
+	// Muxer I/O buffer, then last chunk
+	avio_flush(avio_ctx_);
+
+	push();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		done_ = true;
+	}
+
+	cond_.notify_all();
+
+	writer_.join();
+
+	if (fd_ >= 0) {
+		// Release space reserved beyond the end of file
+		if ((allocated_ > end_) && (allocated_ != INT64_MAX)) {
+			if (ftruncate(fd_, end_) != 0)
+				log_warn("Release '%s' reserved space failure", filename_.c_str());
+		}
+
+		if (::close(fd_) != 0)
+			error_ = true;
+
+		fd_ = -1;
+	}
+
+	return !error_;
+}
+
+
+size_t AsyncWriter::pending(void) {
+	std::unique_lock<std::mutex> lock(mutex_);
+
+	return pending_ + chunk_.data.size();
+}
+
+
+void AsyncWriter::push(void) {
+	std::unique_lock<std::mutex> lock(mutex_);
+
+	if (chunk_.data.empty())
+		goto done;
+
+	// Wait for the writer, up to 'size' bytes can be pending
+	cond_.wait(lock, [this] {
+		return error_ || queue_.empty() || (pending_ + chunk_.data.size() <= size_);
+	});
+
+	pending_ += chunk_.data.size();
+	queue_.push_back(std::move(chunk_));
+
+	cond_.notify_all();
+
+	chunk_.data = std::vector<uint8_t>();
+	chunk_.data.reserve(chunk_size_);
+
+done:
+	chunk_.offset = pos_;
+}
+
+
+void AsyncWriter::work(void) {
+	ssize_t n;
+	size_t written;
+
+	Chunk chunk;
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+
+			cond_.wait(lock, [this] {
+				return done_ || !queue_.empty();
+			});
+
+			if (queue_.empty())
+				break;
+
+			chunk = std::move(queue_.front());
+			queue_.pop_front();
+		}
+
+		int64_t end = chunk.offset + chunk.data.size();
+
+		// Reserve disk space ahead (not supported by every file system)
+		if (end > allocated_) {
+			int64_t length = ((end - allocated_) / PREALLOCATE_SIZE + 1) * PREALLOCATE_SIZE;
+
+			if (fallocate(fd_, FALLOC_FL_KEEP_SIZE, allocated_, length) == 0)
+				allocated_ += length;
+			else
+				allocated_ = INT64_MAX;
+		}
+
+		// Sequential write
+		for (written=0; !error_ && (written < chunk.data.size()); written += n) {
+			n = pwrite(fd_, chunk.data.data() + written, chunk.data.size() - written, chunk.offset + written);
+
+			if ((n < 0) && (errno == EINTR)) {
+				n = 0;
+				continue;
+			}
+
+			if (n <= 0) {
+				log_error("Write '%s' output file failure: %s", filename_.c_str(), strerror(errno));
+				error_ = true;
+			}
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+
+			pending_ -= chunk.data.size();
+		}
+
+		cond_.notify_all();
+	}
+}
+
+
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+int AsyncWriter::writePacket(void *opaque, const uint8_t *buf, int size) {
+#else
+int AsyncWriter::writePacket(void *opaque, uint8_t *buf, int size) {
+#endif
+	AsyncWriter *writer = (AsyncWriter *) opaque;
+
+	if (writer->error_)
+		return AVERROR(EIO);
+
+	writer->chunk_.data.insert(writer->chunk_.data.end(), buf, buf + size);
+
+	writer->pos_ += size;
+	writer->end_ = MAX(writer->end_, writer->pos_);
+
+	if (writer->chunk_.data.size() >= writer->chunk_size_)
+		writer->push();
+
+	return size;
+}
+
+
+int64_t AsyncWriter::seek(void *opaque, int64_t offset, int whence) {
+	int64_t pos;
+
+	AsyncWriter *writer = (AsyncWriter *) opaque;
+
+	if (whence & AVSEEK_SIZE)
+		return writer->end_;
+
+	switch (whence & ~AVSEEK_FORCE) {
+	case SEEK_SET:
+		pos = offset;
+		break;
+	case SEEK_CUR:
+		pos = writer->pos_ + offset;
+		break;
+	case SEEK_END:
+		pos = writer->end_ + offset;
+		break;
+	default:
+		return AVERROR(EINVAL);
+	}
+
+	if (pos < 0)
+		return AVERROR(EINVAL);
+
+	// New chunk at the new position
+	if (pos != writer->pos_) {
+		writer->push();
+
+		writer->pos_ = pos;
+		writer->chunk_.offset = pos;
+	}
+
+	return pos;
+}
+
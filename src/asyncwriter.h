@@ -0,0 +1,93 @@
+#ifndef __GPX2VIDEO__ASYNCWRITER_H__
+#define __GPX2VIDEO__ASYNCWRITER_H__
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+
+// Muxer output written by a writer thread
+//
+// The muxer writes in large chunks queued in memory, a writer thread
+// writes them to the output file. Storage stalls (NFS write-back) don't
+// stall encoding until 'size' bytes are pending.
+//
+// Each chunk is written at its own offset (pwrite), so muxer seeks (mp4
+// header update at trailer) only start a new chunk.
+class AsyncWriter {
+public:
+	virtual ~AsyncWriter();
+
+	static AsyncWriter * open(const std::string &filename, size_t size);
+
+	AVIOContext * context(void) {
+		return avio_ctx_;
+	}
+
+	// Flush pending chunks, return false on write failure
+	bool close(void);
+
+	// Bytes queued, not yet written
+	size_t pending(void);
+
+protected:
+	struct Chunk {
+		int64_t offset;
+		std::vector<uint8_t> data;
+	};
+
+	bool init(void);
+
+	// Writer thread
+	void work(void);
+
+	// Queue current chunk
+	void push(void);
+
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+	static int writePacket(void *opaque, const uint8_t *buf, int size);
+#else
+	static int writePacket(void *opaque, uint8_t *buf, int size);
+#endif
+	static int64_t seek(void *opaque, int64_t offset, int whence);
+
+private:
+	AsyncWriter(const std::string &filename, size_t size);
+
+	std::string filename_;
+
+	int fd_;
+
+	AVIOContext *avio_ctx_;
+
+	size_t size_;
+	size_t chunk_size_;
+
+	// Muxer side
+	Chunk chunk_;
+	int64_t pos_;
+	int64_t end_;
+
+	// Writer side
+	int64_t allocated_;
+
+	std::thread writer_;
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	std::deque<Chunk> queue_;
+	size_t pending_;
+
+	bool done_;
+	std::atomic<bool> error_;
+};
+
+#endif
+
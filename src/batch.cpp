@@ -0,0 +1,174 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "log.h"
+#include "macros.h"
+#include "decoder.h"
+#include "batch.h"
+
+
+Batch::Batch(GPX2Video &app)
+	: RenderPool(app)
+	, app_(app)
+	, layout_(NULL)
+	, started_at_(0) {
+}
+
+
+Batch::~Batch() {
+	if (layout_)
+		delete layout_;
+}
+
+
+Batch * Batch::create(GPX2Video &app) {
+	Batch *batch = new Batch(app);
+
+	batch->init();
+
+	return batch;
+}
+
+
+bool Batch::load(const std::string &filename) {
+	int n = 0;
+
+	std::string line;
+
+	std::ifstream stream(filename);
+
+	log_call();
+
+	if (!stream.is_open()) {
+		log_error("Open '%s' batch file failure, please check that file is readable", filename.c_str());
+		return false;
+	}
+
+	while (std::getline(stream, line)) {
+		Job job;
+
+		std::istringstream iss(line);
+
+		n++;
+
+		// Skip comments & empty lines
+		if (line.empty() || (line.at(0) == '#'))
+			continue;
+
+		job.offset = 0;
+
+		if (!(iss >> job.mediafile))
+			continue;
+
+		if (!(iss >> job.outputfile)) {
+			log_warn("Batch file '%s' line %d: output is missing, skip job", filename.c_str(), n);
+			continue;
+		}
+
+		iss >> job.offset;
+
+		jobs_.push_back(job);
+	}
+
+	return true;
+}
+
+
+void Batch::init(void) {
+	int n = 0;
+
+	GPX2Video::Settings &settings = app_.settings();
+
+	log_call();
+
+	if (!load(settings.batchfile()))
+		return;
+
+	// Shared resources: layout is parsed once, track is projected once
+	layout_ = Renderer::parse(settings.layoutfile());
+
+	app_.geometry();
+
+	// Create a renderer for each job (map download tasks are queued)
+	for (Job &job : jobs_) {
+		Renderer *renderer;
+		MediaContainer *container;
+
+		n++;
+
+		if (settings.chapters())
+			container = Decoder::probe(Demuxer::chapters(job.mediafile), settings.mmap());
+		else
+			container = Decoder::probe(job.mediafile, settings.mmap());
+
+		if (container == NULL) {
+			log_error("Probe '%s' media failure, skip job", job.mediafile.c_str());
+			append(NULL, NULL);
+			continue;
+		}
+
+		// Job settings: media, output & offset (each job writes its own trace file)
+		GPX2Video::Settings job_settings = settings;
+
+		job_settings.setMediafile(job.mediafile);
+		job_settings.setOutputfile(job.outputfile);
+		job_settings.setOffset(job.offset);
+
+		if (!settings.traceFile().empty())
+			job_settings.setTraceFile(settings.traceFile() + "." + std::to_string(n));
+
+		renderer = Renderer::create(app_, job_settings, container, layout_);
+
+		// Workers share the console
+		renderer->setProgress(false);
+
+		append(renderer, container);
+	}
+
+	setNbrWorkers(settings.jobs());
+}
+
+
+bool Batch::start(void) {
+	log_call();
+
+	log_notice("Batch of %d jobs, %d at the same time", (int) jobs_.size(), MAX(1, app_.settings().jobs()));
+
+	started_at_ = ::time(NULL);
+
+	return true;
+}
+
+
+bool Batch::process(size_t index, Renderer *renderer) {
+	const Job &job = jobs_[index];
+
+	log_notice("Job %d/%d: render '%s' to '%s'", (int) index + 1, (int) jobs_.size(),
+		job.mediafile.c_str(), job.outputfile.c_str());
+
+	return render(renderer);
+}
+
+
+bool Batch::stop(void) {
+	int working;
+
+	time_t now;
+
+	log_call();
+
+	// Interrupted: current jobs stop at next frame
+	RenderPool::stop();
+
+	now = ::time(NULL);
+	working = now - started_at_;
+
+	printf("%d jobs (%d failures) proceed in %02d:%02d:%02d\n",
+		(int) jobs_.size(), nbrFailures(),
+		(working / 3600), (working / 60) % 60, (working) % 60);
+
+	return true;
+}
+
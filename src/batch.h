@@ -0,0 +1,55 @@
+#ifndef __GPX2VIDEO__BATCH_H__
+#define __GPX2VIDEO__BATCH_H__
+
+#include <string>
+#include <vector>
+
+#include "layoutlib/Layout.h"
+
+#include "renderpool.h"
+
+
+// Batch of videos rendered with the same GPX & layout
+//
+// Batch file: one job per line 'media output [offset]', '#' for comments.
+//
+// GPX data, layout, map raster & pictos are loaded once and shared by
+// every job. Map downloads run first in the event loop, then jobs are
+// rendered by worker threads ('jobs' clips at the same time).
+class Batch : public RenderPool {
+public:
+	struct Job {
+		std::string mediafile;
+		std::string outputfile;
+		int offset;
+	};
+
+	virtual ~Batch();
+
+	static Batch * create(GPX2Video &app);
+
+	bool start(void);
+	bool stop(void);
+
+protected:
+	void init(void);
+
+	// Read batch file
+	bool load(const std::string &filename);
+
+	bool process(size_t index, Renderer *renderer);
+
+private:
+	GPX2Video &app_;
+
+	Batch(GPX2Video &app);
+
+	layout::Layout *layout_;
+
+	std::vector<Job> jobs_;
+
+	time_t started_at_;
+};
+
+#endif
+
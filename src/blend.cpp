@@ -0,0 +1,375 @@
+#include <iostream>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+#include "blend.h"
+
+
+typedef void (*blend8_t)(uint8_t *dst, const uint8_t *src, size_t count);
+typedef void (*blend16_t)(uint16_t *dst, const uint16_t *src, size_t count);
+
+
+// Scalar kernels
+//
+// dst = src + round(dst * (max - alpha) / max), saturated
+//---------------------------------------------------------------------
+
+static void overRGBA8Scalar(uint8_t *dst, const uint8_t *src, size_t count) {
+	size_t i;
+
+	int c;
+	uint32_t pixel;
+	unsigned int ia, v;
+
+	for (i=0; i<count; i++, src+=4, dst+=4) {
+		// Transparent pixel
+		memcpy(&pixel, src, sizeof(pixel));
+
+		if (pixel == 0)
+			continue;
+
+		ia = 255 - src[3];
+
+		for (c=0; c<4; c++) {
+			v = src[c] + (dst[c] * ia + 127) / 255;
+
+			dst[c] = (v > 255) ? 255 : v;
+		}
+	}
+}
+
+
+static void overRGBA16Scalar(uint16_t *dst, const uint16_t *src, size_t count) {
+	size_t i;
+
+	int c;
+	uint64_t pixel;
+	uint32_t ia, v;
+
+	for (i=0; i<count; i++, src+=4, dst+=4) {
+		// Transparent pixel
+		memcpy(&pixel, src, sizeof(pixel));
+
+		if (pixel == 0)
+			continue;
+
+		ia = 65535 - src[3];
+
+		for (c=0; c<4; c++) {
+			v = src[c] + (dst[c] * ia + 32767) / 65535;
+
+			dst[c] = (v > 65535) ? 65535 : v;
+		}
+	}
+}
+
+
+#ifdef HAVE_X86_KERNELS
+
+// SSE4 kernels
+//
+// x / 255 == (x + 1 + (x >> 8)) >> 8 for x < 65535
+// x / 65535 == (x + 1 + (x >> 16)) >> 16 for x < 65535 * 65537
+//---------------------------------------------------------------------
+
+__attribute__((target("sse4.1")))
+static void overRGBA8SSE4(uint8_t *dst, const uint8_t *src, size_t count) {
+	size_t i;
+
+	__m128i s, d, ia, lo, hi;
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ones = _mm_set1_epi8((char) 0xff);
+	const __m128i one = _mm_set1_epi16(1);
+	const __m128i half = _mm_set1_epi16(127);
+	const __m128i alpha = _mm_setr_epi8(3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15);
+
+	// 4 pixels by loop
+	for (i=0; i+4<=count; i+=4) {
+		s = _mm_loadu_si128((const __m128i *) (src + 4 * i));
+
+		// Transparent pixels
+		if (_mm_testz_si128(s, s))
+			continue;
+
+		d = _mm_loadu_si128((const __m128i *) (dst + 4 * i));
+
+		ia = _mm_xor_si128(_mm_shuffle_epi8(s, alpha), ones);
+
+		lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(ia, zero)), half);
+		hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(ia, zero)), half);
+
+		lo = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(lo, one), _mm_srli_epi16(lo, 8)), 8);
+		hi = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(hi, one), _mm_srli_epi16(hi, 8)), 8);
+
+		d = _mm_adds_epu8(s, _mm_packus_epi16(lo, hi));
+
+		_mm_storeu_si128((__m128i *) (dst + 4 * i), d);
+	}
+
+	overRGBA8Scalar(dst + 4 * i, src + 4 * i, count - i);
+}
+
+
+__attribute__((target("sse4.1")))
+static void overRGBA16SSE4(uint16_t *dst, const uint16_t *src, size_t count) {
+	size_t i;
+
+	__m128i s, d, ia, lo, hi;
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i ones = _mm_set1_epi8((char) 0xff);
+	const __m128i one = _mm_set1_epi32(1);
+	const __m128i half = _mm_set1_epi32(32767);
+	const __m128i alpha = _mm_setr_epi8(6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15);
+
+	// 2 pixels by loop
+	for (i=0; i+2<=count; i+=2) {
+		s = _mm_loadu_si128((const __m128i *) (src + 4 * i));
+
+		// Transparent pixels
+		if (_mm_testz_si128(s, s))
+			continue;
+
+		d = _mm_loadu_si128((const __m128i *) (dst + 4 * i));
+
+		ia = _mm_xor_si128(_mm_shuffle_epi8(s, alpha), ones);
+
+		lo = _mm_add_epi32(_mm_mullo_epi32(_mm_unpacklo_epi16(d, zero), _mm_unpacklo_epi16(ia, zero)), half);
+		hi = _mm_add_epi32(_mm_mullo_epi32(_mm_unpackhi_epi16(d, zero), _mm_unpackhi_epi16(ia, zero)), half);
+
+		lo = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(lo, one), _mm_srli_epi32(lo, 16)), 16);
+		hi = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(hi, one), _mm_srli_epi32(hi, 16)), 16);
+
+		d = _mm_adds_epu16(s, _mm_packus_epi32(lo, hi));
+
+		_mm_storeu_si128((__m128i *) (dst + 4 * i), d);
+	}
+
+	overRGBA16Scalar(dst + 4 * i, src + 4 * i, count - i);
+}
+
+
+// AVX2 kernels (same as SSE4, shuffle & pack work within each 128 bits lane)
+//---------------------------------------------------------------------
+
+__attribute__((target("avx2")))
+static void overRGBA8AVX2(uint8_t *dst, const uint8_t *src, size_t count) {
+	size_t i;
+
+	__m256i s, d, ia, lo, hi;
+
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i ones = _mm256_set1_epi8((char) 0xff);
+	const __m256i one = _mm256_set1_epi16(1);
+	const __m256i half = _mm256_set1_epi16(127);
+	const __m256i alpha = _mm256_setr_epi8(3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15,
+		3, 3, 3, 3, 7, 7, 7, 7, 11, 11, 11, 11, 15, 15, 15, 15);
+
+	// 8 pixels by loop
+	for (i=0; i+8<=count; i+=8) {
+		s = _mm256_loadu_si256((const __m256i *) (src + 4 * i));
+
+		// Transparent pixels
+		if (_mm256_testz_si256(s, s))
+			continue;
+
+		d = _mm256_loadu_si256((const __m256i *) (dst + 4 * i));
+
+		ia = _mm256_xor_si256(_mm256_shuffle_epi8(s, alpha), ones);
+
+		lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(ia, zero)), half);
+		hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(ia, zero)), half);
+
+		lo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(lo, one), _mm256_srli_epi16(lo, 8)), 8);
+		hi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(hi, one), _mm256_srli_epi16(hi, 8)), 8);
+
+		d = _mm256_adds_epu8(s, _mm256_packus_epi16(lo, hi));
+
+		_mm256_storeu_si256((__m256i *) (dst + 4 * i), d);
+	}
+
+	overRGBA8SSE4(dst + 4 * i, src + 4 * i, count - i);
+}
+
+
+__attribute__((target("avx2")))
+static void overRGBA16AVX2(uint16_t *dst, const uint16_t *src, size_t count) {
+	size_t i;
+
+	__m256i s, d, ia, lo, hi;
+
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i ones = _mm256_set1_epi8((char) 0xff);
+	const __m256i one = _mm256_set1_epi32(1);
+	const __m256i half = _mm256_set1_epi32(32767);
+	const __m256i alpha = _mm256_setr_epi8(6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15,
+		6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15);
+
+	// 4 pixels by loop
+	for (i=0; i+4<=count; i+=4) {
+		s = _mm256_loadu_si256((const __m256i *) (src + 4 * i));
+
+		// Transparent pixels
+		if (_mm256_testz_si256(s, s))
+			continue;
+
+		d = _mm256_loadu_si256((const __m256i *) (dst + 4 * i));
+
+		ia = _mm256_xor_si256(_mm256_shuffle_epi8(s, alpha), ones);
+
+		lo = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_unpacklo_epi16(d, zero), _mm256_unpacklo_epi16(ia, zero)), half);
+		hi = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_unpackhi_epi16(d, zero), _mm256_unpackhi_epi16(ia, zero)), half);
+
+		lo = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(lo, one), _mm256_srli_epi32(lo, 16)), 16);
+		hi = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(hi, one), _mm256_srli_epi32(hi, 16)), 16);
+
+		d = _mm256_adds_epu16(s, _mm256_packus_epi32(lo, hi));
+
+		_mm256_storeu_si256((__m256i *) (dst + 4 * i), d);
+	}
+
+	overRGBA16SSE4(dst + 4 * i, src + 4 * i, count - i);
+}
+
+#else
+
+#define overRGBA8SSE4 overRGBA8Scalar
+#define overRGBA16SSE4 overRGBA16Scalar
+#define overRGBA8AVX2 overRGBA8Scalar
+#define overRGBA16AVX2 overRGBA16Scalar
+
+#endif
+
+
+// Runtime dispatch
+//---------------------------------------------------------------------
+
+static const struct {
+	const char *name;
+	blend8_t rgba8;
+	blend16_t rgba16;
+} kernels[Blend::KernelCount] = {
+	{ "auto",   NULL, NULL },
+	{ "scalar", overRGBA8Scalar, overRGBA16Scalar },
+	{ "sse4",   overRGBA8SSE4, overRGBA16SSE4 },
+	{ "avx2",   overRGBA8AVX2, overRGBA16AVX2 },
+};
+
+
+static bool isSupported(enum Blend::Kernel kernel) {
+	switch (kernel) {
+	case Blend::KernelAuto:
+	case Blend::KernelScalar:
+		return true;
+#ifdef HAVE_X86_KERNELS
+	case Blend::KernelSSE4:
+		return __builtin_cpu_supports("sse4.1");
+	case Blend::KernelAVX2:
+		return __builtin_cpu_supports("avx2");
+#endif
+	default:
+		break;
+	}
+
+	return false;
+}
+
+
+static enum Blend::Kernel detectKernel(void) {
+	if (isSupported(Blend::KernelAVX2))
+		return Blend::KernelAVX2;
+	if (isSupported(Blend::KernelSSE4))
+		return Blend::KernelSSE4;
+
+	return Blend::KernelScalar;
+}
+
+
+static enum Blend::Kernel kernel_ = detectKernel();
+
+
+bool Blend::setKernel(enum Blend::Kernel kernel) {
+	if ((kernel >= Blend::KernelCount) || !isSupported(kernel))
+		return false;
+
+	kernel_ = (kernel == Blend::KernelAuto) ? detectKernel() : kernel;
+
+	return true;
+}
+
+
+const char * Blend::getFriendlyName(enum Blend::Kernel kernel) {
+	if (kernel >= Blend::KernelCount)
+		return "unknown";
+
+	return kernels[kernel].name;
+}
+
+
+void Blend::overRGBA8(uint8_t *dst, const uint8_t *src, size_t count) {
+	kernels[kernel_].rgba8(dst, src, count);
+}
+
+
+void Blend::overRGBA16(uint16_t *dst, const uint16_t *src, size_t count) {
+	kernels[kernel_].rgba16(dst, src, count);
+}
+
+
+// Image blend
+//---------------------------------------------------------------------
+
+static bool isRGBA(const OIIO::ImageBuf &buf, OIIO::TypeDesc type) {
+	const OIIO::ImageSpec &spec = buf.spec();
+
+	if ((spec.nchannels != 4) || (spec.alpha_channel != 3) || (spec.format != type))
+		return false;
+
+	// In memory buffer only (not backed by the image cache)
+	if (buf.localpixels() == NULL)
+		return false;
+
+	return (buf.pixel_stride() == 4 * (long) type.size());
+}
+
+
+bool Blend::over(OIIO::ImageBuf &dst, const OIIO::ImageBuf &src, OIIO::ROI roi) {
+	int y;
+
+	OIIO::TypeDesc type = dst.spec().format;
+
+	// Generic blend for any other format
+	if (((type != OIIO::TypeDesc::UINT8) && (type != OIIO::TypeDesc::UINT16))
+		|| !isRGBA(dst, type) || !isRGBA(src, type))
+		return OIIO::ImageBufAlgo::over(dst, src, dst, roi);
+
+	// Blend area, dst is left as is out of src
+	if (!roi.defined())
+		roi = dst.roi();
+
+	roi = OIIO::roi_intersection(roi, OIIO::roi_intersection(dst.roi(), src.roi()));
+
+	if ((roi.xbegin >= roi.xend) || (roi.ybegin >= roi.yend))
+		return true;
+
+	for (y=roi.ybegin; y<roi.yend; y++) {
+		if (type == OIIO::TypeDesc::UINT8) {
+			overRGBA8((uint8_t *) dst.pixeladdr(roi.xbegin, y),
+				(const uint8_t *) src.pixeladdr(roi.xbegin, y),
+				roi.width());
+		}
+		else {
+			overRGBA16((uint16_t *) dst.pixeladdr(roi.xbegin, y),
+				(const uint16_t *) src.pixeladdr(roi.xbegin, y),
+				roi.width());
+		}
+	}
+
+	return true;
+}
+
@@ -0,0 +1,43 @@
+#ifndef __GPX2VIDEO__BLEND_H__
+#define __GPX2VIDEO__BLEND_H__
+
+#include <cstdint>
+#include <cstddef>
+
+#include <OpenImageIO/imageio.h>
+#include <OpenImageIO/imagebuf.h>
+#include <OpenImageIO/imagebufalgo.h>
+
+
+// Alpha blend kernels
+//
+// 'src' over 'dst' for RGBA 8 bits & 16 bits pixels, with premultiplied
+// (associated) alpha source: dst = src + dst * (1 - src.alpha)
+//
+// Results are rounded as ImageBufAlgo::over does. SSE4 & AVX2 kernels are
+// selected at runtime, the scalar kernel is used on any other CPU.
+class Blend {
+public:
+	enum Kernel {
+		KernelAuto,
+		KernelScalar,
+		KernelSSE4,
+		KernelAVX2,
+
+		KernelCount
+	};
+
+	// 'src' over 'dst' in 'roi', falls back to ImageBufAlgo::over if both
+	// images aren't RGBA in memory buffers of the same format
+	static bool over(OIIO::ImageBuf &dst, const OIIO::ImageBuf &src, OIIO::ROI roi=OIIO::ROI::All());
+
+	static void overRGBA8(uint8_t *dst, const uint8_t *src, size_t count);
+	static void overRGBA16(uint16_t *dst, const uint16_t *src, size_t count);
+
+	// Force a kernel (tests), returns false if CPU doesn't support it
+	static bool setKernel(enum Kernel kernel);
+	static const char * getFriendlyName(enum Kernel kernel);
+};
+
+#endif
+
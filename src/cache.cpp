@@ -1,5 +1,6 @@
 #include "log.h"
 #include "utils.h"
+#include "tilecache.h"
 #include "cache.h"
 
 
@@ -36,10 +37,14 @@ bool Cache::run(void) {
 
 	log_notice("Cache initialization...");
 
-	if (app_.command() != GPX2Video::CommandClear)
+	if (app_.command() == GPX2Video::CommandClear) {
+		rmpath(path_);
 		goto done;
+	}
 
-	rmpath(path_);
+	// Keep cache size bounded
+	if (app_.settings().cachesize() > 0)
+		TileCache::evict(path_, (uint64_t) app_.settings().cachesize() * 1024 * 1024);
 
 done:
 	complete();
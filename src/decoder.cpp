@@ -5,13 +5,22 @@
 
 #include "log.h"
 #include "ffmpegutils.h"
+#include "profiler.h"
 #include "decoder.h"
 
 
 Decoder::Decoder()
-	: fmt_ctx_(NULL)
+	: demuxer_(NULL)
+	, avstream_(NULL)
 	, codec_ctx_(NULL)
-	, sws_ctx_(NULL) {
+	, sws_ctx_(NULL)
+	, width_(0)
+	, height_(0)
+	, rate_(av_make_q(0, 1))
+	, next_ts_(AV_NOPTS_VALUE)
+	, fast_(false)
+	, skip_ts_(AV_NOPTS_VALUE)
+	, origin_(0) {
 }
 
 
@@ -20,22 +29,29 @@ Decoder::~Decoder() {
 }
 
 
-MediaContainer * Decoder::probe(const std::string &filename) {
-	int result;
+MediaContainer * Decoder::probe(const std::string &filename, bool mmap) {
+	return Decoder::probe(std::vector<std::string>(1, filename), mmap);
+}
+
+
+MediaContainer * Decoder::probe(const std::vector<std::string> &filenames, bool mmap) {
 	std::string name;
 	std::string start_time;
 
 	unsigned int i;
 
-	AVFormatContext *fmt_ctx = NULL;
+	Demuxer *demuxer;
+	AVFormatContext *fmt_ctx;
 
 	MediaContainer *container;
 
-	// Open file in a format context
-	if ((result = avformat_open_input(&fmt_ctx, filename.c_str(), NULL, NULL)) < 0) {
-        av_log(NULL, AV_LOG_ERROR, "Cannot open input file\n");
-        return NULL;
-    }
+	// Open & probe file once, the demux context is shared by every decoder
+	if ((demuxer = Demuxer::open(filenames, mmap)) == NULL)
+		return NULL;
+
+	const std::string &filename = demuxer->filename();
+
+	fmt_ctx = demuxer->context();
 	
 	// Read metadata
 	// creation_time = 2020-12-13T09:56:27.000000Z
@@ -47,16 +63,11 @@ MediaContainer * Decoder::probe(const std::string &filename) {
 		start_time = entry->value;
 	}
 
-	// Get stream information from format
-    if ((result = avformat_find_stream_info(fmt_ctx, NULL)) < 0) {
-        av_log(NULL, AV_LOG_ERROR, "Cannot find stream information\n");
-        return NULL;
-    }
-
 	container = new MediaContainer();
 
 	container->setStartTime(start_time);
 	container->setFilename(filename);
+	container->setDemuxer(demuxer);
 
 	// For each stream
 	for (i=0; i<fmt_ctx->nb_streams; i++) {
@@ -86,37 +97,23 @@ MediaContainer * Decoder::probe(const std::string &filename) {
 				AVRational pixel_aspect_ratio;
 				VideoParams::Interlacing interlacing = VideoParams::InterlaceNone;
 
-				// Read at least two frames to get more information about this video stream
-				{
-					AVPacket *packet = av_packet_alloc();
-					AVFrame *frame = av_frame_alloc();
-
-					Decoder instance;
-					instance.open(filename, avstream->index);
-
-					// Read fist frame and retrieve some metadata
-					if (instance.getFrame(packet, frame) >= 0) {
-						// Check if video is interlaced and what field dominance it has if so
-						if (frame->interlaced_frame) {
-							if (frame->top_field_first)
-								interlacing = VideoParams::InterlacedTopFirst;
-							else
-								interlacing = VideoParams::InterlacedBottomFirst;
-						}
-
-						pixel_aspect_ratio = av_guess_sample_aspect_ratio(fmt_ctx, avstream, frame);
-
-						frame_rate = av_guess_frame_rate(fmt_ctx, avstream, frame);
-					}
-
-					// Read second frame
-					// TODO
+				// Stream info has already decoded the first frames, no need to decode again
+				switch (avstream->codecpar->field_order) {
+				case AV_FIELD_TT:
+				case AV_FIELD_TB:
+					interlacing = VideoParams::InterlacedTopFirst;
+					break;
+				case AV_FIELD_BB:
+				case AV_FIELD_BT:
+					interlacing = VideoParams::InterlacedBottomFirst;
+					break;
+				default:
+					break;
+				}
 
-					instance.close();
+				pixel_aspect_ratio = av_guess_sample_aspect_ratio(fmt_ctx, avstream, NULL);
 
-					av_frame_free(&frame);
-					av_packet_free(&packet);
-				}
+				frame_rate = av_guess_frame_rate(fmt_ctx, avstream, NULL);
 
 				AVPixelFormat compatible_pix_fmt = FFmpegUtils::getCompatiblePixelFormat(static_cast<AVPixelFormat>(avstream->codecpar->format));
 
@@ -159,7 +156,7 @@ MediaContainer * Decoder::probe(const std::string &filename) {
 		stream->setName(name);
 		stream->setIndex(avstream->index);
 		stream->setTimeBase(avstream->time_base);
-		stream->setDuration(avstream->duration);
+		stream->setDuration(demuxer->duration(i));
 
 		container->addStream(stream);
 	}
@@ -167,9 +164,6 @@ MediaContainer * Decoder::probe(const std::string &filename) {
 	// Dump input info
     av_dump_format(fmt_ctx, 0, filename.c_str(), 0);
 
-	// Close input
-	avformat_close_input(&fmt_ctx);
-
 	return container;
 }
 
@@ -188,7 +182,7 @@ bool Decoder::open(StreamPtr stream) {
 	stream_ = stream;
 
 	// Try to open
-	if ((result = open(stream->container()->filename(), stream->index())) == false)
+	if ((result = open(stream->container()->demuxer(), stream->index())) == false)
 		return false;
 
 	if (stream->type() == AVMEDIA_TYPE_VIDEO) {
@@ -204,12 +198,20 @@ bool Decoder::open(StreamPtr stream) {
 			av_log(NULL, AV_LOG_ERROR, "Failed to find valid native pixel format for %d\n", ideal_pix_fmt_);
 		}
 
-		// Init scaler
+		// Output size (scaled down by the converter for preview)
+		if ((width_ <= 0) || (height_ <= 0)) {
+			width_ = avstream_->codecpar->width;
+			height_ = avstream_->codecpar->height;
+		}
+
+		// Init scaler (output size: better downscale, except for preview)
+		bool scaled = (width_ != avstream_->codecpar->width) || (height_ != avstream_->codecpar->height);
+
 		sws_ctx_ = sws_getContext(avstream_->codecpar->width, avstream_->codecpar->height, 
 				static_cast<AVPixelFormat>(avstream_->codecpar->format),
-				avstream_->codecpar->width, avstream_->codecpar->height, 
+				width_, height_, 
 				ideal_pix_fmt_,
-				SWS_FAST_BILINEAR, NULL, NULL, NULL);
+				(scaled && !fast_) ? SWS_BICUBIC : SWS_FAST_BILINEAR, NULL, NULL, NULL);
 
 		if (sws_ctx_ == NULL) {
 			log_error("Decoder fails to create scale context");
@@ -221,22 +223,20 @@ bool Decoder::open(StreamPtr stream) {
 }
 
 
-bool Decoder::open(const std::string &filename, const int &index) {
+bool Decoder::open(Demuxer *demuxer, const int &index) {
 	int result;
 
-	if ((result = avformat_open_input(&fmt_ctx_, filename.c_str(), NULL, NULL)) < 0) {
-		av_log(NULL, AV_LOG_ERROR, "Cannot open input file '%s'", filename.c_str());
+	if (demuxer == NULL)
 		return false;
-	}
 
-	// Get stream information from format
-	if ((result = avformat_find_stream_info(fmt_ctx_, NULL)) < 0) {
-		av_log(NULL, AV_LOG_ERROR, "Cannot find stream information\n");
+	// Get reference to correct AVStream (media is already probed)
+	demuxer_ = demuxer;
+	avstream_ = demuxer_->stream(index);
+
+	if (avstream_ == NULL)
 		return false;
-	}
 
-	// Get reference to correct AVStream
-	avstream_ = fmt_ctx_->streams[index];
+	demuxer_->enable(index);
 
 	// Find decoder
 	const AVCodec *decoder = avcodec_find_decoder(avstream_->codecpar->codec_id);
@@ -262,6 +262,16 @@ bool Decoder::open(const std::string &filename, const int &index) {
 		return false;
 	}
 
+	// Preview quality
+	if (fast_) {
+		codec_ctx_->flags2 |= AV_CODEC_FLAG2_FAST;
+		codec_ctx_->skip_loop_filter = AVDISCARD_ALL;
+
+		// Frames are dropped anyway at preview rate
+		if ((rate_.num > 0) && (av_cmp_q(rate_, av_mul_q(avstream_->avg_frame_rate, av_make_q(1, 2))) <= 0))
+			codec_ctx_->skip_frame = AVDISCARD_NONREF;
+	}
+
 	// Open decoder
 	result = avcodec_open2(codec_ctx_, decoder, NULL);
 
@@ -286,13 +296,7 @@ int Decoder::getFrame(AVPacket *packet, AVFrame *frame) {
 
 	while ((result = avcodec_receive_frame(codec_ctx_, frame)) == AVERROR(EAGAIN) && !eof) {
 		// Find next packet in the correct stream index
-		do {
-			// Free buffer in packet if there is one
-			av_packet_unref(packet);
-
-			// Read packet from file
-			result = av_read_frame(fmt_ctx_, packet);
-		} while (packet->stream_index != avstream_->index && result >= 0);
+		result = demuxer_->read(avstream_->index, packet);
 
 		if (result == AVERROR_EOF) {
 			// Don't break so that receive gets called again, but don't try to read again
@@ -332,13 +336,42 @@ void Decoder::close(void) {
 		codec_ctx_ = NULL;
 	}
 
-	if (fmt_ctx_) {
-		avformat_close_input(&fmt_ctx_);
-		fmt_ctx_ = NULL;
+	if (demuxer_) {
+		demuxer_->disable(avstream_->index);
+		demuxer_ = NULL;
 	}
 }
 
 
+void Decoder::setSize(int width, int height) {
+	width_ = width;
+	height_ = height;
+}
+
+
+void Decoder::setFrameRate(AVRational rate) {
+	rate_ = rate;
+}
+
+
+void Decoder::setFast(bool enable) {
+	fast_ = enable;
+}
+
+
+void Decoder::seek(AVRational timecode) {
+	log_call();
+
+	if (codec_ctx_)
+		avcodec_flush_buffers(codec_ctx_);
+
+	next_ts_ = AV_NOPTS_VALUE;
+
+	skip_ts_ = av_rescale_q(timecode.num, av_make_q(1, timecode.den), avstream_->time_base);
+	origin_ = skip_ts_;
+}
+
+
 FramePtr Decoder::retrieveAudio(const AudioParams &params, AVRational timecode) {
 	uint8_t *data;
 
@@ -408,6 +441,16 @@ uint8_t * Decoder::retrieveAudioFrameData(const AudioParams &params, const int64
 			break;
 		}
 
+		// Seek, drop samples before target
+		if (skip_ts_ != AV_NOPTS_VALUE) {
+			int64_t end = frame->pts + av_rescale_q(frame->nb_samples, av_make_q(1, frame->sample_rate), avstream_->time_base);
+
+			if (end <= skip_ts_)
+				continue;
+
+			skip_ts_ = AV_NOPTS_VALUE;
+		}
+
 //		// Allocate buffers
 //		int nb_samples = swr_get_out_samples(resampler, frame->nb_samples);
 //		size_t size = params.samplesToBytes(nb_samples);
@@ -418,6 +461,9 @@ uint8_t * Decoder::retrieveAudioFrameData(const AudioParams &params, const int64
 
 		pts_ = frame->pts;
 
+		// Output audio starts at seek position
+		frame->pts -= origin_;
+
 		break;
 	}
 
@@ -435,6 +481,8 @@ uint8_t * Decoder::retrieveAudioFrameData(const AudioParams &params, const int64
 FramePtr Decoder::retrieveVideo(AVRational timecode) {
 	uint8_t *data;
 
+	PROFILE_SCOPE("decode");
+
 	VideoStreamPtr vs = std::static_pointer_cast<VideoStream>(stream());
 
 	int64_t target_ts = vs->getTimeInTimeBaseUnits(timecode);
@@ -446,7 +494,7 @@ FramePtr Decoder::retrieveVideo(AVRational timecode) {
 	// Return the frame
 	FramePtr frame = Frame::create();
 
-	frame->setVideoParams(VideoParams(vs->width(), vs->height(),
+	frame->setVideoParams(VideoParams(width_, height_,
 		native_pix_fmt_,
 		native_nb_channels_,
 		std::static_pointer_cast<VideoStream>(stream())->pixelAspectRatio(),
@@ -483,21 +531,46 @@ uint8_t * Decoder::retrieveVideoFrameData(const int64_t& target_ts) {
 			break;
 		}
 
+		// Seek, drop frames before target (not converted)
+		if (skip_ts_ != AV_NOPTS_VALUE) {
+			if (frame->pts < skip_ts_)
+				continue;
+
+			skip_ts_ = AV_NOPTS_VALUE;
+		}
+
+		// Output rate, drop frames before next one (not converted)
+		if (rate_.num > 0) {
+			int64_t interval = av_rescale_q(1, av_inv_q(rate_), avstream_->time_base);
+
+			if ((next_ts_ != AV_NOPTS_VALUE) && (frame->pts < next_ts_))
+				continue;
+
+			next_ts_ = (next_ts_ == AV_NOPTS_VALUE) ? frame->pts + interval : next_ts_ + interval;
+
+			if (next_ts_ <= frame->pts)
+				next_ts_ = frame->pts + interval;
+		}
+
 		// Store data
-		int linesize = Frame::generateLinesizeBytes(frame->width, native_pix_fmt_, native_nb_channels_);
-		size_t size = VideoParams::getBufferSize(linesize, frame->height, native_pix_fmt_, native_nb_channels_);
+		int linesize = Frame::generateLinesizeBytes(width_, native_pix_fmt_, native_nb_channels_);
+		size_t size = VideoParams::getBufferSize(linesize, height_, native_pix_fmt_, native_nb_channels_);
 //printf("linesize = [%d,%d,%d] / dst_linesize = %d / height = %d\n", 
 //		frame->linesize[0], frame->linesize[1], frame->linesize[2], linesize, frame->height);
 //printf("buffsize = %ld\n", size);
 		data = (uint8_t *) malloc(size * sizeof(uint8_t));
 
-		sws_scale(sws_ctx_,
-			(const uint8_t * const *) frame->data,
-			frame->linesize,
-			0,
-			frame->height,
-			&data,
-			&linesize);
+		{
+			PROFILE_SCOPE("decode scale");
+
+			sws_scale(sws_ctx_,
+				(const uint8_t * const *) frame->data,
+				frame->linesize,
+				0,
+				frame->height,
+				&data,
+				&linesize);
+		}
 
 		pts_ = frame->pts;
 
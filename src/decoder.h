@@ -14,13 +14,15 @@ extern "C" {
 #include "frame.h"
 #include "stream.h"
 #include "media.h"
+#include "demuxer.h"
 
 
 class Decoder {
 public:
 	virtual ~Decoder();
 
-	static MediaContainer * probe(const std::string &filename);
+	static MediaContainer * probe(const std::string &filename, bool mmap=false);
+	static MediaContainer * probe(const std::vector<std::string> &filenames, bool mmap=false);
 
 	static Decoder * create(void);
 
@@ -28,6 +30,16 @@ public:
 	int getFrame(AVPacket *packet, AVFrame *frame);
 	void close(void);
 
+	// Drop frames before timecode, once the demuxer is seeked before it
+	void seek(AVRational timecode);
+
+	// Video output size (preview, --output-size) & rate (preview), set before open
+	void setSize(int width, int height);
+	void setFrameRate(AVRational rate);
+
+	// Faster decoding, lower quality (no loop filter, non reference frames skipped)
+	void setFast(bool enable);
+
 	FramePtr retrieveAudio(const AudioParams &params, AVRational timecode);
 	uint8_t * retrieveAudioFrameData(const AudioParams &params, const int64_t& target_ts);
 
@@ -39,7 +51,7 @@ protected:
 		return stream_;
 	}
 
-	bool open(const std::string &filename, const int &index);
+	bool open(Demuxer *demuxer, const int &index);
 
 private:
 	static uint64_t validateChannelLayout(AVStream* stream);
@@ -50,7 +62,7 @@ private:
 
 	StreamPtr stream_;
 
-	AVFormatContext *fmt_ctx_;
+	Demuxer *demuxer_;
 
 	AVStream *avstream_;
 	AVCodecContext *codec_ctx_;
@@ -61,7 +73,19 @@ private:
 
 	SwsContext *sws_ctx_;
 
+	int width_;
+	int height_;
+
+	AVRational rate_;
+	int64_t next_ts_;
+
+	bool fast_;
+
 	int64_t pts_;
+
+	// Seek target, output audio starts at origin
+	int64_t skip_ts_;
+	int64_t origin_;
 };
 
 #endif
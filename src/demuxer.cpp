@@ -0,0 +1,610 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <functional>
+#include <cstdlib>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <limits.h>
+
+#include "log.h"
+#include "utils.h"
+#include "macros.h"
+#include "demuxer.h"
+
+
+Demuxer::Demuxer(const std::vector<std::string> &filenames, bool mmap)
+	: filenames_(filenames)
+	, mmap_(mmap)
+	, fmt_ctx_(NULL)
+	, chapter_(0)
+	, eof_(false) {
+}
+
+
+Demuxer::~Demuxer() {
+	for (std::deque<AVPacket *> &queue : queues_) {
+		for (AVPacket *packet : queue)
+			av_packet_free(&packet);
+	}
+
+	// Next chapters (first one is fmt_ctx_)
+	for (size_t i=1; i<chapters_.size(); i++)
+		avformat_close_input(&chapters_[i]);
+
+	if (fmt_ctx_)
+		avformat_close_input(&fmt_ctx_);
+
+	// Custom inputs are released once contexts are closed
+	for (MmapReader *reader : readers_)
+		delete reader;
+}
+
+
+Demuxer * Demuxer::open(const std::string &filename, bool mmap) {
+	return Demuxer::open(std::vector<std::string>(1, filename), mmap);
+}
+
+
+Demuxer * Demuxer::open(const std::vector<std::string> &filenames, bool mmap) {
+	if (filenames.empty())
+		return NULL;
+
+	Demuxer *demuxer = new Demuxer(filenames, mmap);
+
+	if (!demuxer->init()) {
+		delete demuxer;
+		return NULL;
+	}
+
+	return demuxer;
+}
+
+
+std::vector<std::string> Demuxer::chapters(const std::string &filename) {
+	int n;
+	int number;
+
+	char name[16];
+	char prefix;
+
+	std::string dir, base, ext;
+
+	std::vector<std::string> filenames(1, filename);
+
+	size_t pos = filename.rfind('/');
+
+	dir = (pos != std::string::npos) ? filename.substr(0, pos + 1) : "";
+	base = (pos != std::string::npos) ? filename.substr(pos + 1) : filename;
+
+	pos = base.rfind('.');
+
+	if (pos == std::string::npos)
+		return filenames;
+
+	ext = base.substr(pos);
+	base = base.substr(0, pos);
+
+	// GoPro file naming:
+	//   GOPR1234 then GP011234, GP021234... (HERO5 and older)
+	//   GH011234 then GH021234, GH031234... (GX for HEVC, HERO6 and newer)
+	if (sscanf(base.c_str(), "GOPR%4d", &number) == 1) {
+		prefix = 'P';
+		n = 1;
+	}
+	else if ((base.length() == 8) && (sscanf(base.c_str(), "G%c%2d%4d", &prefix, &n, &number) == 3)) {
+		n++;
+	}
+	else
+		return filenames;
+
+	for (; n<100; n++) {
+		snprintf(name, sizeof(name), "G%c%02d%04d", prefix, n, number);
+
+		std::string chapter = dir + name + ext;
+
+		if (access(chapter.c_str(), R_OK) != 0)
+			break;
+
+		filenames.push_back(chapter);
+	}
+
+	return filenames;
+}
+
+
+bool Demuxer::init(void) {
+	struct stat st;
+
+	const std::string &filename_ = filenames_[0];
+
+	log_call();
+
+	// File identity, used to validate the probe cache
+	if (stat(filename_.c_str(), &st) == 0) {
+		std::stringstream stream;
+
+		stream << st.st_dev << ":" << st.st_ino << ":" << st.st_size << ":" << st.st_mtime;
+
+		identity_ = stream.str();
+	}
+
+	// Open file in a format context
+	if (!openInput(&fmt_ctx_, filename_)) {
+		av_log(NULL, AV_LOG_ERROR, "Cannot open input file '%s'\n", filename_.c_str());
+		return false;
+	}
+
+	// Get stream information from format (decodes a few frames, so cache it)
+	if (!loadProbe()) {
+		if (avformat_find_stream_info(fmt_ctx_, NULL) < 0) {
+			av_log(NULL, AV_LOG_ERROR, "Cannot find stream information\n");
+			return false;
+		}
+
+		saveProbe();
+	}
+
+	consumers_.assign(fmt_ctx_->nb_streams, 0);
+	queues_.resize(fmt_ctx_->nb_streams);
+	queued_.assign(fmt_ctx_->nb_streams, 0);
+
+	chapters_.push_back(fmt_ctx_);
+	starts_.push_back(0);
+
+	// Next chapters, stop at the first one that doesn't match
+	for (size_t i=1; i<filenames_.size(); i++) {
+		if (!openChapter(filenames_[i])) {
+			filenames_.resize(i);
+			break;
+		}
+	}
+
+	// Don't demux streams without consumer
+	for (AVFormatContext *ctx : chapters_) {
+		for (unsigned int i=0; i<ctx->nb_streams; i++)
+			ctx->streams[i]->discard = AVDISCARD_ALL;
+	}
+
+	return true;
+}
+
+
+bool Demuxer::openInput(AVFormatContext **ctx, const std::string &filename) {
+	MmapReader *reader = NULL;
+
+	log_call();
+
+	// Memory mapped input (FFmpeg file protocol if the file can't be mapped)
+	if (mmap_)
+		reader = MmapReader::open(filename);
+
+	if (reader != NULL) {
+		if ((*ctx = avformat_alloc_context()) == NULL) {
+			delete reader;
+			return false;
+		}
+
+		(*ctx)->pb = reader->context();
+		(*ctx)->flags |= AVFMT_FLAG_CUSTOM_IO;
+	}
+
+	if (avformat_open_input(ctx, filename.c_str(), NULL, NULL) < 0) {
+		if (reader)
+			delete reader;
+		return false;
+	}
+
+	if (reader)
+		readers_.push_back(reader);
+
+	return true;
+}
+
+
+bool Demuxer::openChapter(const std::string &filename) {
+	int64_t duration;
+
+	AVFormatContext *ctx = NULL;
+	AVFormatContext *prev = chapters_.back();
+
+	log_call();
+
+	// Chapter header only (codec parameters are those of the first chapter)
+	if (!openInput(&ctx, filename)) {
+		log_error("Cannot open '%s' chapter file", filename.c_str());
+		return false;
+	}
+
+	if (ctx->nb_streams != fmt_ctx_->nb_streams) {
+		log_error("Chapter '%s' streams don't match first chapter, skip", filename.c_str());
+		avformat_close_input(&ctx);
+		return false;
+	}
+
+	for (unsigned int i=0; i<ctx->nb_streams; i++) {
+		if ((ctx->streams[i]->codecpar->codec_type != fmt_ctx_->streams[i]->codecpar->codec_type)
+			|| (ctx->streams[i]->codecpar->codec_id != fmt_ctx_->streams[i]->codecpar->codec_id)) {
+			log_error("Chapter '%s' streams don't match first chapter, skip", filename.c_str());
+			avformat_close_input(&ctx);
+			return false;
+		}
+	}
+
+	// Previous chapter duration (longest stream if unknown)
+	duration = prev->duration;
+
+	if (duration == AV_NOPTS_VALUE) {
+		duration = 0;
+
+		for (unsigned int i=0; i<prev->nb_streams; i++) {
+			AVStream *avstream = prev->streams[i];
+
+			if (avstream->duration != AV_NOPTS_VALUE)
+				duration = MAX(duration, av_rescale_q(avstream->duration, avstream->time_base, AV_TIME_BASE_Q));
+		}
+	}
+
+	log_info("Media chapter %d: '%s'", (int) chapters_.size() + 1, filename.c_str());
+
+	starts_.push_back(starts_.back() + duration);
+	chapters_.push_back(ctx);
+
+	return true;
+}
+
+
+std::string Demuxer::probePath(void) {
+	char path[PATH_MAX];
+
+	std::stringstream stream;
+
+	if (realpath(filenames_[0].c_str(), path) == NULL)
+		return "";
+
+	stream << std::getenv("HOME") << "/.gpx2video/cache/probe/" << std::hex << std::hash<std::string>()(path);
+
+	return stream.str();
+}
+
+
+bool Demuxer::loadProbe(void) {
+	int version;
+	unsigned int nb_streams;
+
+	int64_t start_time, duration, bit_rate;
+
+	std::string key;
+	std::string identity;
+	std::string filename = probePath();
+
+	if (filename.empty() || identity_.empty())
+		return false;
+
+	std::ifstream stream(filename);
+
+	if (!stream.is_open())
+		return false;
+
+	stream >> key >> version;
+
+	if ((key != "version") || (version != DEMUXER_PROBE_VERSION))
+		return false;
+
+	stream >> key >> identity;
+
+	if ((key != "identity") || (identity != identity_))
+		return false;
+
+	// Timings (estimated on stream info lookup)
+	stream >> key >> start_time >> duration >> bit_rate;
+
+	if (!stream || (key != "timings"))
+		return false;
+
+	stream >> key >> nb_streams;
+
+	if ((key != "streams") || (nb_streams != fmt_ctx_->nb_streams))
+		return false;
+
+	for (unsigned int i=0; i<nb_streams; i++) {
+		int type, codec_id;
+		int format, width, height, field_order;
+		int sample_rate, channels;
+		uint64_t channel_layout;
+		int64_t stream_start_time, stream_duration;
+		AVRational sar, avg_frame_rate, r_frame_rate;
+
+		AVStream *avstream = fmt_ctx_->streams[i];
+
+		stream >> key >> type >> codec_id
+			>> format >> width >> height >> field_order
+			>> sample_rate >> channels >> channel_layout
+			>> sar.num >> sar.den
+			>> avg_frame_rate.num >> avg_frame_rate.den
+			>> r_frame_rate.num >> r_frame_rate.den
+			>> stream_start_time >> stream_duration;
+
+		if (!stream || (key != "stream"))
+			return false;
+
+		// Header doesn't match cache
+		if ((type != avstream->codecpar->codec_type) || (codec_id != avstream->codecpar->codec_id))
+			return false;
+
+		avstream->codecpar->format = format;
+		avstream->codecpar->width = width;
+		avstream->codecpar->height = height;
+		avstream->codecpar->field_order = (enum AVFieldOrder) field_order;
+		avstream->codecpar->sample_rate = sample_rate;
+		avstream->codecpar->channels = channels;
+		avstream->codecpar->channel_layout = channel_layout;
+		avstream->codecpar->sample_aspect_ratio = sar;
+		avstream->sample_aspect_ratio = sar;
+		avstream->avg_frame_rate = avg_frame_rate;
+		avstream->r_frame_rate = r_frame_rate;
+		avstream->start_time = stream_start_time;
+		avstream->duration = stream_duration;
+	}
+
+	fmt_ctx_->start_time = start_time;
+	fmt_ctx_->duration = duration;
+	fmt_ctx_->bit_rate = bit_rate;
+
+	log_info("Media stream info loaded from cache");
+
+	return true;
+}
+
+
+bool Demuxer::saveProbe(void) {
+	std::string path = probePath();
+
+	if (path.empty() || identity_.empty())
+		return false;
+
+	std::string dir = path.substr(0, path.rfind('/'));
+
+	if (::mkpath(dir, 0700) != 0)
+		return false;
+
+	std::ofstream stream(path);
+
+	if (!stream.is_open())
+		return false;
+
+	stream << "version " << DEMUXER_PROBE_VERSION << std::endl;
+	stream << "identity " << identity_ << std::endl;
+	stream << "timings " << fmt_ctx_->start_time << " " << fmt_ctx_->duration << " " << fmt_ctx_->bit_rate << std::endl;
+	stream << "streams " << fmt_ctx_->nb_streams << std::endl;
+
+	for (unsigned int i=0; i<fmt_ctx_->nb_streams; i++) {
+		AVStream *avstream = fmt_ctx_->streams[i];
+		AVCodecParameters *codecpar = avstream->codecpar;
+
+		stream << "stream "
+			<< codecpar->codec_type << " " << codecpar->codec_id << " "
+			<< codecpar->format << " " << codecpar->width << " " << codecpar->height << " " << codecpar->field_order << " "
+			<< codecpar->sample_rate << " " << codecpar->channels << " " << codecpar->channel_layout << " "
+			<< avstream->sample_aspect_ratio.num << " " << avstream->sample_aspect_ratio.den << " "
+			<< avstream->avg_frame_rate.num << " " << avstream->avg_frame_rate.den << " "
+			<< avstream->r_frame_rate.num << " " << avstream->r_frame_rate.den << " "
+			<< avstream->start_time << " " << avstream->duration << std::endl;
+	}
+
+	return true;
+}
+
+
+AVStream * Demuxer::stream(int index, int chapter) {
+	if ((index < 0) || (index >= (int) fmt_ctx_->nb_streams))
+		return NULL;
+
+	if ((chapter < 0) || (chapter >= (int) chapters_.size()))
+		return NULL;
+
+	return chapters_[chapter]->streams[index];
+}
+
+
+int64_t Demuxer::duration(int index) {
+	AVStream *ref = fmt_ctx_->streams[index];
+	AVStream *last = chapters_.back()->streams[index];
+
+	if ((chapters_.size() == 1) || (last->duration == AV_NOPTS_VALUE))
+		return ref->duration;
+
+	return av_rescale_q(starts_.back(), AV_TIME_BASE_Q, ref->time_base)
+		+ av_rescale_q(last->duration, last->time_base, ref->time_base);
+}
+
+
+int64_t Demuxer::timestamp(int index, int chapter, int64_t ts) {
+	AVStream *ref = fmt_ctx_->streams[index];
+	AVStream *avstream = chapters_[chapter]->streams[index];
+
+	if ((chapter == 0) || (ts == AV_NOPTS_VALUE))
+		return ts;
+
+	// Chapter streams start where the previous chapter ends
+	if (avstream->start_time != AV_NOPTS_VALUE)
+		ts -= avstream->start_time;
+
+	ts = av_rescale_q(ts, avstream->time_base, ref->time_base);
+
+	if (ref->start_time != AV_NOPTS_VALUE)
+		ts += ref->start_time;
+
+	return ts + av_rescale_q(starts_[chapter], AV_TIME_BASE_Q, ref->time_base);
+}
+
+
+bool Demuxer::seek(int index, int64_t ts) {
+	size_t c;
+
+	int64_t start;
+
+	AVStream *ref, *avstream;
+
+	log_call();
+
+	if ((index < 0) || (index >= (int) fmt_ctx_->nb_streams))
+		return false;
+
+	ref = fmt_ctx_->streams[index];
+
+	// Chapter of the timestamp
+	for (c=chapters_.size()-1; c>0; c--) {
+		start = av_rescale_q(starts_[c], AV_TIME_BASE_Q, ref->time_base);
+
+		if (ref->start_time != AV_NOPTS_VALUE)
+			start += ref->start_time;
+
+		if (ts >= start)
+			break;
+	}
+
+	// Timeline timestamp to chapter timestamp
+	if (c > 0) {
+		avstream = chapters_[c]->streams[index];
+
+		ts = av_rescale_q(ts - start, ref->time_base, avstream->time_base);
+
+		if (avstream->start_time != AV_NOPTS_VALUE)
+			ts += avstream->start_time;
+	}
+
+	if (av_seek_frame(chapters_[c], index, ts, AVSEEK_FLAG_BACKWARD) < 0) {
+		log_error("Seek media to %ld failure", (long) ts);
+		return false;
+	}
+
+	// Next chapters are read from their beginning
+	for (size_t i=c+1; i<chapters_.size(); i++)
+		av_seek_frame(chapters_[i], -1, 0, AVSEEK_FLAG_BACKWARD);
+
+	chapter_ = c;
+	eof_ = false;
+
+	// Drop queued packets
+	for (std::deque<AVPacket *> &queue : queues_) {
+		for (AVPacket *packet : queue)
+			av_packet_free(&packet);
+
+		queue.clear();
+	}
+
+	queued_.assign(queued_.size(), 0);
+
+	return true;
+}
+
+
+void Demuxer::enable(int index) {
+	if ((index < 0) || (index >= (int) fmt_ctx_->nb_streams))
+		return;
+
+	if (consumers_[index]++ > 0)
+		return;
+
+	for (AVFormatContext *ctx : chapters_)
+		ctx->streams[index]->discard = AVDISCARD_DEFAULT;
+}
+
+
+void Demuxer::disable(int index) {
+	if ((index < 0) || (index >= (int) fmt_ctx_->nb_streams))
+		return;
+
+	if ((consumers_[index] == 0) || (--consumers_[index] > 0))
+		return;
+
+	for (AVFormatContext *ctx : chapters_)
+		ctx->streams[index]->discard = AVDISCARD_ALL;
+
+	// Flush stream queue
+	for (AVPacket *packet : queues_[index])
+		av_packet_free(&packet);
+
+	queues_[index].clear();
+	queued_[index] = 0;
+}
+
+
+int Demuxer::read(int index, AVPacket *packet) {
+	int result;
+
+	AVPacket *pkt;
+
+	av_packet_unref(packet);
+
+	// Packet already demuxed
+	if (!queues_[index].empty()) {
+		pkt = queues_[index].front();
+		queues_[index].pop_front();
+
+		queued_[index] -= MIN(queued_[index], (size_t) pkt->size);
+
+		av_packet_move_ref(packet, pkt);
+		av_packet_free(&pkt);
+
+		return 0;
+	}
+
+	if (eof_)
+		return AVERROR_EOF;
+
+	for (;;) {
+		result = av_read_frame(chapters_[chapter_], packet);
+
+		// Roll over next chapter
+		if ((result == AVERROR_EOF) && (chapter_ + 1 < chapters_.size())) {
+			chapter_++;
+			continue;
+		}
+
+		if (result == AVERROR_EOF)
+			eof_ = true;
+
+		if (result < 0)
+			break;
+
+		// Continuous timeline
+		if (chapter_ > 0) {
+			AVStream *avstream = chapters_[chapter_]->streams[packet->stream_index];
+
+			packet->pts = timestamp(packet->stream_index, chapter_, packet->pts);
+			packet->dts = timestamp(packet->stream_index, chapter_, packet->dts);
+			packet->duration = av_rescale_q(packet->duration, avstream->time_base, fmt_ctx_->streams[packet->stream_index]->time_base);
+		}
+
+		if (packet->stream_index == index)
+			break;
+
+		// Queue packet for its consumer
+		if (consumers_[packet->stream_index] > 0) {
+			pkt = av_packet_alloc();
+
+			av_packet_move_ref(pkt, packet);
+
+			queues_[pkt->stream_index].push_back(pkt);
+			queued_[pkt->stream_index] += pkt->size;
+
+			// Consumer of this stream doesn't read it
+			if (queued_[pkt->stream_index] > DEMUXER_MAX_QUEUE) {
+				log_error("Demux stream %d failure, stream %d queue is full (%d packets not read)",
+					index, pkt->stream_index, (int) queues_[pkt->stream_index].size());
+				result = AVERROR(ENOBUFS);
+				break;
+			}
+		}
+		else
+			av_packet_unref(packet);
+	}
+
+	return result;
+}
+
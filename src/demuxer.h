@@ -0,0 +1,114 @@
+#ifndef __GPX2VIDEO__DEMUXER_H__
+#define __GPX2VIDEO__DEMUXER_H__
+
+#include <string>
+#include <vector>
+#include <deque>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+#include "mmapreader.h"
+
+
+// Packet queue size limit by stream (bytes)
+#define DEMUXER_MAX_QUEUE (64 * 1024 * 1024)
+
+// Probe cache file format, cache files of another version are ignored
+#define DEMUXER_PROBE_VERSION 2
+
+
+// One demux context shared by every consumer of a media file
+//
+// Each stream has its own packet queue: a packet read for a stream
+// goes to the queue of its stream if it has a consumer, else it's
+// dropped (and the stream is discarded by the demuxer).
+//
+// Consumers must read their stream along the others: a stream enabled
+// but not read piles up its packets. Queues are bounded (DEMUXER_MAX_QUEUE
+// bytes), once a queue is full, read fails with AVERROR(ENOBUFS) (queued
+// packets are kept). A stream not read for a while has to be disabled.
+//
+// A media can be split in several chapter files (GoPro): chapters are
+// read one after the other as one continuous timeline. Timestamps are
+// in the time base of the first chapter streams.
+//
+// With 'mmap', files are read through a memory mapping with read ahead
+// instead of the FFmpeg file protocol.
+class Demuxer {
+public:
+	virtual ~Demuxer();
+
+	static Demuxer * open(const std::string &filename, bool mmap=false);
+	static Demuxer * open(const std::vector<std::string> &filenames, bool mmap=false);
+
+	// GoPro chapter files of a media, starting with filename
+	static std::vector<std::string> chapters(const std::string &filename);
+
+	const std::string& filename(int chapter=0) const {
+		return filenames_[chapter];
+	}
+
+	int nbChapters(void) const {
+		return (int) chapters_.size();
+	}
+
+	AVFormatContext * context(void) {
+		return fmt_ctx_;
+	}
+
+	AVStream * stream(int index, int chapter=0);
+
+	// Stream duration of the whole timeline
+	int64_t duration(int index);
+
+	// Chapter timestamp to timeline timestamp
+	int64_t timestamp(int index, int chapter, int64_t ts);
+
+	// Register / unregister a stream consumer
+	void enable(int index);
+	void disable(int index);
+
+	// Next packet of a stream
+	int read(int index, AVPacket *packet);
+
+	// Seek every stream to the keyframe before the timestamp of a stream
+	bool seek(int index, int64_t ts);
+
+protected:
+	bool init(void);
+	bool openInput(AVFormatContext **ctx, const std::string &filename);
+	bool openChapter(const std::string &filename);
+
+	// Stream info cache, keyed by file identity
+	bool loadProbe(void);
+	bool saveProbe(void);
+	std::string probePath(void);
+
+private:
+	Demuxer(const std::vector<std::string> &filenames, bool mmap);
+
+	std::vector<std::string> filenames_;
+
+	bool mmap_;
+	std::vector<MmapReader *> readers_;
+	std::string identity_;
+
+	AVFormatContext *fmt_ctx_;
+
+	// Chapters (first one is fmt_ctx_), start in AV_TIME_BASE units
+	std::vector<AVFormatContext *> chapters_;
+	std::vector<int64_t> starts_;
+	size_t chapter_;
+
+	std::vector<int> consumers_;
+	std::vector<std::deque<AVPacket *> > queues_;
+	std::vector<size_t> queued_;
+
+	bool eof_;
+};
+
+#endif
+
@@ -1,10 +1,15 @@
 #include "log.h"
 #include "ffmpegutils.h"
+#include "profiler.h"
 #include "encoder.h"
 
 
 EncoderSettings::EncoderSettings() :
+	write_buffer_(0),
 	video_enabled_(false),
+	video_codec_id_(AV_CODEC_ID_NONE),
+	frame_width_(0),
+	frame_height_(0),
 	video_bit_rate_(0),
 	video_max_bit_rate_(0),
 	video_buffer_size_(0),
@@ -38,6 +43,27 @@ void EncoderSettings::setVideoParams(const VideoParams &video_params, AVCodecID
 }
 
 
+AVCodecID EncoderSettings::videoCodecId(void) const {
+	return video_codec_id_;
+}
+
+
+int EncoderSettings::frameWidth(void) const {
+	return (frame_width_ > 0) ? frame_width_ : video_params_.width();
+}
+
+
+int EncoderSettings::frameHeight(void) const {
+	return (frame_height_ > 0) ? frame_height_ : video_params_.height();
+}
+
+
+void EncoderSettings::setFrameSize(int width, int height) {
+	frame_width_ = width;
+	frame_height_ = height;
+}
+
+
 const AudioParams& EncoderSettings::audioParams(void) const {
 	return audio_params_;
 }
@@ -70,6 +96,16 @@ void EncoderSettings::setVideoBufferSize(const int64_t size) {
 }
 
 
+const std::string& EncoderSettings::videoPreset(void) const {
+	return video_preset_;
+}
+
+
+void EncoderSettings::setVideoPreset(const std::string &preset) {
+	video_preset_ = preset;
+}
+
+
 bool EncoderSettings::isAudioEnabled(void) const {
 	return audio_enabled_;
 }
@@ -80,14 +116,28 @@ void EncoderSettings::setAudioBitrate(const int64_t rate) {
 }
 
 
+size_t EncoderSettings::writeBuffer(void) const {
+	return write_buffer_;
+}
+
+
+void EncoderSettings::setWriteBuffer(const size_t size) {
+	write_buffer_ = size;
+}
+
+
 Encoder::Encoder(const EncoderSettings &settings) : 
 	settings_(settings),
 	open_(false),
 	fmt_ctx_(NULL),
+	writer_(NULL),
 	video_stream_(NULL),
 	video_codec_(NULL),
 	audio_stream_(NULL),
-	audio_codec_(NULL) {
+	audio_codec_(NULL),
+	bytes_(0),
+	video_frames_(0),
+	video_packets_(0) {
 	log_call();
 }
 
@@ -102,6 +152,11 @@ const EncoderSettings& Encoder::settings() const {
 }
 
 
+size_t Encoder::pendingBytes(void) {
+	return writer_ ? writer_->pending() : 0;
+}
+
+
 Encoder * Encoder::create(const EncoderSettings &settings) {
 	Encoder *encoder = new Encoder(settings);
 
@@ -122,7 +177,7 @@ bool Encoder::open(void) {
 
 	// Initialize video stream
 	if (settings().isVideoEnabled()) {
-		if (!this->initializeStream(AVMEDIA_TYPE_VIDEO, &video_stream_, &video_codec_, AV_CODEC_ID_H264))
+		if (!this->initializeStream(AVMEDIA_TYPE_VIDEO, &video_stream_, &video_codec_, settings_.videoCodecId()))
 			return false;
 
 		// Decoder use a compatible AVPixelFormat
@@ -152,11 +207,15 @@ bool Encoder::open(void) {
 //			(AVPixelFormat) video_codec_->pix_fmt,
 //			0, NULL, NULL, NULL);
 
-		sws_ctx_ = sws_getContext(settings_.videoParams().width(), settings_.videoParams().height(), 
+		// Frames are resized by the color conversion (--output-size upscale)
+		bool scaled = (settings_.frameWidth() != settings_.videoParams().width())
+			|| (settings_.frameHeight() != settings_.videoParams().height());
+
+		sws_ctx_ = sws_getContext(settings_.frameWidth(), settings_.frameHeight(), 
 			ideal_pix_fmt,
 			settings_.videoParams().width(), settings_.videoParams().height(), 
 			(AVPixelFormat) video_codec_->pix_fmt,
-			0, NULL, NULL, NULL);
+			scaled ? SWS_BICUBIC : 0, NULL, NULL, NULL);
 
 	}
 
@@ -170,7 +229,18 @@ bool Encoder::open(void) {
     av_dump_format(fmt_ctx_, 0, settings_.filename().c_str(), 1);
 
 	// Open output file for writing
-	if (!(fmt_ctx_->oformat->flags & AVFMT_NOFILE)) {
+	if (!(fmt_ctx_->oformat->flags & AVFMT_NOFILE) && (settings_.writeBuffer() > 0)) {
+		// Muxer output written by a writer thread
+		writer_ = AsyncWriter::open(settings_.filename(), settings_.writeBuffer());
+
+		if (writer_ == NULL) {
+			av_log(NULL, AV_LOG_ERROR, "Could not open output file '%s'\n", settings_.filename().c_str());
+			return false;
+		}
+
+		fmt_ctx_->pb = writer_->context();
+	}
+	else if (!(fmt_ctx_->oformat->flags & AVFMT_NOFILE)) {
 		result = avio_open(&fmt_ctx_->pb, settings_.filename().c_str(), AVIO_FLAG_WRITE);
 
 		if (result < 0) {
@@ -202,12 +272,26 @@ void Encoder::close(void) {
 		// Write trailer
 		av_write_trailer(fmt_ctx_);
 
-		if (!(fmt_ctx_->oformat->flags & AVFMT_NOFILE))
+		if (writer_) {
+			if (!writer_->close())
+				av_log(NULL, AV_LOG_ERROR, "Could not write output file '%s'\n", settings_.filename().c_str());
+
+			fmt_ctx_->pb = NULL;
+		}
+		else if (!(fmt_ctx_->oformat->flags & AVFMT_NOFILE))
 			avio_closep(&fmt_ctx_->pb);
 
 		open_ = false;
 	}
 
+	if (writer_) {
+		if (fmt_ctx_)
+			fmt_ctx_->pb = NULL;
+
+		delete writer_;
+		writer_ = NULL;
+	}
+
 	if (sws_ctx_) {
 		sws_freeContext(sws_ctx_);
 		sws_ctx_ = NULL;
@@ -309,6 +393,9 @@ bool Encoder::initializeStream(AVMediaType type, AVStream **stream_ptr, AVCodecC
 // codec/ffmpeg/ffmpegencoder.cpp:503
 //				enc_ctx->flags |= AV_CODEC_FLAG_INTERLACED_DCT | AV_CODEC_FLAG_INTERLACED_ME;
 
+		if (!settings().videoPreset().empty())
+			av_opt_set(codec_context->priv_data, "preset", settings().videoPreset().c_str(), AV_OPT_SEARCH_CHILDREN);
+
 //				av_opt_set(enc_ctx->priv_data, "crf", "27", AV_OPT_SEARCH_CHILDREN);
 //				av_opt_set(enc_ctx->priv_data, "crf", "31", AV_OPT_SEARCH_CHILDREN);
 //				av_opt_set(enc_ctx->priv_data, "x264opts", "bff=1", AV_OPT_SEARCH_CHILDREN);
@@ -383,11 +470,13 @@ bool Encoder::writeFrame(FramePtr frame, AVRational time) {
 	int input_linesize;
 	const uint8_t *input_data;
 
+	PROFILE_SCOPE("encode");
+
 	AVFrame *encoded_frame = av_frame_alloc();
 
-	// Frame must be video
-	encoded_frame->width = frame->videoParams().width();
-	encoded_frame->height = frame->videoParams().height();
+	// Frame must be video (encoded at video size)
+	encoded_frame->width = settings().videoParams().width();
+	encoded_frame->height = settings().videoParams().height();
 	encoded_frame->format = video_codec_->pix_fmt;
 
 //	// TODO / FIXME !!!
@@ -424,14 +513,18 @@ bool Encoder::writeFrame(FramePtr frame, AVRational time) {
 	input_data = frame->constData();
 	input_linesize = frame->linesizeBytes();
 
-	result = sws_scale(sws_ctx_,
+	{
+		PROFILE_SCOPE("encode scale");
+
+		result = sws_scale(sws_ctx_,
 //	result = sws_scale((frame->videoParams().nbChannels() == VideoParams::RGBAChannelCount) ? alpha_sws_ctx_ : noalpha_sws_ctx_,
-			reinterpret_cast<const uint8_t * const *>(&input_data),
-			&input_linesize,
-			0,
-			frame->videoParams().height(),
-			encoded_frame->data,
-			encoded_frame->linesize);
+				reinterpret_cast<const uint8_t * const *>(&input_data),
+				&input_linesize,
+				0,
+				frame->videoParams().height(),
+				encoded_frame->data,
+				encoded_frame->linesize);
+	}
 //printf("linesize = [%d,%d,%d] / dst_linesize = %d / height = %d\n", 
 //		encoded_frame->linesize[0], encoded_frame->linesize[1], encoded_frame->linesize[2], input_linesize, encoded_frame->height);
 
@@ -456,6 +549,8 @@ fail:
 bool Encoder::writeAVFrame(AVFrame *frame, AVCodecContext *codec_ctx, AVStream *stream) {
 	int result;
 
+	PROFILE_SCOPE("write");
+
 	// Send raw frame to the encoder
 	result = avcodec_send_frame(codec_ctx, frame);
 
@@ -464,6 +559,9 @@ bool Encoder::writeAVFrame(AVFrame *frame, AVCodecContext *codec_ctx, AVStream *
 		return false;
 	}
 
+	if (frame && (codec_ctx == video_codec_))
+		video_frames_++;
+
 	AVPacket *packet = av_packet_alloc();
 
 	while (result >= 0) {
@@ -480,10 +578,19 @@ bool Encoder::writeAVFrame(AVFrame *frame, AVCodecContext *codec_ctx, AVStream *
 		// Set packet stream index
 		packet->stream_index = stream->index;
 
+		bytes_ += packet->size;
+
+		if (codec_ctx == video_codec_)
+			video_packets_++;
+
         av_packet_rescale_ts(packet, codec_ctx->time_base, stream->time_base);
 
 		// Mux encoded frame
-        av_interleaved_write_frame(fmt_ctx_, packet);
+		{
+			PROFILE_SCOPE("mux");
+
+			av_interleaved_write_frame(fmt_ctx_, packet);
+		}
 
 		// Unref packet in case we're getting another
 		av_packet_unref(packet);
@@ -14,6 +14,7 @@ extern "C" {
 #include "audioparams.h"
 #include "videoparams.h"
 #include "frame.h"
+#include "asyncwriter.h"
 
 
 class EncoderSettings {
@@ -26,6 +27,12 @@ public:
 
 	const VideoParams& videoParams(void) const;
 	void setVideoParams(const VideoParams &video_params, AVCodecID codec_id);
+	AVCodecID videoCodecId(void) const;
+
+	// Input frames size, scaled to video size by the encoder (default: video size)
+	int frameWidth(void) const;
+	int frameHeight(void) const;
+	void setFrameSize(int width, int height);
 
 	const AudioParams& audioParams(void) const;
 	void setAudioParams(const AudioParams &audio_params, AVCodecID codec_id);
@@ -35,18 +42,28 @@ public:
 	void setVideoMaxBitrate(const int64_t rate);
 	void setVideoBufferSize(const int64_t size);
 
+	const std::string& videoPreset(void) const;
+	void setVideoPreset(const std::string &preset);
+
 	bool isAudioEnabled(void) const;
 	void setAudioBitrate(const int64_t rate);
 
+	size_t writeBuffer(void) const;
+	void setWriteBuffer(const size_t size);
+
 private:
 	std::string filename_;
+	size_t write_buffer_;
 
 	bool video_enabled_;
 	VideoParams video_params_;
 	AVCodecID video_codec_id_;
+	int frame_width_;
+	int frame_height_;
 	int64_t video_bit_rate_;
 	int64_t video_max_bit_rate_;
 	int64_t video_buffer_size_;
+	std::string video_preset_;
 
 	bool audio_enabled_;
 	AudioParams audio_params_;
@@ -69,6 +86,19 @@ public:
 	bool writeAudio(FramePtr frame, AVRational time);
 	bool writeFrame(FramePtr frame, AVRational time);
 
+	// Encoded bytes (audio & video packets)
+	int64_t bytes(void) const {
+		return bytes_;
+	}
+
+	// Video frames sent to the codec, not yet encoded (lookahead)
+	int64_t pendingFrames(void) const {
+		return video_frames_ - video_packets_;
+	}
+
+	// Bytes queued by the writer thread
+	size_t pendingBytes(void);
+
 private:
 	Encoder(const EncoderSettings &settings);
 
@@ -85,6 +115,8 @@ private:
 
 	AVFormatContext *fmt_ctx_;
 
+	AsyncWriter *writer_;
+
 	AVStream *video_stream_;
 	AVCodecContext *video_codec_;
 
@@ -95,6 +127,10 @@ private:
 	SwsContext *alpha_sws_ctx_;
 	SwsContext *noalpha_sws_ctx_;
 	VideoParams::Format video_conversion_fmt_;
+
+	int64_t bytes_;
+	int64_t video_frames_;
+	int64_t video_packets_;
 };
 
 #endif
@@ -1,6 +1,8 @@
 #include <string>
+#include <iomanip>
 
-#include <byteswap.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -61,6 +63,10 @@ Extractor::Extractor(GPX2Video &app, const ExtractorSettings &settings)
 	, app_(app) 
 	, settings_(settings) {
 	container_ = NULL;
+	demuxer_ = NULL;
+	avstream_ = NULL;
+
+	next_ = 0;
 }
 
 
@@ -84,11 +90,11 @@ Extractor * Extractor::create(GPX2Video &app, const ExtractorSettings &settings)
 }
 
 
-void Extractor::init(void) {
+void Extractor::init(MediaContainer *container) {
 	log_call();
 
-	// Media
-	container_ = app_.media();
+	// Media (app media by default)
+	container_ = (container != NULL) ? container : app_.media();
 }
 
 
@@ -102,6 +108,8 @@ bool Extractor::start(void) {
 	n_ = 0;
 	ok_ = false;
 
+	gpmf_.reset();
+
 	// Open GPMD stream
 	log_notice("Extract GPMD data...");
 
@@ -141,7 +149,6 @@ done:
 
 bool Extractor::run(void) {
 	char s[92];
-	char buf[128];
 
 	int result;
 
@@ -154,7 +161,7 @@ bool Extractor::run(void) {
 
     AVPacket *packet = NULL;
 
-	Extractor::GPMD gpmd;
+	std::vector<GPMF::Sample> samples;
 
 	log_call();
 
@@ -194,30 +201,18 @@ bool Extractor::run(void) {
 	}
 
 	if (settings().format() == ExtractorSettings::FormatRAW) {
-		out_.write(reinterpret_cast<char*>(packet->data), packet->size); //reinterpret_cast<char*>(&myuint), sizeof(myuint));
+		out_.write(reinterpret_cast<char*>(packet->data), packet->size);
+	}
+	else if (settings().format() == ExtractorSettings::FormatDump) {
+		GPMF::dump(packet->data, packet->size, out_);
+
+		out_ << "###############################################" << std::endl;
 	}
 	else {
-		// Parsing stream packet
-		parse(gpmd, packet->data, packet->size, out_); //(settings().format() == ExtractorSettings::FormatDump));
-
-		// <trkpt lat="42.4586662211" lon="2.017777">
-		//	 <ele>31.4122</ele>
-		//   <time>2021-10-10T06:14:52.000Z</time>
-		// </trkpt>
-		if (settings().format() == ExtractorSettings::FormatGPX) {
-			if (gpmd.fix > 0) {
-				strftime(s, sizeof(s), "%Y-%m-%dT%H:%M:%S", &gpmd.utc_time);
-				snprintf(buf, sizeof(buf), "%s.%03dZ", s, gpmd.utc_ms);
-
-				out_ << std::setprecision(9);
-				out_ << "      <trkpt lat=\"" << gpmd.lat << "\" lon=\"" << gpmd.lon << "\">" << std::endl;
-				out_ << "        <ele>" << gpmd.ele << "</ele>" << std::endl;
-				out_ << "        <time>" << buf << "</time>" << std::endl;
-				out_ << "      </trkpt>" << std::endl;
-			}
-		}
-		else if (settings().format() == ExtractorSettings::FormatDump)
-			out_ << "###############################################" << std::endl;
+		// Parsing stream packet (packet data is left untouched)
+		gpmf_.decode(packet->data, packet->size, samples);
+
+		write(samples);
 	}
 
 	n_++;
@@ -244,7 +239,48 @@ done:
 }
 
 
+void Extractor::write(const std::vector<GPMF::Sample> &samples) {
+	char s[92];
+	char buf[128];
+
+	time_t t;
+	struct tm time;
+
+	if (settings().format() != ExtractorSettings::FormatGPX)
+		return;
+
+	out_ << std::setprecision(9);
+
+	// <trkpt lat="42.4586662211" lon="2.017777">
+	//	 <ele>31.4122</ele>
+	//   <time>2021-10-10T06:14:52.000Z</time>
+	// </trkpt>
+	for (const GPMF::Sample &sample : samples) {
+		if (sample.fix == 0)
+			continue;
+
+		t = sample.time / 1000;
+		gmtime_r(&t, &time);
+
+		strftime(s, sizeof(s), "%Y-%m-%dT%H:%M:%S", &time);
+		snprintf(buf, sizeof(buf), "%s.%03dZ", s, (int) (sample.time % 1000));
+
+		out_ << "      <trkpt lat=\"" << sample.lat << "\" lon=\"" << sample.lon << "\">" << std::endl;
+		out_ << "        <ele>" << sample.ele << "</ele>" << std::endl;
+		out_ << "        <time>" << buf << "</time>" << std::endl;
+		out_ << "      </trkpt>" << std::endl;
+	}
+}
+
+
 bool Extractor::stop(void) {
+	std::vector<GPMF::Sample> samples;
+
+	// Last samples
+	gpmf_.flush(samples);
+
+	write(samples);
+
 	// Write GPX footer
 	if (settings().format() == ExtractorSettings::FormatGPX) {
 		out_ << "    </trkseg>" << std::endl;
@@ -281,259 +317,167 @@ bool Extractor::open(void) {
 		goto done;
 	};
 
-	// Try to open
-	if (avformat_open_input(&fmt_ctx_, stream->container()->filename().c_str(), NULL, NULL) < 0) {
-		av_log(NULL, AV_LOG_ERROR, "Cannot open input file '%s'", stream->container()->filename().c_str());
-		goto done;
-	}
+	// Shared demux context (media is already probed)
+	demuxer_ = container_->demuxer();
 
-	// Get stream information from format
-	if (avformat_find_stream_info(fmt_ctx_, NULL) < 0) {
-		av_log(NULL, AV_LOG_ERROR, "Cannot find stream information\n");
+	if (demuxer_ == NULL)
 		goto done;
-	}
 
 	// Get reference to correct AVStream
-	avstream_ = fmt_ctx_->streams[stream->index()];
-
-	result = true;
-
-done:
-	return result;
-}
+	avstream_ = demuxer_->stream(stream->index());
 
+	// Demux only the telemetry stream, others have their own consumers
+	demuxer_->enable(stream->index());
 
-void Extractor::close(void) {
-	log_call();
-
-	if (fmt_ctx_)
-		avformat_close_input(&fmt_ctx_);
-}
-
+	// Read GPMD samples directly from the sample table (one file per chapter)
+	if (loadIndex()) {
+		for (int c=0; c<demuxer_->nbChapters(); c++) {
+			int fd = ::open(demuxer_->filename(c).c_str(), O_RDONLY);
 
-int Extractor::getPacket(AVPacket *packet) {
-	int result = -1;
-
-	bool eof = false;
-
-	log_call();
-
-	while (!eof) {
-		do {
-			// Free buffer in packet if there is one
-			av_packet_unref(packet);
-		
-			result = av_read_frame(fmt_ctx_, packet);
-		} while (packet->stream_index != avstream_->index && result >= 0);
+			if (fd < 0) {
+				index_.clear();
+				break;
+			}
 
-		if (result == AVERROR_EOF) {
-			// Don't break so that receive gets called again, but don't try to read again
-			eof = true;
-		}
-		else if (result < 0) {
-			// Handle other error by breaking loop and returning the code we received
-			break;
+			fds_.push_back(fd);
 		}
-		else {
-        	av_log(NULL, AV_LOG_DEBUG, "Extract GPX from stream %u\n", packet->stream_index);
 
-			break;
+		if (index_.empty()) {
+			for (int fd : fds_)
+				::close(fd);
+
+			fds_.clear();
 		}
 	}
 
+	result = true;
+
+done:
 	return result;
 }
 
 
-void Extractor::parse(Extractor::GPMD &gpmd, uint8_t *buffer, size_t size, std::ofstream &out) {
-	int i, j, k;
-	int inputtypesize;
-
-	size_t n;
-	size_t len;
-
-	int remain;
-
-	uint32_t key;
-	char string[128];
-
-	uint32_t scal[5] = { 1, 1, 1, 1, 1 };
-
-	struct gpmd_data *data;
-
-	bool dump = (settings().format() == ExtractorSettings::FormatDump);
+void Extractor::close(void) {
+	bool rewind;
 
-#define MAKEKEY(label)		((uint32_t *) &label)[0]
-#define STR2FOURCC(s)		((s[0]<<0)|(s[1]<<8)|(s[2]<<16)|(s[3]<<24))
+	log_call();
 
-	for (n=0; n<size; n=n+sizeof(data->header)) {
-		data = (struct gpmd_data *) (buffer + n);
+	// Packets read in sequence: other streams packets have been dropped,
+	// the shared demuxer has to be read again from the beginning
+	rewind = fds_.empty();
 
-		data->header.count = bswap_16(data->header.count);
+	for (int fd : fds_)
+		::close(fd);
 
-		if (dump) {
-			snprintf(string, sizeof(string), "%c%c%c%c %c 0x%X %u %u", 
-					data->header.label[0], data->header.label[1], data->header.label[2], data->header.label[3], 
-					data->header.type, data->header.type,
-					data->header.size, data->header.count);
-			out << string << std::endl;
-		}
+	fds_.clear();
+	next_ = 0;
+	index_.clear();
 
-		inputtypesize = 4;
-		len = data->header.count * data->header.size;
+	if (demuxer_ && avstream_) {
+		demuxer_->disable(avstream_->index);
 
-		key = MAKEKEY(data->header);
+		if (rewind)
+			demuxer_->seek(avstream_->index, (avstream_->start_time != AV_NOPTS_VALUE) ? avstream_->start_time : 0);
+	}
 
-		// Parse data
-		switch (data->header.type) {
-		case 0x00:
-			continue;
-			break;
+	demuxer_ = NULL;
+}
 
-		case Extractor::GPMF_TYPE_STRING_ASCII: // 0x63
-			memcpy(string, data->value.string, len);
-			string[len] = '\0';
 
-			if (dump)
-				out << "  value: " << string << std::endl;
-			break;
+bool Extractor::loadIndex(void) {
+	int count;
 
-		case Extractor::GPMF_TYPE_SIGNED_SHORT: // 0x73
-			for (i=0; i<data->header.count; i++) {
-				data->value.s16[i] = bswap_16(data->value.s16[i]);
+	log_call();
 
-				if (dump)
-					out << "  value: " << data->value.s16[i] << std::endl;
+	index_.clear();
+	next_ = 0;
+
+	// Chapters sample tables, timestamps on the continuous timeline
+	for (int c=0; c<demuxer_->nbChapters(); c++) {
+		AVStream *avstream = demuxer_->stream(avstream_->index, c);
+
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100)
+		count = avformat_index_get_entries_count(avstream);
+#else
+		count = avstream->nb_index_entries;
+#endif
+
+		for (int i=0; i<count; i++) {
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100)
+			const AVIndexEntry *entry = avformat_index_get_entry(avstream, i);
+#else
+			const AVIndexEntry *entry = &avstream->index_entries[i];
+#endif
+
+			if ((entry == NULL) || (entry->pos < 0) || (entry->size <= 0)) {
+				index_.clear();
+				return false;
 			}
-			break;
 
-		case Extractor::GPMF_TYPE_UNSIGNED_SHORT: // 0x53
-			for (i=0; i<data->header.count; i++) {
-				data->value.u16[i] = bswap_16(data->value.u16[i]);
+			index_.push_back({ c, entry->pos, demuxer_->timestamp(avstream_->index, c, entry->timestamp), entry->size });
+		}
+	}
 
-				if (dump)
-					out << "  value[" << i << "]: " << data->value.u16[i] << std::endl;
-			}
-			break;
+	log_info("GPMD stream: %d samples in sample table", (int) index_.size());
 
-		case Extractor::GPMF_TYPE_FLOAT: // 0x66
-			for (i=0; i<data->header.count; i++) {
-				data->value.real[i] = __bswap_32(data->value.real[i]);
+	return !index_.empty();
+}
 
-				if (dump)
-					out << "  value: " << data->value.real[i] << std::endl;
-			}
-			break;
 
-		case Extractor::GPMF_TYPE_SIGNED_LONG: // 0x6c
-			inputtypesize = 4;
-			for (i=0, k=0; i<data->header.count; i++) {
-				for (j=0; j<data->header.size / inputtypesize; j++) {
-					data->value.s32[k+j] = __bswap_32(data->value.s32[k+j]);
+int Extractor::getPacket(AVPacket *packet) {
+	int result = -1;
 
-					if (dump)
-						out << "  value[" << k+j << "]: " << data->value.s32[k+j] << std::endl;
-				}
-				k += data->header.size / inputtypesize;
-			}
-			break;
+	bool eof = false;
 
-		case Extractor::GPMF_TYPE_UNSIGNED_LONG: // 0x4c
-			inputtypesize = 4;
-			for (i=0, k=0; i<data->header.count; i++) {
-				for (j=0; j<data->header.size / inputtypesize; j++) {
-					data->value.u32[k+j] = __bswap_32(data->value.u32[k+j]);
+	log_call();
 
-					if (dump)
-						out << "  value[" << k+j << "]: " << data->value.u32[k+j] << std::endl;
-				}
-				k += data->header.size / inputtypesize;
-			}
-			break;
+	// Sample table, read only GPMD byte ranges
+	if (!fds_.empty()) {
+		av_packet_unref(packet);
 
-		case Extractor::GPMF_TYPE_UNSIGNED_64BIT_INT: // 0x4a
-			inputtypesize = 8;
-			for (i=0; i<data->header.count; i++) {
-				data->value.u64[i] = __bswap_64(data->value.u64[i]);
+		if (next_ >= index_.size())
+			return AVERROR_EOF;
 
-				if (dump)
-					out << "  value: " << (uint64_t) data->value.u64[i] << std::endl;
-			}
-			break;
+		const IndexEntry &entry = index_[next_++];
 
-		case Extractor::GPMF_TYPE_UTC_DATE_TIME: { // 0x55 16 bytes
-				char *bytes = data->value.string;
-
-				// 2020-12-13T09:56:27.000000Z
-				// buffer contains: 201213085548.215
-				// so format to : YY:MM:DD HH:MM:SS.
-				sprintf(string, "20%c%c-%c%c-%c%c %c%c:%c%c:%c%c.%c%c%c",
-						bytes[0], bytes[1], // YY
-						bytes[2], bytes[3], // MM 
-						bytes[4], bytes[5], // DD
-						bytes[6], bytes[7], // HH
-						bytes[8], bytes[9], // MM
-						bytes[10], bytes[11], // SS
-						bytes[13], bytes[14], bytes[15] // MS
-					);
-
-				// GPS time - format = 2021-12-08 08:55:46.039
-				memset(&gpmd.utc_time, 0, sizeof(gpmd.utc_time));
-				strptime(string, "%Y-%m-%d %H:%M:%S.", &gpmd.utc_time);
-				gpmd.utc_ms = (bytes[13] - '0') * 100 + (bytes[14] - '0') * 10 + (bytes[15] - '0');
-
-				if (dump)
-					out << "  value: " << string << std::endl;
-			}
-			break;
+		if ((result = av_new_packet(packet, entry.size)) < 0)
+			return result;
 
-		case Extractor::GPMF_TYPE_DOUBLE:
-			for (i=0; i<data->header.count; i++) {
-				data->value.u64[i] = __bswap_64(data->value.u64[i]);
+		if (pread(fds_[entry.chapter], packet->data, entry.size, entry.pos) != entry.size) {
+			av_packet_unref(packet);
+			return AVERROR(EIO);
+		}
 
-				if (dump)
-					out << "  mmmmmvalue: " << (double) data->value.u64[i] << std::endl;
-			}
-			break;
+		packet->stream_index = avstream_->index;
+		packet->pts = entry.timestamp;
+		packet->dts = entry.timestamp;
+		packet->pos = entry.pos;
 
-		default:
-			break;
-		}
+		return 0;
+	}
 
-		// Save data
-		if (key == STR2FOURCC("DVNM")) {
-			gpmd.device_name = string;
-		}
-		else if (key == STR2FOURCC("GPSF")) {
-			if ((data->header.type == 'L') && data->header.count) {
-				gpmd.fix = data->value.u32[0];
-			}
-		}
-		else if (key == STR2FOURCC("GPSU")) {
-			gpmd.date = string;
-		}
-		else if (key == STR2FOURCC("SCAL")) {
-			for (i=0, k=0; i<data->header.count; i++) {
-				if (k < (int) sizeof(scal))
-					scal[k] = data->value.u32[k];
+	while (!eof) {
+		do {
+			// Free buffer in packet if there is one
+			av_packet_unref(packet);
+		
+			result = demuxer_->read(avstream_->index, packet);
+		} while (packet->stream_index != avstream_->index && result >= 0);
 
-				k += data->header.size / inputtypesize;
-			}
+		if (result == AVERROR_EOF) {
+			// Don't break so that receive gets called again, but don't try to read again
+			eof = true;
 		}
-		else if (key == STR2FOURCC("GPS5")) {
-			for (i=0, k=0; i<data->header.count; i++) {
-				gpmd.lat = (double) data->value.s32[k] / (double) scal[0];
-				gpmd.lon = (double) data->value.s32[k+1] / (double) scal[1];
-				gpmd.ele = (double) data->value.s32[k+2] / (double) scal[2];
-
-				k += data->header.size / inputtypesize;
-			}
+		else if (result < 0) {
+			// Handle other error by breaking loop and returning the code we received
+			break;
 		}
+		else {
+        	av_log(NULL, AV_LOG_DEBUG, "Extract GPX from stream %u\n", packet->stream_index);
 
-		n += len;
-		remain = len % 4;
-		if (remain > 0)
-			n += 4 - remain;
+			break;
+		}
 	}
-}
 
+	return result;
+}
@@ -0,0 +1,413 @@
+#include <iostream>
+#include <string>
+#include <cstdio>
+#include <cstring>
+
+#include <time.h>
+#include <byteswap.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "log.h"
+#include "macros.h"
+#include "gpmf.h"
+
+
+#define STR2FOURCC(s)		((s[0]<<0)|(s[1]<<8)|(s[2]<<16)|(s[3]<<24))
+
+// KLV header: 4CC label, type, sample size, repeat (big endian)
+#define GPMF_HEADER_SIZE 8
+
+
+static inline uint32_t gpmf_key(const uint8_t *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+
+static inline uint16_t gpmf_be16(const uint8_t *p) {
+	return (p[0] << 8) | p[1];
+}
+
+
+static inline uint32_t gpmf_be32(const uint8_t *p) {
+	return ((uint32_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+
+static inline uint64_t gpmf_be64(const uint8_t *p) {
+	return ((uint64_t) gpmf_be32(p) << 32) | gpmf_be32(p + 4);
+}
+
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("ssse3")))
+static size_t gpmf_bswap32_ssse3(int32_t *dst, const uint8_t *src, size_t n) {
+	size_t i;
+
+	const __m128i mask = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+
+	for (i=0; i+4<=n; i+=4) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (src + i * 4));
+
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_shuffle_epi8(v, mask));
+	}
+
+	return i;
+}
+#endif
+
+
+void GPMF::bswap32(int32_t *dst, const uint8_t *src, size_t n) {
+	size_t i = 0;
+
+#if defined(__x86_64__) || defined(__i386__)
+	static const bool ssse3 = __builtin_cpu_supports("ssse3");
+
+	if (ssse3)
+		i = gpmf_bswap32_ssse3(dst, src, n);
+#endif
+
+	for (; i<n; i++)
+		dst[i] = (int32_t) gpmf_be32(src + i * 4);
+}
+
+
+// GPSU format: yymmddhhmmss.sss
+static int64_t gpmf_utc2ms(const uint8_t *bytes) {
+	struct tm tm;
+
+	for (int i=0; i<16; i++) {
+		if ((i != 12) && ((bytes[i] < '0') || (bytes[i] > '9')))
+			return -1;
+	}
+
+#define DIGITS(i) ((bytes[i] - '0') * 10 + (bytes[i+1] - '0'))
+
+	memset(&tm, 0, sizeof(tm));
+
+	tm.tm_year = 100 + DIGITS(0);
+	tm.tm_mon = DIGITS(2) - 1;
+	tm.tm_mday = DIGITS(4);
+	tm.tm_hour = DIGITS(6);
+	tm.tm_min = DIGITS(8);
+	tm.tm_sec = DIGITS(10);
+
+#undef DIGITS
+
+	return (int64_t) timegm(&tm) * 1000
+		+ (bytes[13] - '0') * 100 + (bytes[14] - '0') * 10 + (bytes[15] - '0');
+}
+
+
+GPMF::GPMF() {
+	reset();
+}
+
+
+GPMF::~GPMF() {
+}
+
+
+void GPMF::reset(void) {
+	device_name_ = "";
+
+	fix_ = 0;
+	time_ = 0;
+
+	time_begin_ = 0;
+	period_ = 1000;
+
+	has_time_ = false;
+	packet_time_ = false;
+
+	current_.clear();
+	pending_.clear();
+}
+
+
+bool GPMF::decode(const uint8_t *buffer, size_t size, std::vector<GPMF::Sample> &samples) {
+	bool result;
+
+	current_.clear();
+	packet_time_ = false;
+
+	result = walk(buffer, size, Scale());
+
+	// No new GPSU stamp, samples share the current time span
+	if (!packet_time_) {
+		pending_.insert(pending_.end(), current_.begin(), current_.end());
+		return result;
+	}
+
+	// Spread pending samples between both GPSU stamps
+	if (has_time_ && (time_ > time_begin_))
+		period_ = time_ - time_begin_;
+
+	if (has_time_) {
+		for (size_t i=0; i<pending_.size(); i++) {
+			pending_[i].time = time_begin_ + (int64_t) i * period_ / (int64_t) pending_.size();
+
+			samples.push_back(pending_[i]);
+		}
+	}
+	else if (!pending_.empty())
+		log_debug("Drop %d GPS samples without time stamp", (int) pending_.size());
+
+	pending_.swap(current_);
+
+	time_begin_ = time_;
+	has_time_ = true;
+
+	return result;
+}
+
+
+void GPMF::flush(std::vector<GPMF::Sample> &samples) {
+	// Last packet, assume the previous time span
+	if (has_time_) {
+		for (size_t i=0; i<pending_.size(); i++) {
+			pending_[i].time = time_begin_ + (int64_t) i * period_ / (int64_t) pending_.size();
+
+			samples.push_back(pending_[i]);
+		}
+	}
+
+	pending_.clear();
+}
+
+
+bool GPMF::walk(const uint8_t *buffer, size_t size, GPMF::Scale scale) {
+	size_t n;
+	size_t len;
+
+	uint32_t key;
+	uint8_t type, ssize;
+	uint16_t count;
+
+	const uint8_t *payload;
+
+	for (n=0; n+GPMF_HEADER_SIZE<=size; ) {
+		key = gpmf_key(buffer + n);
+		type = buffer[n + 4];
+		ssize = buffer[n + 5];
+		count = gpmf_be16(buffer + n + 6);
+
+		payload = buffer + n + GPMF_HEADER_SIZE;
+		len = (size_t) ssize * count;
+
+		// Truncated payload
+		if (n + GPMF_HEADER_SIZE + len > size)
+			return false;
+
+		// Nested container (DEVC, STRM...), SCAL is scoped to its container
+		if (type == GPMF::TypeNest) {
+			if (!walk(payload, len, Scale()))
+				return false;
+		}
+		else if (key == STR2FOURCC("DVNM")) {
+			if (type == GPMF::TypeStringASCII)
+				device_name_ = std::string((const char *) payload, strnlen((const char *) payload, len));
+		}
+		else if (key == STR2FOURCC("GPSF")) {
+			if ((type == GPMF::TypeUnsignedLong) && count)
+				fix_ = gpmf_be32(payload);
+		}
+		else if (key == STR2FOURCC("GPSU")) {
+			if ((type == GPMF::TypeUTCDateTime) && (len >= 16)) {
+				int64_t t = gpmf_utc2ms(payload);
+
+				if (t >= 0) {
+					time_ = t;
+					packet_time_ = true;
+				}
+			}
+		}
+		else if (key == STR2FOURCC("SCAL")) {
+			size_t nvalues = (ssize == 2) ? (size_t) count : (size_t) count * ssize / 4;
+
+			scale.count = MIN(nvalues, ARRAY_SIZE(scale.inv));
+
+			for (size_t i=0; i<scale.count; i++) {
+				double value = 1.0;
+
+				if (type == GPMF::TypeSignedShort)
+					value = (int16_t) gpmf_be16(payload + i * 2);
+				else if (type == GPMF::TypeUnsignedShort)
+					value = gpmf_be16(payload + i * 2);
+				else if (type == GPMF::TypeSignedLong)
+					value = (int32_t) gpmf_be32(payload + i * 4);
+				else if (type == GPMF::TypeUnsignedLong)
+					value = gpmf_be32(payload + i * 4);
+
+				scale.inv[i] = (value != 0.0) ? 1.0 / value : 1.0;
+			}
+		}
+		else if (key == STR2FOURCC("GPS5")) {
+			if ((type == GPMF::TypeSignedLong) && (ssize >= 20))
+				decodeGPS5(payload, ssize, count, scale);
+		}
+
+		n += GPMF_HEADER_SIZE + P2ROUND(len, 4);
+	}
+
+	return true;
+}
+
+
+void GPMF::decodeGPS5(const uint8_t *payload, uint8_t size, uint16_t count, const GPMF::Scale &scale) {
+	double inv[5];
+
+	size_t stride = size / 4;
+
+	// SCAL may hold one value for all or one value per field
+	for (size_t j=0; j<5; j++) {
+		if (scale.count == 0)
+			inv[j] = 1.0;
+		else if (scale.count == 1)
+			inv[j] = scale.inv[0];
+		else
+			inv[j] = scale.inv[MIN(j, scale.count - 1)];
+	}
+
+	// Whole sample array at once
+	values_.resize(stride * count);
+
+	bswap32(values_.data(), payload, stride * count);
+
+	size_t offset = current_.size();
+
+	current_.resize(offset + count);
+
+	for (size_t i=0; i<count; i++) {
+		const int32_t *v = values_.data() + i * stride;
+
+		Sample &sample = current_[offset + i];
+
+		sample.time = 0;
+		sample.fix = fix_;
+		sample.lat = v[0] * inv[0];
+		sample.lon = v[1] * inv[1];
+		sample.ele = v[2] * inv[2];
+		sample.speed2d = v[3] * inv[3];
+		sample.speed3d = v[4] * inv[4];
+	}
+}
+
+
+bool GPMF::dump(const uint8_t *buffer, size_t size, std::ostream &out) {
+	return dump(buffer, size, out, 0);
+}
+
+
+bool GPMF::dump(const uint8_t *buffer, size_t size, std::ostream &out, int depth) {
+	size_t n;
+	size_t len;
+
+	uint8_t type, ssize;
+	uint16_t count;
+
+	char string[128];
+
+	const uint8_t *payload;
+
+	std::string indent(depth * 2, ' ');
+
+	for (n=0; n+GPMF_HEADER_SIZE<=size; ) {
+		type = buffer[n + 4];
+		ssize = buffer[n + 5];
+		count = gpmf_be16(buffer + n + 6);
+
+		payload = buffer + n + GPMF_HEADER_SIZE;
+		len = (size_t) ssize * count;
+
+		if (n + GPMF_HEADER_SIZE + len > size)
+			return false;
+
+		snprintf(string, sizeof(string), "%c%c%c%c %c 0x%X %u %u",
+				buffer[n], buffer[n + 1], buffer[n + 2], buffer[n + 3],
+				type ? type : ' ', type, ssize, count);
+		out << indent << string << std::endl;
+
+		switch (type) {
+		case GPMF::TypeNest:
+			if (!dump(payload, len, out, depth + 1))
+				return false;
+			break;
+
+		case GPMF::TypeStringASCII:
+			out << indent << "  value: " << std::string((const char *) payload, strnlen((const char *) payload, len)) << std::endl;
+			break;
+
+		case GPMF::TypeSignedShort:
+			for (size_t i=0; i<len/2; i++)
+				out << indent << "  value[" << i << "]: " << (int16_t) gpmf_be16(payload + i * 2) << std::endl;
+			break;
+
+		case GPMF::TypeUnsignedShort:
+			for (size_t i=0; i<len/2; i++)
+				out << indent << "  value[" << i << "]: " << gpmf_be16(payload + i * 2) << std::endl;
+			break;
+
+		case GPMF::TypeSignedLong:
+			for (size_t i=0; i<len/4; i++)
+				out << indent << "  value[" << i << "]: " << (int32_t) gpmf_be32(payload + i * 4) << std::endl;
+			break;
+
+		case GPMF::TypeUnsignedLong:
+			for (size_t i=0; i<len/4; i++)
+				out << indent << "  value[" << i << "]: " << gpmf_be32(payload + i * 4) << std::endl;
+			break;
+
+		case GPMF::TypeFloat:
+			for (size_t i=0; i<len/4; i++) {
+				uint32_t u = gpmf_be32(payload + i * 4);
+				float f;
+
+				memcpy(&f, &u, sizeof(f));
+
+				out << indent << "  value[" << i << "]: " << f << std::endl;
+			}
+			break;
+
+		case GPMF::TypeUnsigned64:
+			for (size_t i=0; i<len/8; i++)
+				out << indent << "  value[" << i << "]: " << gpmf_be64(payload + i * 8) << std::endl;
+			break;
+
+		case GPMF::TypeDouble:
+			for (size_t i=0; i<len/8; i++) {
+				uint64_t u = gpmf_be64(payload + i * 8);
+				double d;
+
+				memcpy(&d, &u, sizeof(d));
+
+				out << indent << "  value[" << i << "]: " << d << std::endl;
+			}
+			break;
+
+		case GPMF::TypeUTCDateTime:
+			if (len >= 16) {
+				const uint8_t *bytes = payload;
+
+				// buffer contains: 201213085548.215
+				snprintf(string, sizeof(string), "20%c%c-%c%c-%c%c %c%c:%c%c:%c%c.%c%c%c",
+						bytes[0], bytes[1], bytes[2], bytes[3], bytes[4], bytes[5],
+						bytes[6], bytes[7], bytes[8], bytes[9], bytes[10], bytes[11],
+						bytes[13], bytes[14], bytes[15]);
+
+				out << indent << "  value: " << string << std::endl;
+			}
+			break;
+
+		default:
+			break;
+		}
+
+		n += GPMF_HEADER_SIZE + P2ROUND(len, 4);
+	}
+
+	return true;
+}
+
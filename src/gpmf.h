@@ -0,0 +1,121 @@
+#ifndef __GPX2VIDEO__GPMF_H__
+#define __GPX2VIDEO__GPMF_H__
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+
+// GoPro Metadata Format decoder
+//
+// Packet data is never modified: KLV headers and payloads are read in
+// place, GPS5 sample arrays are byteswapped and scaled in batch into
+// the decoder own buffers.
+class GPMF {
+public:
+	enum Type {
+		TypeStringASCII = 'c',      // single byte 'c' style character string
+		TypeSignedByte = 'b',       // single byte signed number
+		TypeUnsignedByte = 'B',     // single byte unsigned number
+		TypeSignedShort = 's',      // 16-bit integer
+		TypeUnsignedShort = 'S',    // 16-bit integer
+		TypeFloat = 'f',            // 32-bit single precision float (IEEE 754)
+		TypeFourCC = 'F',           // 32-bit four character tag
+		TypeSignedLong = 'l',       // 32-bit integer
+		TypeUnsignedLong = 'L',     // 32-bit integer
+		TypeQ15_16 = 'q',           // Q number Q15.16 - 16-bit signed integer with 16-bit fixed point
+		TypeQ31_32 = 'Q',           // Q number Q31.32 - 32-bit signed integer with 32-bit fixed point
+		TypeSigned64 = 'j',         // 64 bit signed long
+		TypeUnsigned64 = 'J',       // 64 bit unsigned long
+		TypeDouble = 'd',           // 64 bit double precision float (IEEE 754)
+		TypeStringUTF8 = 'u',       // UTF-8 formatted text string
+		TypeUTCDateTime = 'U',      // 128-bit ASCII Date + UTC Time format yymmddhhmmss.sss
+		TypeGUID = 'G',             // 128-bit ID (like UUID)
+		TypeComplex = '?',          // sample with complex data structures
+		TypeCompressed = '#',       // Huffman compression STRM payloads
+
+		TypeNest = 0,               // nested GPMF formatted metadata
+	};
+
+	struct Sample {
+		int64_t time;   // UTC time (in ms)
+		uint32_t fix;   // 0: no lock, 2: 2D lock, 3: 3D lock
+		double lat;
+		double lon;
+		double ele;
+		double speed2d; // m/s
+		double speed3d; // m/s
+	};
+
+	GPMF();
+	virtual ~GPMF();
+
+	void reset(void);
+
+	// Decode one packet, samples whose time is known are appended
+	bool decode(const uint8_t *buffer, size_t size, std::vector<Sample> &samples);
+
+	// Append remaining samples (end of stream)
+	void flush(std::vector<Sample> &samples);
+
+	const std::string& deviceName(void) const {
+		return device_name_;
+	}
+
+	// Last GPS fix & GPSU time (in ms) read
+	uint32_t fix(void) const {
+		return fix_;
+	}
+
+	int64_t time(void) const {
+		return time_;
+	}
+
+	// Dump KLV tree
+	static bool dump(const uint8_t *buffer, size_t size, std::ostream &out);
+
+	// Big endian to host, n 32-bit words
+	static void bswap32(int32_t *dst, const uint8_t *src, size_t n);
+
+protected:
+	struct Scale {
+		Scale()
+			: count(0) {
+		}
+
+		size_t count;
+		double inv[16];
+	};
+
+	bool walk(const uint8_t *buffer, size_t size, Scale scale);
+
+	void decodeGPS5(const uint8_t *payload, uint8_t size, uint16_t count, const Scale &scale);
+
+	static bool dump(const uint8_t *buffer, size_t size, std::ostream &out, int depth);
+
+private:
+	std::string device_name_;
+
+	uint32_t fix_;
+	int64_t time_;
+
+	// Time span of the pending samples
+	int64_t time_begin_;
+	int64_t period_;
+
+	bool has_time_;
+	bool packet_time_;
+
+	// Samples of the packet being decoded
+	std::vector<Sample> current_;
+
+	// Samples waiting for next GPSU stamp
+	std::vector<Sample> pending_;
+
+	// Byteswap buffer
+	std::vector<int32_t> values_;
+};
+
+#endif
+
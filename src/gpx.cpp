@@ -1,6 +1,8 @@
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <map>
+#include <mutex>
 
 #include <string.h>
 //#define __USE_XOPEN  // For strptime
@@ -48,6 +50,7 @@ GPXData::GPXData()
 	: nbr_points_(0)
 	, line_(0)
 	, valid_(false)
+	, timestamp_(0)
 	, elapsedtime_(0)
 	, duration_(0)
 	, distance_(0)
@@ -168,6 +171,8 @@ bool GPXData::compute(void) {
 void GPXData::init(void) {
 	memcpy(&cur_pt_, &next_pt_, sizeof(cur_pt_));
 	memcpy(&prev_pt_, &cur_pt_, sizeof(prev_pt_));
+
+	timestamp_ = (int64_t) cur_pt_.time * 1000;
 }
 
 
@@ -219,6 +224,8 @@ void GPXData::predict(enum TelemetrySettings::Filter filter) {
 
 	elapsedtime_ += (cur_pt_.time - prev_pt_.time);
 
+	timestamp_ = (int64_t) cur_pt_.time * 1000;
+
 	return;
 }
 
@@ -249,6 +256,8 @@ void GPXData::update(enum TelemetrySettings::Filter filter) {
 
 	elapsedtime_ += (cur_pt_.time - prev_pt_.time);
 
+	timestamp_ = (int64_t) cur_pt_.time * 1000;
+
 	if (filter == TelemetrySettings::FilterNone)
 		prev_pt_.time -= nbr_predictions_;
 
@@ -299,6 +308,13 @@ void GPXData::read(gpx::WPT *wpt) {
 // GPX File Reader
 //-----------------
 
+// Parsed documents, each reader of the same file (renderer, map, track,
+// batch jobs...) shares one telemetry store. Documents must never be
+// modified once parsed: readers only walk them with their own iterators
+static std::mutex documents_mutex;
+static std::map<std::string, gpx::GPX *> documents;
+
+
 GPX::GPX(std::ifstream &stream, gpx::GPX *root, enum TelemetrySettings::Filter filter) 
 	: stream_(stream)
 	, root_(root)
@@ -320,7 +336,17 @@ GPX * GPX::open(const std::string &filename, enum TelemetrySettings::Filter filt
 //	gpx::ReportCerr report;
 	gpx::Parser parser(NULL); //&report);
 
-    std::ifstream stream = std::ifstream(filename);
+    std::ifstream stream;
+
+	std::lock_guard<std::mutex> lock(documents_mutex);
+
+	// Already parsed
+	if (documents.find(filename) != documents.end()) {
+		root = documents[filename];
+		goto done;
+	}
+
+	stream = std::ifstream(filename);
 
 	if (!stream.is_open()) {
 		log_error("Open '%s' GPX file failure, please check that file is readable", filename.c_str());
@@ -336,6 +362,9 @@ GPX * GPX::open(const std::string &filename, enum TelemetrySettings::Filter filt
 		goto failure;
 	}
 
+	documents[filename] = root;
+
+done:
 	gpx = new GPX(stream, root, filter);
 
 	// Parse activity start time
@@ -488,6 +517,10 @@ enum GPX::Data GPX::retrieveNext(GPXData &data, int timecode_ms) {
 		}
 	} while ((timecode_ms != -1) && (data.time(GPXData::PositionCurrent) < timestamp));
 
+	// Frame time (ms precision)
+	if (timecode_ms != -1)
+		data.setTimestamp(((int64_t) start_time_ * 1000) + offset_ + timecode_ms);
+
 	return result;
 
 eof:
@@ -497,31 +530,36 @@ eof:
 }
 
 
+enum GPX::Data GPX::seek(GPXData &data, int timecode_ms) {
+	if (retrieveFirst(data) == GPX::DataEof)
+		return GPX::DataEof;
+
+	// Cumulative values (distance, elapsed time...) need every track point
+	return retrieveNext(data, timecode_ms);
+}
+
+
 enum GPX::Data GPX::retrieveData(GPXData &data) {
 	gpx::WPT *wpt;
-	gpx::TRKSeg *trkseg = (*iter_seg_);
 
-	std::list<gpx::WPT*> &trkpts = trkseg->trkpts().list();
+	// Document is shared by readers, it's only read through iterators
+	std::list<gpx::WPT*> *trkpts = &(*iter_seg_)->trkpts().list();
 	std::list<gpx::TRKSeg*> &trksegs = trk_->trksegs().list();
 
 	// Next point
 	iter_pts_++;
 
-	if (iter_pts_ == trkpts.end()) {
+	// Next segment (empty ones are skipped)
+	while (iter_pts_ == trkpts->end()) {
 		iter_seg_++;
 
 		if (iter_seg_ == trksegs.end())
 			goto done;
 
-		trkseg = (*iter_seg_);
-
-		trkpts = trkseg->trkpts().list();
-		iter_pts_ = trkpts.begin();
+		trkpts = &(*iter_seg_)->trkpts().list();
+		iter_pts_ = trkpts->begin();
 	}
 
-	if (iter_pts_ == trkpts.end())
-		goto done;
-
 	wpt = (*iter_pts_);
 
 	data.read(wpt);
@@ -611,6 +649,34 @@ bool GPX::getBoundingBox(GPXData::point *p1, GPXData::point *p2) {
 }
 
 
+bool GPX::getPoints(std::vector<GPXData::point> &points) {
+	GPXData::point p;
+
+	std::list<gpx::TRKSeg*> &trksegs = trk_->trksegs().list();
+
+	points.clear();
+
+	for (std::list<gpx::TRKSeg*>::iterator iter2 = trksegs.begin(); iter2 != trksegs.end(); ++iter2) {
+		gpx::TRKSeg *seg = (*iter2);
+
+		std::list<gpx::WPT*> &trkpts = seg->trkpts().list();
+
+		for (std::list<gpx::WPT*>::iterator iter3 = trkpts.begin(); iter3 != trkpts.end(); ++iter3) {
+			gpx::WPT *wpt = (*iter3);
+
+			GPXData::convert(&p, wpt);
+
+			if (!p.valid)
+				continue;
+
+			points.push_back(p);
+		}
+	}
+
+	return !points.empty();
+}
+
+
 double GPX::getMaxSpeed(void) {
 	GPXData data;
 
@@ -5,6 +5,7 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <cstdint>
 
 #include "kalman.h"
 #include "gpxlib/Parser.h"
@@ -67,6 +68,15 @@ public:
 		return valid_;
 	}
 
+	// Current time in ms (frame time when retrieved with a timecode)
+	const int64_t& timestamp(void) const {
+		return timestamp_;
+	}
+
+	void setTimestamp(const int64_t &timestamp) {
+		timestamp_ = timestamp;
+	}
+
 	const int& elapsedTime(void) const {
 		return elapsedtime_;
 	}
@@ -133,6 +143,7 @@ protected:
 
 	int line_;
 	bool valid_;
+	int64_t timestamp_;
 	int elapsedtime_;
 	double duration_;
 	double distance_;
@@ -170,6 +181,7 @@ public:
 
 //	const GPXData retrieveData(const int64_t &timecode);
 	bool getBoundingBox(GPXData::point *p1, GPXData::point *p2);
+	bool getPoints(std::vector<GPXData::point> &points);
 	double getMaxSpeed(void);
 
 	enum Data retrieveFirst(GPXData &data);
@@ -177,6 +189,9 @@ public:
 	enum Data retrieveData(GPXData &data);
 	enum Data retrieveLast(GPXData &data);
 
+	// First data at timecode (track points are replayed, not frames)
+	enum Data seek(GPXData &data, int timecode_ms);
+
 protected:
 	bool parse(void);
 
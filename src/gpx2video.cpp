@@ -21,9 +21,11 @@ extern "C" {
 #include "log.h"
 #include "version.h"
 #include "utils.h"
+#include "macros.h"
 #include "evcurl.h"
 #include "map.h"
 #include "track.h"
+#include "trackgeometry.h"
 #include "extractor.h"
 #include "decoder.h"
 #include "encoder.h"
@@ -33,7 +35,8 @@ extern "C" {
 
 GPX2Video::GPX2Video(struct event_base *evbase) 
 	: evbase_(evbase)
-	, container_(NULL) {
+	, container_(NULL)
+	, geometry_(NULL) {
 	log_call();
 
 	setLogLevel(AV_LOG_INFO);
@@ -57,6 +60,16 @@ GPX2Video::GPX2Video(struct event_base *evbase)
 GPX2Video::~GPX2Video() {
 	log_call();
 
+	if (geometry_)
+		delete geometry_;
+
+	if (container_)
+		delete container_;
+
+	// Task queue event
+	event_del(ev_queue_);
+	event_free(ev_queue_);
+
 	// Signal event
 	event_del(ev_signal_);
 	event_free(ev_signal_);
@@ -109,17 +122,51 @@ void GPX2Video::setSettings(const GPX2Video::Settings &settings) {
 }
 
 
+GPX2Video::Command& GPX2Video::command(void) {
+	return command_;
+}
+
+
+void GPX2Video::setCommand(const GPX2Video::Command &command) {
+	command_ = command;
+}
+
+
 MediaContainer * GPX2Video::media(void) {
 	std::string mediafile = settings().mediafile();
 	
 	// Probe input media
-	if (container_ == NULL)
-		container_ = Decoder::probe(mediafile);
+	if (container_ == NULL) {
+		// GoPro chapters: media is the first file of the sequence
+		if (settings().chapters())
+			container_ = Decoder::probe(Demuxer::chapters(mediafile), settings().mmap());
+		else
+			container_ = Decoder::probe(mediafile, settings().mmap());
+	}
 
 	return container_;
 }
 
 
+TrackGeometry * GPX2Video::geometry(void) {
+	GPX *gpx;
+
+	// Project GPX track once, map & track widgets share it
+	if (geometry_ == NULL) {
+		gpx = GPX::open(settings().gpxfile());
+
+		if (gpx == NULL)
+			return NULL;
+
+		geometry_ = TrackGeometry::create(gpx);
+
+		delete gpx;
+	}
+
+	return geometry_;
+}
+
+
 Map * GPX2Video::buildMap(void) {
 	// GPX input file
 	GPXData data;
@@ -240,10 +287,36 @@ sighandler_error:
 }
 
 
-void GPX2Video::pipehandler(int sfd, short kind, void *data) {
-	int32_t info;
+void GPX2Video::perform(enum Task::Action action) {
+	bool wakeup;
+
+	// Zero timeout: the queue is processed once pending I/O events (map
+	// downloads, signals) have been dispatched
+	static const struct timeval now = { 0, 0 };
+
+	log_call();
+
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex_);
 
-	size_t bytes;
+		wakeup = queue_.empty();
+
+		queue_.push_back(action);
+	}
+
+	// Tasks may complete from worker threads (batch)
+	if (wakeup)
+		evtimer_add(ev_queue_, &now);
+}
+
+
+void GPX2Video::queuehandler(int sfd, short kind, void *data) {
+	int n;
+	bool pending;
+
+	enum GPX2Video::Task::Action action;
+
+	static const struct timeval now = { 0, 0 };
 
 	GPX2Video *app = (GPX2Video *) data;
 
@@ -252,18 +325,39 @@ void GPX2Video::pipehandler(int sfd, short kind, void *data) {
 	(void) sfd;
 	(void) kind;
 
-	bytes = read(app->pipe_in_, &info, sizeof(info));
+	// Run a bounded batch of task steps, then go back to the event loop
+	n = MAX(1, app->settings().taskSteps());
+
+	for (int i=0; i<n; i++) {
+		{
+			std::lock_guard<std::mutex> lock(app->queue_mutex_);
+
+			if (app->queue_.empty())
+				break;
+
+			action = app->queue_.front();
+			app->queue_.pop_front();
+		}
+
+		app->run(action);
+
+		// Aborted
+		if (event_base_got_exit(app->evbase_))
+			return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(app->queue_mutex_);
 
-	(void) bytes;
+		pending = !app->queue_.empty();
+	}
 
-	app->run((enum GPX2Video::Task::Action) info);
+	if (pending)
+		evtimer_add(app->ev_queue_, &now);
 }
 
 
 void GPX2Video::init(void) {
-	int error;
-
-	int fds[2];
 	int sfd = -1;
 
 	sigset_t mask;
@@ -294,18 +388,8 @@ void GPX2Video::init(void) {
 	ev_signal_ = event_new(evbase_, sfd, EV_READ | EV_PERSIST, sighandler, this);
 	event_add(ev_signal_, NULL);
 
-	// Create pipe to schedule tasks
-	error = pipe(fds);
-
-	if (error == -1) {
-		log_error("Unable to create pipe");
-		return;
-	}
-
-	pipe_in_ = fds[0];
-	pipe_out_ = fds[1];
-	ev_pipe_ = event_new(evbase_, pipe_in_, EV_READ | EV_PERSIST, pipehandler, this);
-	event_add(ev_pipe_, NULL);
+	// In-process task queue
+	ev_queue_ = evtimer_new(evbase_, queuehandler, this);
 }
 
 
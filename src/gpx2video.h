@@ -5,6 +5,9 @@
 #include <cstdlib>
 #include <string>
 #include <list>
+#include <vector>
+#include <deque>
+#include <mutex>
 
 #include <unistd.h>
 
@@ -17,6 +20,7 @@
 
 class Map;
 class Extractor;
+class TrackGeometry;
 
 class GPX2Video {
 public:
@@ -29,10 +33,31 @@ public:
 			int offset=0,
 			double map_factor=1.0,
 			int map_zoom=8, 
+			int map_zoom_max=0,
+			int map_margin=1,
+			int cache_size=0,
 			int max_duration_ms=0,
 			MapSettings::Source map_source=MapSettings::SourceOpenStreetMap,
 			ExtractorSettings::Format extract_format=ExtractorSettings::FormatDump,
-			TelemetrySettings::Filter telemetry_filter=TelemetrySettings::FilterNone)
+			TelemetrySettings::Filter telemetry_filter=TelemetrySettings::FilterNone,
+			std::string batch_file="",
+			int jobs=1,
+			bool chapters=false,
+			int task_steps=32,
+			int write_buffer=64,
+			bool mmap=true,
+			int start_ms=0,
+			int preview_width=0,
+			int preview_rate=10,
+			std::string overlay_codec="",
+			bool profile=false,
+			std::string trace_file="",
+			int progress_fd=-1,
+			int progress_interval_ms=1000,
+			bool overlay_cache=false,
+			std::vector<int> snapshots=std::vector<int>(),
+			int output_width=0,
+			int output_height=0)
 			: gpx_file_(gpx_file)
 			, media_file_(media_file)
 			, layout_file_(layout_file)
@@ -40,10 +65,31 @@ public:
 			, offset_(offset)
 			, map_factor_(map_factor)
 			, map_zoom_(map_zoom)
+			, map_zoom_max_(map_zoom_max)
+			, map_margin_(map_margin)
+			, cache_size_(cache_size)
 			, max_duration_ms_(max_duration_ms)
 			, map_source_(map_source)
 	   		, extract_format_(extract_format) 
-			, telemetry_filter_(telemetry_filter) {
+			, telemetry_filter_(telemetry_filter)
+			, batch_file_(batch_file)
+			, jobs_(jobs)
+			, chapters_(chapters)
+			, task_steps_(task_steps)
+			, write_buffer_(write_buffer)
+			, mmap_(mmap)
+			, start_ms_(start_ms)
+			, preview_width_(preview_width)
+			, preview_rate_(preview_rate)
+			, overlay_codec_(overlay_codec)
+			, profile_(profile)
+			, trace_file_(trace_file)
+			, progress_fd_(progress_fd)
+			, progress_interval_ms_(progress_interval_ms)
+			, overlay_cache_(overlay_cache)
+			, snapshots_(snapshots)
+			, output_width_(output_width)
+			, output_height_(output_height) {
 		}
 
 		const std::string& gpxfile(void) const {
@@ -54,6 +100,10 @@ public:
 			return media_file_;
 		}
 
+		void setMediafile(const std::string &value) {
+			media_file_ = value;
+		}
+
 		const std::string& layoutfile(void) const {
 			return layout_file_;
 		}
@@ -62,10 +112,18 @@ public:
 			return output_file_;
 		}
 
+		void setOutputfile(const std::string &value) {
+			output_file_ = value;
+		}
+
 		const int& offset(void) const {
 			return offset_;
 		}
 
+		void setOffset(const int &value) {
+			offset_ = value;
+		}
+
 		const MapSettings::Source& mapsource(void) const {
 			return map_source_;
 		}
@@ -86,10 +144,102 @@ public:
 			return map_zoom_;
 		}
 
+		const int& mapzoommax(void) const {
+			return map_zoom_max_;
+		}
+
+		const int& mapmargin(void) const {
+			return map_margin_;
+		}
+
+		const int& cachesize(void) const {
+			return cache_size_;
+		}
+
 		const unsigned int& maxDuration(void) const {
 			return max_duration_ms_;
 		}
 
+		const std::string& batchfile(void) const {
+			return batch_file_;
+		}
+
+		const int& jobs(void) const {
+			return jobs_;
+		}
+
+		const bool& chapters(void) const {
+			return chapters_;
+		}
+
+		const int& taskSteps(void) const {
+			return task_steps_;
+		}
+
+		const int& writeBuffer(void) const {
+			return write_buffer_;
+		}
+
+		const bool& mmap(void) const {
+			return mmap_;
+		}
+
+		const int& start(void) const {
+			return start_ms_;
+		}
+
+		void setStart(const int &value) {
+			start_ms_ = value;
+		}
+
+		const int& previewWidth(void) const {
+			return preview_width_;
+		}
+
+		const int& previewRate(void) const {
+			return preview_rate_;
+		}
+
+		const std::string& overlayCodec(void) const {
+			return overlay_codec_;
+		}
+
+		const bool& profile(void) const {
+			return profile_;
+		}
+
+		const std::string& traceFile(void) const {
+			return trace_file_;
+		}
+
+		void setTraceFile(const std::string &value) {
+			trace_file_ = value;
+		}
+
+		const int& progressFd(void) const {
+			return progress_fd_;
+		}
+
+		const int& progressInterval(void) const {
+			return progress_interval_ms_;
+		}
+
+		const bool& overlayCache(void) const {
+			return overlay_cache_;
+		}
+
+		const std::vector<int>& snapshots(void) const {
+			return snapshots_;
+		}
+
+		const int& outputWidth(void) const {
+			return output_width_;
+		}
+
+		const int& outputHeight(void) const {
+			return output_height_;
+		}
+
 	private:
 		std::string gpx_file_;
 		std::string media_file_;
@@ -100,11 +250,46 @@ public:
 
 		double map_factor_;
 		int map_zoom_;
+		int map_zoom_max_;
+		int map_margin_;
+		int cache_size_;
 		unsigned int max_duration_ms_;
 		MapSettings::Source map_source_;
 
 		ExtractorSettings::Format extract_format_;
 		TelemetrySettings::Filter telemetry_filter_;
+
+		std::string batch_file_;
+		int jobs_;
+
+		bool chapters_;
+
+		int task_steps_;
+		int write_buffer_;
+
+		bool mmap_;
+
+		int start_ms_;
+
+		int preview_width_;
+		int preview_rate_;
+
+		std::string overlay_codec_;
+
+		bool profile_;
+		std::string trace_file_;
+
+		int progress_fd_;
+		int progress_interval_ms_;
+
+		bool overlay_cache_;
+
+		// Snapshot times (in ms)
+		std::vector<int> snapshots_;
+
+		// Output video size (0: media size)
+		int output_width_;
+		int output_height_;
 	};
 
 	class Task {
@@ -157,8 +342,12 @@ public:
 		CommandClear,	// Clear cache directories
 		CommandMap,		// Download & build map
 		CommandTrack,	// Download, build map & draw track
+		CommandPrefetch,// Download map tiles in cache
 		CommandCompute, // Compute telemetry data from gpx
 		CommandVideo,	// Render video with telemtry overlay
+		CommandOverlay,	// Render telemetry overlay only (alpha channel)
+		CommandBatch,	// Render several videos with the same gpx & layout
+		CommandSnapshot,// Render a frame at given times to images
 
 		CommandCount
 	};
@@ -191,6 +380,7 @@ public:
 	}
 
 	MediaContainer * media(void);
+	TrackGeometry * geometry(void);
 	Map * buildMap(void);
 	Extractor * buildExtractor(void);
 
@@ -202,15 +392,7 @@ public:
 		time_ = time;
 	}
 
-	void perform(enum Task::Action action=Task::ActionPerform) {
-		int32_t info;
-
-		log_call();
-
-		info = (int32_t) action;
-
-		write(pipe_out_, &info, sizeof(info));
-	}
+	void perform(enum Task::Action action=Task::ActionPerform);
 
 	void run(enum Task::Action action) {
 		Task *task;
@@ -273,7 +455,7 @@ public:
 
 protected:
 	static void sighandler(int sfd, short kind, void *data);
-	static void pipehandler(int sfd, short kind, void *data);
+	static void queuehandler(int sfd, short kind, void *data);
 
 	void init(void);
 
@@ -281,10 +463,10 @@ protected:
 	void loopexit(void);
 
 private:
-	int pipe_in_;
-	int pipe_out_;
+	std::mutex queue_mutex_;
+	std::deque<enum Task::Action> queue_;
 
-	struct event *ev_pipe_;
+	struct event *ev_queue_;
 	struct event *ev_signal_;
 	struct event_base *evbase_;
 
@@ -294,6 +476,7 @@ private:
 	Settings settings_;
 
 	MediaContainer *container_;
+	TrackGeometry *geometry_;
 
 	std::list<Task *> tasks_;
 
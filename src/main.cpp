@@ -1,19 +1,27 @@
 #include <iostream>
 #include <cstdlib>
+#include <cstdio>
 #include <string>
+#include <vector>
+#include <cmath>
 
 #include <string.h>
 #include <getopt.h>
+#include <unistd.h>
 
 extern "C" {
 #include <event2/event.h>
+#include <event2/thread.h>
 #include <libavcodec/avcodec.h>
 }
 
 #include "log.h"
 #include "map.h"
+#include "batch.h"
 #include "cache.h"
+#include "prefetch.h"
 #include "renderer.h"
+#include "snapshot.h"
 #include "timesync.h"
 #include "extractor.h"
 #include "telemetry.h"
@@ -37,7 +45,28 @@ static const struct option options[] = {
 	{ "map-source",       required_argument, 0, 0 },
 	{ "map-factor",       required_argument, 0, 0 },
 	{ "map-zoom",         required_argument, 0, 0 },
+	{ "map-zoom-max",     required_argument, 0, 0 },
+	{ "map-margin",       required_argument, 0, 0 },
 	{ "map-list",         no_argument,       0, 0 },
+	{ "cache-size",       required_argument, 0, 0 },
+	{ "batch",            required_argument, 0, 0 },
+	{ "jobs",             required_argument, 0, 0 },
+	{ "chapters",         no_argument,       0, 0 },
+	{ "task-steps",       required_argument, 0, 0 },
+	{ "write-buffer",     required_argument, 0, 0 },
+	{ "no-mmap",          no_argument,       0, 0 },
+	{ "start",            required_argument, 0, 0 },
+	{ "preview",          optional_argument, 0, 0 },
+	{ "preview-rate",     required_argument, 0, 0 },
+	{ "overlay-codec",    required_argument, 0, 0 },
+	{ "profile",          no_argument,       0, 0 },
+	{ "trace",            required_argument, 0, 0 },
+	{ "progress-fd",      required_argument, 0, 0 },
+	{ "progress-json",    no_argument,       0, 0 },
+	{ "progress-interval", required_argument, 0, 0 },
+	{ "overlay-cache",    no_argument,       0, 0 },
+	{ "at",               required_argument, 0, 0 },
+	{ "output-size",      required_argument, 0, 0 },
 	{ "extract-format",   no_argument,       0, 0 },
 	{ "telemetry-filter", no_argument,       0, 0 },
 	{ 0,                  0,                 0, 0 }
@@ -58,10 +87,31 @@ static void print_usage(const std::string &name) {
 	std::cout << "\t- f, --format=name      : Extract format (dump, gpx)" << std::endl;
 	std::cout << "\t- t, --telemetry=filter : Filter GPX values (none, kalman)" << std::endl;
 	std::cout << "\t-    --offset           : Add a time offset (in ms)" << std::endl;
+	std::cout << "\t-    --start            : Start rendering at media time (in ms), duration is then from start" << std::endl;
+	std::cout << "\t-    --output-size=WxH  : Output video size, W only keeps media aspect ratio (default: media size)" << std::endl;
+	std::cout << "\t-    --preview[=width]  : Fast low resolution render to check layout, no audio (default width: 640)" << std::endl;
+	std::cout << "\t-    --preview-rate     : Preview frame rate (default: 10)" << std::endl;
+	std::cout << "\t-    --overlay-codec    : Overlay codec: prores, qtrle, ffv1, png (default: from output extension)" << std::endl;
+	std::cout << "\t-    --profile          : Dump per stage timings (p50/p95/max by frame) at the end of render" << std::endl;
+	std::cout << "\t-    --trace=file       : Write a Chrome trace_event JSON file of render stages (implies --profile)" << std::endl;
+	std::cout << "\t-    --overlay-cache    : Render overlay frames once, reuse them on next renders (same layout, GPX, offset & rate)" << std::endl;
+	std::cout << "\t-    --progress-fd=fd   : Write progress as JSON lines to file descriptor" << std::endl;
+	std::cout << "\t-    --progress-json    : Write progress as JSON lines to stdout, any other output goes to stderr" << std::endl;
+	std::cout << "\t-    --progress-interval: JSON progress interval (in ms, default: 1000)" << std::endl;
 	std::cout << "\t-    --map-factor       : Map factor (default: 1.0)" << std::endl;
 	std::cout << "\t-    --map-source       : Map source" << std::endl;
 	std::cout << "\t-    --map-zoom         : Map zoom" << std::endl;
+	std::cout << "\t-    --map-zoom-max     : Map max zoom (prefetch)" << std::endl;
+	std::cout << "\t-    --map-margin       : Map margin in tiles (prefetch, default: 1)" << std::endl;
 	std::cout << "\t-    --map-list         : Dump supported map list" << std::endl;
+	std::cout << "\t-    --cache-size       : Cache size limit in MB, LRU eviction (default: 0, no limit)" << std::endl;
+	std::cout << "\t-    --at=time          : Snapshot time HH:MM:SS.mmm, MM:SS.mmm or SS.mmm (repeat for several snapshots)" << std::endl;
+	std::cout << "\t-    --batch=file       : Batch file, one 'media output [offset]' job per line" << std::endl;
+	std::cout << "\t-    --jobs             : Number of batch jobs rendered at the same time (default: 1)" << std::endl;
+	std::cout << "\t-    --chapters         : Join GoPro chapter files following media (GH01xxxx.MP4, GH02xxxx.MP4...)" << std::endl;
+	std::cout << "\t-    --task-steps       : Task steps run between two event loop iterations (default: 32)" << std::endl;
+	std::cout << "\t-    --write-buffer     : Output write buffer in MB, 0 for synchronous writes (default: 64)" << std::endl;
+	std::cout << "\t-    --no-mmap          : Read media with FFmpeg file I/O instead of a memory mapping" << std::endl;
 	std::cout << "\t- v, --verbose          : Show trace" << std::endl;
 	std::cout << "\t- q, --quiet            : Quiet mode" << std::endl;
 	std::cout << "\t- h, --help             : Show this help screen" << std::endl;
@@ -76,8 +126,12 @@ static void print_usage(const std::string &name) {
 	std::cout << "\t clear  : Clear cache" << std::endl;
 	std::cout << "\t map    : Build map from gpx data" << std::endl;
 	std::cout << "\t track  : Build map with track from gpx data" << std::endl;
+	std::cout << "\t prefetch: Download map tiles in cache from gpx data (file or directory)" << std::endl;
 	std::cout << "\t compute: Compute telemetry data from gpx data" << std::endl;
 	std::cout << "\t video  : Process video" << std::endl;
+	std::cout << "\t overlay: Render telemetry overlay only, with alpha channel (no video decode)" << std::endl;
+	std::cout << "\t batch  : Process each video of the batch file" << std::endl;
+	std::cout << "\t snapshot: Render frame at each '--at' time to an image (PNG, JPEG... from output extension)" << std::endl;
 
 	return;
 }
@@ -130,19 +184,40 @@ static void print_filter_supported(const std::string &name) {
 	}
 }
 
-}; // namespace gpx2video
 
+// Parse [[HH:]MM:]SS[.mmm] time, returns ms or -1
+static int parse_time(const char *s) {
+	char *end;
 
+	double value;
+	int64_t seconds = 0;
 
-GPX2Video::Command& GPX2Video::command(void) {
-	return command_;
-}
+	for (;;) {
+		value = strtod(s, &end);
+
+		if ((end == s) || (value < 0))
+			return -1;
+
+		if (*end != ':')
+			break;
 
+		// Only seconds field can be fractional
+		if (value != floor(value))
+			return -1;
+
+		seconds = (seconds + (int64_t) value) * 60;
+		s = end + 1;
+	}
 
-void GPX2Video::setCommand(const GPX2Video::Command &command) {
-	command_ = command;
+	if (*end != '\0')
+		return -1;
+
+	return (int) (seconds * 1000 + llround(value * 1000));
 }
 
+}; // namespace gpx2video
+
+
 
 int GPX2Video::parseCommandLine(int argc, char *argv[]) {
 	int index;
@@ -151,10 +226,28 @@ int GPX2Video::parseCommandLine(int argc, char *argv[]) {
 	int offset = 0;
 	int verbose = 0;
 	int map_zoom = 12;
+	int map_zoom_max = 0;
+	int map_margin = 1;
+	int cache_size = 0;
+	int jobs = 1;
+	int task_steps = 32;
+	int write_buffer = 64;
 	int max_duration_ms = 0; // By default process whole media
+	int start_ms = 0;
+	int preview_width = 0;
+	int preview_rate = 10;
+	int progress_fd = -1;
+	int progress_interval_ms = 1000;
+	int output_width = 0;
+	int output_height = 0;
 
 	double map_factor = 1.0;
 
+	bool chapters = false;
+	bool mmap = true;
+	bool profile = false;
+	bool overlay_cache = false;
+
 	const char *s;
 
 	MapSettings::Source map_source = MapSettings::SourceNull;
@@ -163,6 +256,11 @@ int GPX2Video::parseCommandLine(int argc, char *argv[]) {
 	std::string mediafile;
 	std::string layoutfile;
 	std::string outputfile;
+	std::string batchfile;
+	std::string overlay_codec;
+	std::string trace_file;
+
+	std::vector<int> snapshots;
 
 	ExtractorSettings::Format extract_format = ExtractorSettings::FormatDump;
 
@@ -172,6 +270,8 @@ int GPX2Video::parseCommandLine(int argc, char *argv[]) {
 	bool mediafile_required = false;
 	bool layoutfile_required = false;
 	bool outputfile_required = false;
+	bool batchfile_required = false;
+	bool snapshots_required = false;
 
 	const std::string name(argv[0]);
 
@@ -200,6 +300,87 @@ int GPX2Video::parseCommandLine(int argc, char *argv[]) {
 			else if (s && !strcmp(s, "map-zoom")) {
 				map_zoom = atoi(optarg);
 			}
+			else if (s && !strcmp(s, "map-zoom-max")) {
+				map_zoom_max = atoi(optarg);
+			}
+			else if (s && !strcmp(s, "map-margin")) {
+				map_margin = atoi(optarg);
+			}
+			else if (s && !strcmp(s, "cache-size")) {
+				cache_size = atoi(optarg);
+			}
+			else if (s && !strcmp(s, "batch")) {
+				batchfile = std::string(optarg);
+			}
+			else if (s && !strcmp(s, "jobs")) {
+				jobs = atoi(optarg);
+			}
+			else if (s && !strcmp(s, "chapters")) {
+				chapters = true;
+			}
+			else if (s && !strcmp(s, "task-steps")) {
+				task_steps = atoi(optarg);
+			}
+			else if (s && !strcmp(s, "write-buffer")) {
+				write_buffer = atoi(optarg);
+
+				if (write_buffer < 0) {
+					std::cout << name << ": invalid '--write-buffer' value '" << optarg << "'" << std::endl;
+					return -1;
+				}
+			}
+			else if (s && !strcmp(s, "no-mmap")) {
+				mmap = false;
+			}
+			else if (s && !strcmp(s, "start")) {
+				start_ms = atoi(optarg);
+			}
+			else if (s && !strcmp(s, "preview")) {
+				preview_width = optarg ? atoi(optarg) : 640;
+			}
+			else if (s && !strcmp(s, "preview-rate")) {
+				preview_rate = MAX(1, atoi(optarg));
+			}
+			else if (s && !strcmp(s, "overlay-codec")) {
+				overlay_codec = std::string(optarg);
+			}
+			else if (s && !strcmp(s, "profile")) {
+				profile = true;
+			}
+			else if (s && !strcmp(s, "trace")) {
+				trace_file = std::string(optarg);
+				profile = true;
+			}
+			else if (s && !strcmp(s, "progress-fd")) {
+				progress_fd = atoi(optarg);
+			}
+			else if (s && !strcmp(s, "progress-json")) {
+				progress_fd = STDOUT_FILENO;
+			}
+			else if (s && !strcmp(s, "progress-interval")) {
+				progress_interval_ms = MAX(1, atoi(optarg));
+			}
+			else if (s && !strcmp(s, "overlay-cache")) {
+				overlay_cache = true;
+			}
+			else if (s && !strcmp(s, "at")) {
+				int time_ms = gpx2video::parse_time(optarg);
+
+				if (time_ms < 0) {
+					std::cout << name << ": invalid '--at' time '" << optarg << "'" << std::endl;
+					return -1;
+				}
+
+				snapshots.push_back(time_ms);
+			}
+			else if (s && !strcmp(s, "output-size")) {
+				output_height = 0;
+
+				if ((sscanf(optarg, "%dx%d", &output_width, &output_height) < 1) || (output_width <= 0) || (output_height < 0)) {
+					std::cout << name << ": invalid '--output-size' value '" << optarg << "'" << std::endl;
+					return -1;
+				}
+			}
 			else if (s && !strcmp(s, "map-source")) {
 				map_source = (MapSettings::Source) atoi(optarg);
 			}
@@ -306,6 +487,11 @@ int GPX2Video::parseCommandLine(int argc, char *argv[]) {
 			gpxfile_required = true;
 			outputfile_required = true;
 		}
+		else if (!strcmp(argv[0], "prefetch")) {
+			setCommand(GPX2Video::CommandPrefetch);
+
+			gpxfile_required = true;
+		}
 		else if (!strcmp(argv[0], "compute")) {
 			setCommand(GPX2Video::CommandCompute);
 			
@@ -318,6 +504,28 @@ int GPX2Video::parseCommandLine(int argc, char *argv[]) {
 			mediafile_required = true;
 			outputfile_required = true;
 		}
+		else if (!strcmp(argv[0], "overlay")) {
+			setCommand(GPX2Video::CommandOverlay);
+			
+			gpxfile_required = true;
+			mediafile_required = true;
+			outputfile_required = true;
+		}
+		else if (!strcmp(argv[0], "batch")) {
+			setCommand(GPX2Video::CommandBatch);
+
+			gpxfile_required = true;
+			batchfile_required = true;
+		}
+		else if (!strcmp(argv[0], "snapshot")) {
+			setCommand(GPX2Video::CommandSnapshot);
+
+			gpxfile_required = true;
+			mediafile_required = true;
+			layoutfile_required = true;
+			outputfile_required = true;
+			snapshots_required = true;
+		}
 		else {
 			std::cout << name << ": command '" << argv[0] << "' unknown" << std::endl;
 			return -1;
@@ -352,8 +560,31 @@ int GPX2Video::parseCommandLine(int argc, char *argv[]) {
 		return -1;
 	}
 
+	if (batchfile_required && batchfile.empty()) {
+		std::cout << name << ": option '--batch' is required" << std::endl;
+		return -1;
+	}
+
+	if (snapshots_required && snapshots.empty()) {
+		std::cout << name << ": option '--at' is required" << std::endl;
+		return -1;
+	}
+
 	setProgressInfo((verbose > 0));
 
+	// JSON progress on stdout: stdout is only used by JSON lines, any other
+	// output (logs, progress display, summaries...) goes to stderr
+	if (progress_fd == STDOUT_FILENO) {
+		fflush(stdout);
+
+		if ((progress_fd = dup(STDOUT_FILENO)) < 0) {
+			std::cout << name << ": can't write progress to stdout" << std::endl;
+			return -1;
+		}
+
+		dup2(STDERR_FILENO, STDOUT_FILENO);
+	}
+
 	// Save app settings
 	setSettings(GPX2Video::Settings(
 		gpxfile,
@@ -363,10 +594,31 @@ int GPX2Video::parseCommandLine(int argc, char *argv[]) {
 		offset,
 		map_factor,
 		map_zoom,
+		map_zoom_max,
+		map_margin,
+		cache_size,
 		max_duration_ms,
 		map_source,
 		extract_format,
-		telemetry_filter)
+		telemetry_filter,
+		batchfile,
+		jobs,
+		chapters,
+		task_steps,
+		write_buffer,
+		mmap,
+		start_ms,
+		preview_width,
+		preview_rate,
+		overlay_codec,
+		profile,
+		trace_file,
+		progress_fd,
+		progress_interval_ms,
+		overlay_cache,
+		snapshots,
+		output_width,
+		output_height)
 	);
 
 	return 0;
@@ -377,7 +629,10 @@ int main(int argc, char *argv[], char *envp[]) {
 	int result;
 
 	Map *map = NULL;
+	Batch *batch = NULL;
+	Snapshot *snapshot = NULL;
 	Cache *cache = NULL;
+	Prefetch *prefetch = NULL;
 	Renderer *renderer = NULL;
 	TimeSync *timesync = NULL;
 	Extractor *extractor = NULL;
@@ -389,11 +644,10 @@ int main(int argc, char *argv[], char *envp[]) {
 
 	(void) envp;
 
-	// Event loop
-	evbase = event_base_new();
+	// Event loop (tasks can be scheduled from worker threads)
+	evthread_use_pthreads();
 
-	// Baner info
-	log_notice("gpx2video v%s", GPX2Video::version().c_str());
+	evbase = event_base_new();
 
 	// Init
 	GPX2Video app(evbase);
@@ -408,6 +662,9 @@ int main(int argc, char *argv[], char *envp[]) {
 		goto exit;
 	}
 
+	// Baner info (after parse, stdout can be reserved to JSON progress)
+	log_notice("gpx2video v%s", GPX2Video::version().c_str());
+
 	// ::TMP:: Check assets directory 
 	{
     	std::ifstream stream = std::ifstream("./assets/marker/position.png");
@@ -506,6 +763,22 @@ int main(int argc, char *argv[], char *envp[]) {
 		}
 		break;
 
+	case GPX2Video::CommandPrefetch:
+		// Create cache directories
+		cache = Cache::create(app);
+		app.append(cache);
+
+		// Create gpx2video prefetch task
+		if (app.settings().mapsource() != MapSettings::SourceNull) {
+			prefetch = Prefetch::create(app, cache);
+			app.append(prefetch);
+		}
+		else {
+			log_error("Please choose map source.");
+			goto exit;
+		}
+		break;
+
 	case GPX2Video::CommandCompute:
 		telemetry = Telemetry::create(app);
 		app.append(telemetry);
@@ -516,15 +789,41 @@ int main(int argc, char *argv[], char *envp[]) {
 		cache = Cache::create(app);
 		app.append(cache);
 
-		// Create gpx2video timesync task
-		timesync = TimeSync::create(app);
-		app.append(timesync);
+		// Create gpx2video renderer task (time synchronization is done at start)
+		renderer = Renderer::create(app);
+		app.append(renderer);
+		break;
 
-		// Create gpx2video renderer task
+	case GPX2Video::CommandOverlay:
+		// Create cache directories
+		cache = Cache::create(app);
+		app.append(cache);
+
+		// Create gpx2video renderer task (overlay only, media isn't decoded)
 		renderer = Renderer::create(app);
 		app.append(renderer);
 		break;
 
+	case GPX2Video::CommandBatch:
+		// Create cache directories
+		cache = Cache::create(app);
+		app.append(cache);
+
+		// Create gpx2video batch task (map downloads are queued before)
+		batch = Batch::create(app);
+		app.append(batch);
+		break;
+
+	case GPX2Video::CommandSnapshot:
+		// Create cache directories
+		cache = Cache::create(app);
+		app.append(cache);
+
+		// Create gpx2video snapshot task (map downloads are queued before)
+		snapshot = Snapshot::create(app);
+		app.append(snapshot);
+		break;
+
 	default:
 		log_notice("Command not supported");
 		goto exit;
@@ -537,8 +836,14 @@ int main(int argc, char *argv[], char *envp[]) {
 exit:
 	if (map)
 		delete map;
+	if (batch)
+		delete batch;
+	if (snapshot)
+		delete snapshot;
 	if (cache)
 		delete cache;
+	if (prefetch)
+		delete prefetch;
 	if (renderer)
 		delete renderer;
 	if (timesync)
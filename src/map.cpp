@@ -4,6 +4,8 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <map>
+#include <mutex>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -20,12 +22,13 @@
 #include "log.h"
 #include "evcurl.h"
 #include "gpx.h"
+#include "projection.h"
+#include "trackgeometry.h"
 #include "oiioutils.h"
 #include "videoparams.h"
 #include "map.h"
 
 
-#define TILESIZE 256
 #define MAX_ZOOM 20
 #define MIN_ZOOM 0
 
@@ -44,6 +47,13 @@
 #define URI_MARKER_R    "#R"
 
 
+// Maps built (filename) & loaded (raster with path) in this process,
+// each renderer wraps the same raster (batch jobs share one map)
+static std::mutex maps_mutex;
+static std::map<std::string, std::string> maps_built;
+static std::map<std::string, OIIO::ImageBuf *> maps_loaded;
+
+
 
 MapSettings::MapSettings() {
 	width_ = 320;
@@ -262,6 +272,41 @@ int MapSettings::getMinZoom(const MapSettings::Source &source) {
 }
 
 
+int MapSettings::getMaxConnections(const MapSettings::Source &source) {
+	switch (source) {
+	case MapSettings::SourceOpenStreetMap:
+		// https://operations.osmfoundation.org/policies/tiles/
+		return 2;
+	case MapSettings::SourceOpenCycleMap:
+	case MapSettings::SourceOpenTopoMap:
+	case MapSettings::SourceMapsForFree:
+	case MapSettings::SourceOSMPublicTransport:
+		return 4;
+	default:
+		return 8;
+	}
+
+	return 8;
+}
+
+
+int MapSettings::getRateLimit(const MapSettings::Source &source) {
+	switch (source) {
+	case MapSettings::SourceOpenStreetMap:
+		return 10;
+	case MapSettings::SourceOpenCycleMap:
+	case MapSettings::SourceOpenTopoMap:
+	case MapSettings::SourceMapsForFree:
+	case MapSettings::SourceOSMPublicTransport:
+		return 20;
+	default:
+		return 50;
+	}
+
+	return 50;
+}
+
+
 int MapSettings::getMaxZoom(const MapSettings::Source &source) {
 	switch (source) {
 	case MapSettings::SourceNull:
@@ -314,6 +359,8 @@ Map::Map(GPX2Video &app, const MapSettings &settings, struct event_base *evbase)
 
 	buf_ = NULL;
 	mapbuf_ = NULL;
+	trail_ = NULL;
+	geometry_ = NULL;
 
 	evcurl_ = EVCurl::init(evbase);
 	
@@ -326,12 +373,14 @@ Map::Map(GPX2Video &app, const MapSettings &settings, struct event_base *evbase)
 Map::~Map() {
 	log_call();
 
+	if (trail_ != NULL)
+		delete trail_;
 	if (mapbuf_ != NULL)
 		delete mapbuf_;
 	if (buf_)
 		delete buf_;
-
-	delete evcurl_;
+	if (evcurl_)
+		delete evcurl_;
 }
 
 
@@ -362,46 +411,12 @@ void Map::setSize(int width, int height) {
 }
 
 
-int Map::lat2pixel(int zoom, float lat) {
-    float lat_m;
-    int pixel_y;
-
-    double latrad = lat * M_PI / 180.0;
-
-    lat_m = atanh(sin(latrad));
-
-    // the formula is some more notes
-    // http://manialabs.wordpress.com/2013/01/26/converting-latitude-and-longitude-to-map-tile-in-mercator-projection/
-    //
-    // pixel_y = -(2^zoom * TILESIZE * lat_m) / 2PI + (2^zoom * TILESIZE) / 2
-    pixel_y = -(int)( (lat_m * TILESIZE * (1 << zoom) ) / (2*M_PI)) +
-        ((1 << zoom) * (TILESIZE/2) );
-
-    return pixel_y;
-}
-
-
-int Map::lon2pixel(int zoom, float lon) {
-    int pixel_x;
-
-    double lonrad = lon * M_PI / 180.0;
-
-    // the formula is
-    //
-    // pixel_x = (2^zoom * TILESIZE * lon) / 2PI + (2^zoom * TILESIZE) / 2
-    pixel_x = (int)(( lonrad * TILESIZE * (1 << zoom) ) / (2*M_PI)) +
-        ( (1 << zoom) * (TILESIZE/2) );
-
-    return pixel_x;
-}
-
-
-std::string Map::buildURI(int zoom, int x, int y) {
+std::string Map::buildURI(const MapSettings::Source &source, int zoom, int x, int y) {
 	char s[16];
 
-	int max_zoom = settings().getMaxZoom(settings().source());
+	int max_zoom = MapSettings::getMaxZoom(source);
 
-	std::string uri = settings().getRepoURI(settings().source());
+	std::string uri = MapSettings::getRepoURI(source);
 
 	log_call();
 
@@ -450,22 +465,23 @@ std::string Map::buildURI(int zoom, int x, int y) {
 }
 
 
-std::string Map::buildPath(int zoom, int x, int y) {
+std::string Map::buildPath(const MapSettings::Source &source, int zoom, int x, int y) {
 	std::ostringstream stream;
 
 	(void) x;
 	(void) y;
 
 	stream << std::getenv("HOME");
-	stream << "/.gpx2video/cache/" << settings().source() << "/" << zoom;
+	stream << "/.gpx2video/cache/" << source << "/" << zoom;
 
 	return stream.str();
 }
 
 
-std::string Map::buildFilename(int zoom, int x, int y) {
+std::string Map::buildFilename(const MapSettings::Source &source, int zoom, int x, int y) {
 	std::ostringstream stream;
 
+	(void) source;
 	(void) zoom;
 
 	stream << "tile_" << y << "_" << x << ".png";
@@ -506,11 +522,11 @@ void Map::init(void) {
 	// +-------+-------+-------+ ..... +-------+
 
 	// lat/lon to pixel
-	px1_ = Map::lon2pixel(zoom, lon1);
-	py1_ = Map::lat2pixel(zoom, lat1);
+	px1_ = floor(Projection::lon2pixel(zoom, lon1));
+	py1_ = floor(Projection::lat2pixel(zoom, lat1));
 
-	px2_ = Map::lon2pixel(zoom, lon2);
-	py2_ = Map::lat2pixel(zoom, lat2);
+	px2_ = floor(Projection::lon2pixel(zoom, lon2));
+	py2_ = floor(Projection::lat2pixel(zoom, lat2));
 
 	// lat/lon to tile index
 	x1_ = floorf((float) px1_ / (float) TILESIZE);
@@ -531,6 +547,15 @@ void Map::init(void) {
 		y2_ += 1;
 	}
 
+	// Map identity
+	{
+		std::ostringstream stream;
+
+		stream << settings().source() << "/" << zoom << "/" << x1_ << "," << y1_ << "-" << x2_ << "," << y2_;
+
+		key_ = stream.str();
+	}
+
 	// Build each tile
 	for (int y=y1_; y<y2_; y++) {
 		for (int x=x1_; x<x2_; x++) {
@@ -551,36 +576,36 @@ void Map::init(void) {
 
 	// Compute display limits
 	if ((w + 2 * padding) < width) {
-		lim_x1_ = floorf((float) Map::lon2pixel(zoom, lon1)) - (x1_ * TILESIZE);
+		lim_x1_ = px1_ - (x1_ * TILESIZE);
 		lim_x1_ *= divider;
 		lim_x1_ -= (width - w) / 2;
 
 		lim_x2_ = lim_x1_;
 	}
 	else {
-		lim_x1_ = floorf((float) Map::lon2pixel(zoom, lon1)) - (x1_ * TILESIZE);
+		lim_x1_ = px1_ - (x1_ * TILESIZE);
 		lim_x1_ *= divider;
 		lim_x1_ -= padding;
 
-		lim_x2_ = floorf((float) Map::lon2pixel(zoom, lon2)) - (x1_ * TILESIZE);
+		lim_x2_ = px2_ - (x1_ * TILESIZE);
 		lim_x2_ *= divider;
 		lim_x2_ -= width;
 		lim_x2_ += padding;
 	}
 
 	if ((h + 2 * padding) < height) {
-		lim_y1_ = floorf((float) Map::lat2pixel(zoom, lat1)) - (y1_ * TILESIZE);
+		lim_y1_ = py1_ - (y1_ * TILESIZE);
 		lim_y1_ *= divider;
 		lim_y1_ -= (height - h) / 2;
 
 		lim_y2_ = lim_y1_;
 	}
 	else {
-		lim_y1_ = floorf((float) Map::lat2pixel(zoom, lat1)) - (y1_ * TILESIZE);
+		lim_y1_ = py1_ - (y1_ * TILESIZE);
 		lim_y1_ *= divider;
 		lim_y1_ -= padding;
 
-		lim_y2_ = floorf((float) Map::lat2pixel(zoom, lat2)) - (y1_ * TILESIZE);
+		lim_y2_ = py2_ - (y1_ * TILESIZE);
 		lim_y2_ *= divider;
 		lim_y2_ -= height;
 		lim_y2_ += padding;
@@ -593,6 +618,17 @@ void Map::download(void) {
 
 	log_call();
 
+	// Map already built in this process
+	{
+		std::lock_guard<std::mutex> lock(maps_mutex);
+
+		if (maps_built.find(key_) != maps_built.end()) {
+			filename_ = maps_built[key_];
+			complete();
+			return;
+		}
+	}
+
 	log_notice("Download map from %s...", MapSettings::getFriendlyName(settings().source()).c_str());
 
 	nbr_downloads_ = 1;
@@ -683,6 +719,12 @@ void Map::build(void) {
 
 	out->close();
 
+	{
+		std::lock_guard<std::mutex> lock(maps_mutex);
+
+		maps_built[key_] = filename_;
+	}
+
 	// User requests track draw
 	if (app_.command() == GPX2Video::CommandTrack)
 		draw();
@@ -712,7 +754,7 @@ void Map::draw(void) {
 	OIIO::ImageBuf buf(mapbuf_->spec());
 
 	// Draw map
-	OIIO::ImageBufAlgo::over(buf, *mapbuf_, buf);
+	Blend::over(buf, *mapbuf_);
 
 	// Draw markers
 	drawPicto(buf, x_start_, y_start_, OIIO::ROI(), "./assets/marker/start.png", 0.3);
@@ -734,19 +776,23 @@ error:
 }
 
 
-void Map::path(OIIO::ImageBuf &outbuf, GPX *gpx, double divider) {
+void Map::path(OIIO::ImageBuf &outbuf, TrackGeometry *geometry, double divider) {
 	int zoom;
 	int stride;
 	unsigned char *data;
 
-	int x = 0, y = 0;
-
-	GPXData wpt;
+	double scale;
+	double x0, y0;
 
 	log_call();
 
 	zoom = settings().zoom();
 
+	// Projection
+	scale = Projection::size(zoom) * divider;
+	x0 = x1_ * TILESIZE * divider;
+	y0 = y1_ * TILESIZE * divider;
+
 	// Cairo buffer
 	OIIO::ImageBuf buf(outbuf.spec());
 
@@ -761,36 +807,17 @@ void Map::path(OIIO::ImageBuf &outbuf, GPX *gpx, double divider) {
 	cairo_set_line_width(cairo, 4.4); //40.96);
 	cairo_set_line_join(cairo, CAIRO_LINE_JOIN_ROUND);
 
-	// Draw each WPT
-	for (gpx->retrieveFirst(wpt); wpt.valid(); gpx->retrieveNext(wpt)) {
-		x = floorf((float) Map::lon2pixel(zoom, wpt.position().lon)) - (x1_ * TILESIZE);
-		y = floorf((float) Map::lat2pixel(zoom, wpt.position().lat)) - (y1_ * TILESIZE);
-
-		x *= divider;
-		y *= divider;
+	// Draw simplified track
+	geometry->trace(cairo, scale, x0, y0);
 
-		cairo_line_to(cairo, x, y);
-	}
-
-	// Cairo draw
-	cairo_stroke(cairo);
+	// Cairo draw (keep path for the second pass)
+	cairo_stroke_preserve(cairo);
 
 	// Path color
 	cairo_set_source_rgb(cairo, 0.9, 0.4, 0.2); // BGR #669df6
 	cairo_set_line_width(cairo, 3.0); //40.96);
 	cairo_set_line_join(cairo, CAIRO_LINE_JOIN_ROUND);
 
-	// Draw each WPT
-	for (gpx->retrieveFirst(wpt); wpt.valid(); gpx->retrieveNext(wpt)) {
-		x = floorf((float) Map::lon2pixel(zoom, wpt.position().lon)) - (x1_ * TILESIZE);
-		y = floorf((float) Map::lat2pixel(zoom, wpt.position().lat)) - (y1_ * TILESIZE);
-
-		x *= divider;
-		y *= divider;
-
-		cairo_line_to(cairo, x, y);
-	}
-
 	// Cairo draw
 	cairo_stroke (cairo);
 
@@ -805,7 +832,7 @@ void Map::path(OIIO::ImageBuf &outbuf, GPX *gpx, double divider) {
 		stride);
 
 	// Cairo over
-	OIIO::ImageBufAlgo::over(outbuf, buf, outbuf);
+	Blend::over(outbuf, buf);
 
 	// Release
 	cairo_surface_destroy(surface);
@@ -820,62 +847,83 @@ bool Map::load(void) {
 	int zoom = settings().zoom();
 	double divider = settings().divider();
 
-	std::string filename = app_.settings().gpxfile();
+	double x, y;
 
-	GPXData wpt;
+	OIIO::ImageBuf *raster;
+
+	std::ostringstream key;
 
 	log_call();
 
-	// Open map
-	auto img = OIIO::ImageInput::open(filename_);
+	// Projection
+	scale_ = Projection::size(zoom) * divider;
+	x0_ = x1_ * TILESIZE * divider;
+	y0_ = y1_ * TILESIZE * divider;
 
-	if (img == NULL) {
-		log_warn("Can't load '%s' map file", filename_.c_str());
-		return false;
-	}
+	TrackGeometry *geometry = app_.geometry();
+
+	key << key_ << "@" << divider;
+
+	{
+		std::lock_guard<std::mutex> lock(maps_mutex);
+
+		if (maps_loaded.find(key.str()) != maps_loaded.end()) {
+			raster = maps_loaded[key.str()];
+			goto done;
+		}
 
-	const OIIO::ImageSpec& spec = img->spec();
-	VideoParams::Format img_fmt = OIIOUtils::getFormatFromOIIOBaseType((OIIO::TypeDesc::BASETYPE) spec.format.basetype);
-	OIIO::TypeDesc::BASETYPE type = OIIOUtils::getOIIOBaseTypeFromFormat(img_fmt);
+		// Open map
+		auto img = OIIO::ImageInput::open(filename_);
 
-	OIIO::ImageBuf buf(OIIO::ImageSpec(spec.width, spec.height, spec.nchannels, type)); //, OIIO::InitializePixels::No);
-	img->read_image(type, buf.localpixels());
+		if (img == NULL) {
+			log_warn("Can't load '%s' map file", filename_.c_str());
+			return false;
+		}
 
-	// Resize map
-	mapbuf_ = new OIIO::ImageBuf(OIIO::ImageSpec(spec.width * divider, spec.height * divider, spec.nchannels, type)); //, OIIO::InitializePixels::No);
-	OIIO::ImageBufAlgo::resize(*mapbuf_, buf);
+		const OIIO::ImageSpec& spec = img->spec();
+		VideoParams::Format img_fmt = OIIOUtils::getFormatFromOIIOBaseType((OIIO::TypeDesc::BASETYPE) spec.format.basetype);
+		OIIO::TypeDesc::BASETYPE type = OIIOUtils::getOIIOBaseTypeFromFormat(img_fmt);
 
-	GPX *gpx = GPX::open(filename);
+		OIIO::ImageBuf buf(OIIO::ImageSpec(spec.width, spec.height, spec.nchannels, type)); //, OIIO::InitializePixels::No);
+		img->read_image(type, buf.localpixels());
+
+		// Resize map
+		raster = new OIIO::ImageBuf(OIIO::ImageSpec(spec.width * divider, spec.height * divider, spec.nchannels, type)); //, OIIO::InitializePixels::No);
+		OIIO::ImageBufAlgo::resize(*raster, buf);
 
-	if (gpx != NULL) {
 		// Draw path
-		path(*mapbuf_, gpx, divider);
+		if ((geometry != NULL) && !geometry->empty())
+			path(*raster, geometry, divider);
 
-		// Compute begin
-		gpx->retrieveFirst(wpt);
+		maps_loaded[key.str()] = raster;
+	}
 
-		x_start_ = floorf((float) Map::lon2pixel(zoom, wpt.position().lon)) - (x1_ * TILESIZE);
-		y_start_ = floorf((float) Map::lat2pixel(zoom, wpt.position().lat)) - (y1_ * TILESIZE);
+done:
+	// Wrap shared raster (read only)
+	mapbuf_ = new OIIO::ImageBuf(raster->spec(), raster->localpixels());
 
-		x_start_ *= divider;
-		y_start_ *= divider;
+	if ((geometry != NULL) && !geometry->empty()) {
+		// Compute begin
+		geometry->pixel(0, scale_, x0_, y0_, &x, &y);
+
+		x_start_ = x;
+		y_start_ = y;
 
 		// Compute end
-		gpx->retrieveLast(wpt);
+		geometry->pixel(geometry->size() - 1, scale_, x0_, y0_, &x, &y);
 
-		x_end_ = floorf((float) Map::lon2pixel(zoom, wpt.position().lon)) - (x1_ * TILESIZE);
-		y_end_ = floorf((float) Map::lat2pixel(zoom, wpt.position().lat)) - (y1_ * TILESIZE);
+		x_end_ = x;
+		y_end_ = y;
 
-		x_end_ *= divider;
-		y_end_ *= divider;
+		// Trail layer over the path
+		trail_ = Trail::create(geometry, mapbuf_->spec().width, mapbuf_->spec().height, scale_, x0_, y0_);
+
+		geometry_ = geometry;
 	}
 	else {
-		log_warn("Can't open '%s' GPX data file", filename.c_str());
+		log_warn("Can't open '%s' GPX data file", app_.settings().gpxfile().c_str());
 	}
 
-	if (gpx != NULL)
-		delete gpx;
-
 	return (mapbuf_ != NULL);
 }
 
@@ -904,7 +952,20 @@ void Map::prepare(OIIO::ImageBuf *buf) {
 	// Image over
 	buf_->specmod().x = this->x();
 	buf_->specmod().y = this->y();
-	OIIO::ImageBufAlgo::over(*buf, *buf_, *buf, OIIO::ROI());
+	Blend::over(*buf, *buf_);
+}
+
+
+void Map::position(const GPXData &data, double *x, double *y) {
+	// Sub-pixel position interpolated between raw track points (telemetry
+	// filter: filtered position, as other widgets show)
+	if ((geometry_ != NULL) && (app_.settings().telemetryFilter() == TelemetrySettings::FilterNone)) {
+		geometry_->interpolate(data.timestamp(), scale_, x0_, y0_, x, y);
+		return;
+	}
+
+	*x = Projection::lon2x(data.position().lon) * scale_ - x0_;
+	*y = Projection::lat2y(data.position().lat) * scale_ - y0_;
 }
 
 
@@ -917,8 +978,7 @@ void Map::render(OIIO::ImageBuf *frame, const GPXData &data) {
 	int posX, posY;
 	int offsetX, offsetY;
 
-	int zoom = settings().zoom();
-	double divider = settings().divider();
+	double px, py;
 
 	int border = this->border();
 
@@ -935,11 +995,10 @@ void Map::render(OIIO::ImageBuf *frame, const GPXData &data) {
 	height -= 2 * border;
 
 	// Center map on current position
-	posX = floorf((float) Map::lon2pixel(zoom, data.position().lon)) - (x1_ * TILESIZE);
-	posY = floorf((float) Map::lat2pixel(zoom, data.position().lat)) - (y1_ * TILESIZE);
+	position(data, &px, &py);
 
-	posX *= divider;
-	posY *= divider;
+	posX = lround(px);
+	posY = lround(py);
 
 	offsetX = posX - (width / 2);
 	offsetY = posY - (height / 2);
@@ -956,10 +1015,18 @@ void Map::render(OIIO::ImageBuf *frame, const GPXData &data) {
 	// Image over
 	mapbuf_->specmod().x = x - offsetX;
 	mapbuf_->specmod().y = y - offsetY;
-	OIIO::ImageBufAlgo::over(*frame, *mapbuf_, *frame, OIIO::ROI(x, x + width, y, y + height));
+	Blend::over(*frame, *mapbuf_, OIIO::ROI(x, x + width, y, y + height));
+
+	// Draw trail
+	if (trail_ != NULL) {
+		OIIO::ImageBuf *trailbuf = trail_->buffer();
+
+		trail_->update(geometry_->lookup(data.timestamp()), px, py);
 
-	// Draw track
-	// ...
+		trailbuf->specmod().x = x - offsetX;
+		trailbuf->specmod().y = y - offsetY;
+		Blend::over(*frame, *trailbuf, OIIO::ROI(x, x + width, y, y + height));
+	}
 
 	// Draw picto
 	drawPicto(*frame, x - offsetX + x_start_, y - offsetY + y_start_, OIIO::ROI(x, x + width, y, y + height), "./assets/marker/start.png", 0.3);
@@ -972,17 +1039,16 @@ void Map::render(OIIO::ImageBuf *frame, const GPXData &data) {
 bool Map::drawPicto(OIIO::ImageBuf &map, int x, int y, OIIO::ROI roi, const char *picto, double divider) {
 	bool result;
 
-	// Open picto
-	auto img = OIIO::ImageInput::open(picto);
-	const OIIO::ImageSpec& spec = img->spec();
-	OIIO::TypeDesc::BASETYPE type = (OIIO::TypeDesc::BASETYPE) spec.format.basetype;
+	OIIO::ImageBuf *img;
+
+	// Open & resize picto
+	if ((img = sprite(picto)) == NULL)
+		return false;
 
-	OIIO::ImageBuf buf = OIIO::ImageBuf(OIIO::ImageSpec(spec.width, spec.height, spec.nchannels, type));
-	img->read_image(type, buf.localpixels());
+	if ((img = sprite(picto, img->spec().width * divider, img->spec().height * divider)) == NULL)
+		return false;
 
-	// Resize picto
-	OIIO::ImageBuf dst(OIIO::ImageSpec(spec.width * divider, spec.height * divider, spec.nchannels, type));
-	OIIO::ImageBufAlgo::resize(dst, buf);
+	OIIO::ImageBuf dst(img->spec(), img->localpixels());
 
 	// Marker position
 	x -= dst.spec().width / 2;
@@ -991,7 +1057,7 @@ bool Map::drawPicto(OIIO::ImageBuf &map, int x, int y, OIIO::ROI roi, const char
 	// Image over
 	dst.specmod().x = x;
 	dst.specmod().y = y;
-	result = OIIO::ImageBufAlgo::over(map, dst, map, roi);
+	result = Blend::over(map, dst, roi);
 
 	if (!result)
 		log_error("ImageBufAlgo::over failure");
@@ -1050,16 +1116,18 @@ Map::Tile::Tile(Map &map, int zoom, int x, int y)
 	, zoom_(zoom)
 	, x_(x)
 	, y_(y) {
-	fp_ = NULL;
 	evtaskh_ = NULL;
 
-	uri_ = map_.buildURI(zoom_, x_, y_);
-	path_ = map_.buildPath(zoom_, x_, y_);
-	filename_ = map_.buildFilename(zoom_, x_, y_);
+	uri_ = Map::buildURI(map_.settings().source(), zoom_, x_, y_);
+	path_ = Map::buildPath(map_.settings().source(), zoom_, x_, y_);
+	filename_ = Map::buildFilename(map_.settings().source(), zoom_, x_, y_);
+
+	cache_ = new TileCache(path_, filename_);
 }
 
 
 Map::Tile::~Tile() {
+	delete cache_;
 }
 
 
@@ -1112,42 +1180,24 @@ size_t Map::Tile::downloadWrite(char *ptr, size_t size, size_t nmemb, void *user
 	if (ptr == NULL)
 		return 0;
 
-	std::string output = tile->path_ + "/" + tile->filename_;
-
-	// Open output tile file
-	if (tile->fp_ == NULL) {
-		tile->fp_ = std::fopen(output.c_str(), "w+");
-
-		if (tile->fp_ == NULL)
-			return 0;
-	}
-
-	fwrite(ptr, size, nmemb, tile->fp_);
-
-	return size * nmemb;
+	return tile->cache_->write(ptr, size * nmemb);
 }
 
 
 void Map::Tile::downloadComplete(EVCurlTask *evtaskh, CURLcode result, void *userdata) {
 	Map::Tile *tile = (Map::Tile *) userdata;
 
-	log_call();
+	long code = 0;
 
-	(void) evtaskh;
-	(void) result;
-
-	if (tile->fp_)
-		std::fclose(tile->fp_);
+	log_call();
 
-	if (result != CURLE_OK) {
-		std::string output = tile->path_ + "/" + tile->filename_;
+	evtaskh->getInfo(CURLINFO_RESPONSE_CODE, &code);
 
+	if (!tile->cache_->commit(result, code))
 		log_error("\nDownload tile failure: %s", tile->uri().c_str());
+	else if ((result != CURLE_OK) || ((code != 200) && (code != 304)))
+		log_warn("\nRevalidate tile failure, use cached tile: %s", tile->uri().c_str());
 
-		unlink(output.c_str());
-	}
-
-	tile->fp_ = NULL;
 	tile->evtaskh_ = NULL;
 
 	Map::downloadComplete(*tile);
@@ -1155,26 +1205,19 @@ void Map::Tile::downloadComplete(EVCurlTask *evtaskh, CURLcode result, void *use
 
 
 bool Map::Tile::download(void) {
-	struct stat st;
-
-	std::string output = path_ + "/" + filename_;
-
 	log_call();
 
 	::mkpath(path_, 0700);
 
-	// Check if file exists in cache
-	if (access(output.c_str(), F_OK) == 0) {
-		// Check file content
-		stat(output.c_str(), &st);
+	// Check if file exists in cache and is still fresh
+	if (cache_->fresh()) {
+		cache_->touch();
 
-		if (st.st_size > 0) {
-			Map::downloadComplete(*this);
-			return true;
-		}
+		Map::downloadComplete(*this);
+		return true;
 	}
 	
-	// Download
+	// Download (conditional request if tile is cached)
 	evtaskh_ = map_.evcurl()->download(uri_.c_str(), downloadComplete, this);
 
 //	evtaskh_->setOption(CURLOPT_VERBOSE, 1L);
@@ -1192,6 +1235,8 @@ bool Map::Tile::download(void) {
 
 	evtaskh_->setHeader("User-Agent: gpx2video");
 
+	cache_->prepare(evtaskh_);
+
 	evtaskh_->perform();
 
 	return true;
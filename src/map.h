@@ -16,7 +16,10 @@
 
 #include "log.h"
 #include "evcurl.h"
+#include "tilecache.h"
 #include "gpx.h"
+#include "trackgeometry.h"
+#include "trail.h"
 #include "mapsettings.h"
 #include "videowidget.h"
 #include "gpx2video.h"
@@ -54,7 +57,7 @@ public:
 		std::string uri_;
 		std::string path_;
 		std::string filename_;
-		std::FILE *fp_;
+		TileCache *cache_;
 		EVCurlTask *evtaskh_;
 	};
 
@@ -66,8 +69,10 @@ public:
 
 	void setSize(int width, int height);
 
-	static int lat2pixel(int zoom, float lat);
-	static int lon2pixel(int zoom, float lon);
+	// Tile location (remote & cache)
+	static std::string buildURI(const MapSettings::Source &source, int zoom, int x, int y);
+	static std::string buildPath(const MapSettings::Source &source, int zoom, int x, int y);
+	static std::string buildFilename(const MapSettings::Source &source, int zoom, int x, int y);
 
 	bool run(void) {
 		log_call();
@@ -77,9 +82,21 @@ public:
 		return true;
 	}
 
+	// Map built, release downloader (from event loop)
+	bool stop(void) {
+		log_call();
+
+		if (evcurl_)
+			delete evcurl_;
+
+		evcurl_ = NULL;
+
+		return true;
+	}
+
 	// Draw track path
 	void draw(void);
-	void path(OIIO::ImageBuf &outbuf, GPX *gpx, double divider=1.0);
+	void path(OIIO::ImageBuf &outbuf, TrackGeometry *geometry, double divider=1.0);
 
 	// Render map
 	void prepare(OIIO::ImageBuf *buf);
@@ -96,6 +113,9 @@ protected:
 	void init(void);
 	bool load(void);
 
+	// Current position in pixels
+	void position(const GPXData &data, double *x, double *y);
+
 	// Download each tule
 	void download(void);
 	// Draw the full map
@@ -107,10 +127,6 @@ private:
 //	Map(const MapSettings &settings, struct event_base *evbase);
 	Map(GPX2Video &app, const MapSettings &settings, struct event_base *evbase);
 
-	std::string buildURI(int zoom, int x, int y);
-	std::string buildPath(int zoom, int x, int y);
-	std::string buildFilename(int zoom, int x, int y);
-
 	bool drawPicto(OIIO::ImageBuf &map, int x, int y, OIIO::ROI roi, const char *picto, double divider=1.0);
 
 	GPX2Video &app_;
@@ -122,9 +138,22 @@ private:
 
 	OIIO::ImageBuf *mapbuf_;
 
+	// Ridden so far layer
+	Trail *trail_;
+
+	// Shared projected track
+	TrackGeometry *geometry_;
+
+	// Projection (world size & origin in pixels)
+	double scale_;
+	double x0_, y0_;
+
 	// Map filename to tmp save
 	std::string filename_;
 
+	// Map identity (source, zoom & tiles), maps are shared by key
+	std::string key_;
+
 	// Bounding box (map area)
 	int x1_, y1_, x2_, y2_;
 	int px1_, py1_, px2_, py2_;
@@ -53,6 +53,8 @@ public:
 	static const std::string getCopyright(const Source &source);
 	static int getMinZoom(const Source &source);
 	static int getMaxZoom(const Source &source);
+	static int getMaxConnections(const Source &source);
+	static int getRateLimit(const Source &source);
 	static const std::string getRepoURI(const Source &source);
 
 private:
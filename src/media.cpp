@@ -6,11 +6,14 @@
 
 MediaContainer::MediaContainer() 
 	: offset_(0) 
-	, start_time_(0) {
+	, start_time_(0)
+	, demuxer_(NULL) {
 }
 
 
 MediaContainer::~MediaContainer() {
+	if (demuxer_)
+		delete demuxer_;
 }
 
 
@@ -63,6 +66,16 @@ void MediaContainer::setTimeOffset(const int& offset) {
 }
 
 
+Demuxer * MediaContainer::demuxer(void) const {
+	return demuxer_;
+}
+
+
+void MediaContainer::setDemuxer(Demuxer *demuxer) {
+	demuxer_ = demuxer;
+}
+
+
 void MediaContainer::addStream(StreamPtr stream) {
 	stream->setContainer(this);
 
@@ -12,6 +12,7 @@ extern "C" {
 }
 
 #include "stream.h"
+#include "demuxer.h"
 
 
 class MediaContainer {
@@ -25,9 +26,14 @@ public:
 	time_t startTime(void) const;
 	void setStartTime(const std::string &start_time);
 
+	// Camera clock to GPS time offset (in ms)
 	int timeOffset(void) const;
 	void setTimeOffset(const int& offset);
 
+	// Shared demux context
+	Demuxer * demuxer(void) const;
+	void setDemuxer(Demuxer *demuxer);
+
 	void addStream(StreamPtr stream);
 
 	StreamPtr getFirstStreamOfType(const AVMediaType &type) const;
@@ -41,6 +47,8 @@ private:
 	time_t start_time_;
 	std::string filename_;
 
+	Demuxer *demuxer_;
+
 	std::vector<StreamPtr> streams_;
 };
 
@@ -0,0 +1,179 @@
+#include <iostream>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "log.h"
+#include "macros.h"
+#include "mmapreader.h"
+
+
+// Demuxer I/O buffer
+#define IO_BUFFER_SIZE (64 * 1024)
+
+// Read ahead window
+#define READAHEAD_SIZE (32 * 1024 * 1024)
+
+
+MmapReader::MmapReader(const std::string &filename)
+	: filename_(filename)
+	, fd_(-1)
+	, data_(NULL)
+	, size_(0)
+	, pos_(0)
+	, advised_(0)
+	, avio_ctx_(NULL) {
+}
+
+
+MmapReader::~MmapReader() {
+	if (avio_ctx_) {
+		av_freep(&avio_ctx_->buffer);
+		avio_context_free(&avio_ctx_);
+	}
+
+	if (data_)
+		munmap(data_, size_);
+
+	if (fd_ >= 0)
+		::close(fd_);
+}
+
+
+MmapReader * MmapReader::open(const std::string &filename) {
+	MmapReader *reader = new MmapReader(filename);
+
+	if (!reader->init()) {
+		delete reader;
+		return NULL;
+	}
+
+	return reader;
+}
+
+
+bool MmapReader::init(void) {
+	struct stat st;
+
+	uint8_t *buffer = NULL;
+
+	log_call();
+
+	fd_ = ::open(filename_.c_str(), O_RDONLY | O_CLOEXEC);
+
+	if (fd_ < 0)
+		goto error;
+
+	if ((fstat(fd_, &st) != 0) || (st.st_size <= 0))
+		goto error;
+
+	size_ = st.st_size;
+
+	data_ = (uint8_t *) mmap(NULL, size_, PROT_READ, MAP_SHARED, fd_, 0);
+
+	if (data_ == MAP_FAILED) {
+		log_warn("Map '%s' media file failure: %s", filename_.c_str(), strerror(errno));
+		data_ = NULL;
+		goto error;
+	}
+
+	madvise(data_, size_, MADV_SEQUENTIAL);
+
+	buffer = (uint8_t *) av_malloc(IO_BUFFER_SIZE);
+
+	if (buffer == NULL)
+		goto error;
+
+	avio_ctx_ = avio_alloc_context(buffer, IO_BUFFER_SIZE, 0, this, readPacket, NULL, seek);
+
+	if (avio_ctx_ == NULL) {
+		av_free(buffer);
+		goto error;
+	}
+
+	advise();
+
+	return true;
+
+error:
+	return false;
+}
+
+
+void MmapReader::advise(void) {
+	// Still half a window ahead
+	if (pos_ + READAHEAD_SIZE / 2 < advised_)
+		return;
+
+	// Window from current position (after a seek)
+	if ((pos_ < advised_ - READAHEAD_SIZE) || (pos_ > advised_))
+		advised_ = pos_;
+
+	int64_t offset = advised_ & ~((int64_t) sysconf(_SC_PAGESIZE) - 1);
+	int64_t length = MIN((int64_t) READAHEAD_SIZE, size_ - offset);
+
+	if (length <= 0)
+		return;
+
+	posix_fadvise(fd_, offset, length, POSIX_FADV_WILLNEED);
+	madvise(data_ + offset, length, MADV_WILLNEED);
+
+	advised_ = offset + length;
+}
+
+
+int MmapReader::readPacket(void *opaque, uint8_t *buf, int size) {
+	MmapReader *reader = (MmapReader *) opaque;
+
+	if (reader->pos_ >= reader->size_)
+		return AVERROR_EOF;
+
+	size = (int) MIN((int64_t) size, reader->size_ - reader->pos_);
+
+	memcpy(buf, reader->data_ + reader->pos_, size);
+
+	reader->pos_ += size;
+
+	reader->advise();
+
+	return size;
+}
+
+
+int64_t MmapReader::seek(void *opaque, int64_t offset, int whence) {
+	int64_t pos;
+
+	MmapReader *reader = (MmapReader *) opaque;
+
+	if (whence & AVSEEK_SIZE)
+		return reader->size_;
+
+	switch (whence & ~AVSEEK_FORCE) {
+	case SEEK_SET:
+		pos = offset;
+		break;
+	case SEEK_CUR:
+		pos = reader->pos_ + offset;
+		break;
+	case SEEK_END:
+		pos = reader->size_ + offset;
+		break;
+	default:
+		return AVERROR(EINVAL);
+	}
+
+	if ((pos < 0) || (pos > reader->size_))
+		return AVERROR(EINVAL);
+
+	reader->pos_ = pos;
+
+	reader->advise();
+
+	return pos;
+}
+
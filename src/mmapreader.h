@@ -0,0 +1,53 @@
+#ifndef __GPX2VIDEO__MMAPREADER_H__
+#define __GPX2VIDEO__MMAPREADER_H__
+
+#include <string>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+
+// Demuxer input backed by a memory mapped file
+//
+// The file is mapped once and read sequentially by the demuxer (video,
+// audio & data streams are interleaved in the same file). The kernel
+// is asked to read ahead by large windows, following the read position.
+class MmapReader {
+public:
+	virtual ~MmapReader();
+
+	static MmapReader * open(const std::string &filename);
+
+	AVIOContext * context(void) {
+		return avio_ctx_;
+	}
+
+protected:
+	bool init(void);
+
+	// Read ahead from current position
+	void advise(void);
+
+	static int readPacket(void *opaque, uint8_t *buf, int size);
+	static int64_t seek(void *opaque, int64_t offset, int whence);
+
+private:
+	MmapReader(const std::string &filename);
+
+	std::string filename_;
+
+	int fd_;
+
+	uint8_t *data_;
+	int64_t size_;
+	int64_t pos_;
+
+	// Read ahead window end
+	int64_t advised_;
+
+	AVIOContext *avio_ctx_;
+};
+
+#endif
+
@@ -0,0 +1,560 @@
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <cstddef>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "log.h"
+#include "macros.h"
+#include "utils.h"
+#include "blend.h"
+#include "overlaycache.h"
+
+
+#define OVERLAYCACHE_MAGIC "GPX2VOC"
+#define OVERLAYCACHE_VERSION 1
+
+// Longest RLE run
+#define RUN_MAX 32767
+
+
+OverlayCache::OverlayCache(const std::string &filename)
+	: filename_(filename)
+	, pixel_size_(0)
+	, nbr_sprites_(0)
+	, nbr_frames_(0)
+	, file_(NULL)
+	, pos_(0)
+	, fd_(-1)
+	, data_(NULL)
+	, size_(0) {
+	memset(&base_, 0, sizeof(base_));
+}
+
+
+OverlayCache::~OverlayCache() {
+	// Aborted build
+	if (file_) {
+		fclose(file_);
+		::remove((filename_ + ".tmp").c_str());
+	}
+
+	if (data_)
+		munmap(data_, size_);
+
+	if (fd_ >= 0)
+		::close(fd_);
+}
+
+
+std::string OverlayCache::path(uint64_t key) {
+	std::ostringstream stream;
+
+	std::string path = std::getenv("HOME") + std::string("/.gpx2video/cache/overlay");
+
+	::mkpath(path, 0700);
+
+	stream << path << "/" << std::hex << std::setw(16) << std::setfill('0') << key << ".ovc";
+
+	return stream.str();
+}
+
+
+uint64_t OverlayCache::hash(const void *data, size_t size, uint64_t seed) {
+	size_t i;
+
+	uint64_t h = seed;
+
+	const uint8_t *p = (const uint8_t *) data;
+
+	for (i=0; i<size; i++) {
+		h ^= p[i];
+		h *= 0x100000001b3ULL;
+	}
+
+	return h;
+}
+
+
+uint64_t OverlayCache::hash(const std::string &s, uint64_t seed) {
+	// Keep length, so that "ab" + "c" & "a" + "bc" differ
+	uint64_t size = s.size();
+
+	return hash(s.data(), s.size(), hash(&size, sizeof(size), seed));
+}
+
+
+uint64_t OverlayCache::hashFile(const std::string &filename, uint64_t seed) {
+	char buffer[64 * 1024];
+
+	uint64_t h = hash(filename, seed);
+
+	std::ifstream file(filename, std::ios::binary);
+
+	while (file.read(buffer, sizeof(buffer)) || (file.gcount() > 0))
+		h = hash(buffer, file.gcount(), h);
+
+	return h;
+}
+
+
+OverlayCache * OverlayCache::open(const std::string &filename, int width, int height, int pixel_size) {
+	OverlayCache *cache = new OverlayCache(filename);
+
+	if (!cache->load(width, height, pixel_size)) {
+		delete cache;
+		return NULL;
+	}
+
+	return cache;
+}
+
+
+OverlayCache * OverlayCache::create(const std::string &filename, int width, int height, int pixel_size, int nbr_sprites) {
+	OverlayCache *cache = new OverlayCache(filename);
+
+	if (!cache->init(width, height, pixel_size, nbr_sprites)) {
+		delete cache;
+		return NULL;
+	}
+
+	return cache;
+}
+
+
+bool OverlayCache::load(int width, int height, int pixel_size) {
+	struct stat st;
+
+	const Header *header;
+
+	log_call();
+
+	fd_ = ::open(filename_.c_str(), O_RDONLY | O_CLOEXEC);
+
+	if (fd_ < 0)
+		goto error;
+
+	if ((fstat(fd_, &st) != 0) || (st.st_size < (off_t) sizeof(Header)))
+		goto error;
+
+	size_ = st.st_size;
+
+	data_ = (uint8_t *) mmap(NULL, size_, PROT_READ, MAP_SHARED, fd_, 0);
+
+	if (data_ == MAP_FAILED) {
+		log_warn("Map '%s' overlay cache failure: %s", filename_.c_str(), strerror(errno));
+		data_ = NULL;
+		goto error;
+	}
+
+	header = (const Header *) data_;
+
+	if (memcmp(header->magic, OVERLAYCACHE_MAGIC, sizeof(header->magic))
+		|| (header->version != OVERLAYCACHE_VERSION)
+		|| (header->width != (uint32_t) width)
+		|| (header->height != (uint32_t) height)
+		|| (header->pixel_size != (uint32_t) pixel_size)) {
+		log_warn("Overlay cache '%s' doesn't match output, skip it", filename_.c_str());
+		goto error;
+	}
+
+	// Base & each frame sprites
+	if ((header->index < (int64_t) sizeof(Header)) || (header->index % alignof(Entry))
+		|| (header->index + (int64_t) ((1 + header->nbr_frames * header->nbr_sprites) * sizeof(Entry)) > size_)) {
+		log_warn("Overlay cache '%s' is corrupted, skip it", filename_.c_str());
+		goto error;
+	}
+
+	pixel_size_ = pixel_size;
+	nbr_sprites_ = header->nbr_sprites;
+	nbr_frames_ = header->nbr_frames;
+
+	// Frames are read in sequence
+	madvise(data_, size_, MADV_SEQUENTIAL);
+
+	return true;
+
+error:
+	return false;
+}
+
+
+bool OverlayCache::init(int width, int height, int pixel_size, int nbr_sprites) {
+	Header header;
+
+	log_call();
+
+	pixel_size_ = pixel_size;
+	nbr_sprites_ = nbr_sprites;
+
+	if ((file_ = fopen((filename_ + ".tmp").c_str(), "wb")) == NULL) {
+		log_error("Open '%s' overlay cache failure: %s", filename_.c_str(), strerror(errno));
+		return false;
+	}
+
+	// Header is completed at close
+	memset(&header, 0, sizeof(header));
+	strcpy(header.magic, OVERLAYCACHE_MAGIC);
+	header.version = OVERLAYCACHE_VERSION;
+	header.width = width;
+	header.height = height;
+	header.pixel_size = pixel_size;
+	header.nbr_sprites = nbr_sprites;
+
+	if (fwrite(&header, sizeof(header), 1, file_) != 1)
+		return false;
+
+	pos_ = sizeof(header);
+
+	previous_.resize(nbr_sprites);
+
+	return true;
+}
+
+
+void OverlayCache::encode(const OIIO::ImageBuf &buf, Sprite &sprite) {
+	int x, y, n;
+	int x1, y1, x2, y2;
+
+	const OIIO::ImageSpec &spec = buf.spec();
+
+	int pixel_size = spec.pixel_bytes();
+
+	const uint8_t *row;
+	const uint8_t *p;
+
+	// Same test as blend kernels: only an all zero pixel leaves dst unchanged
+	// (premultiplied color can be added with a zero alpha)
+	auto visible = [&](const uint8_t *pixel) {
+		for (int i=0; i<pixel_size; i++) {
+			if (pixel[i])
+				return true;
+		}
+		return false;
+	};
+
+	auto same = [&](const uint8_t *a, const uint8_t *b) {
+		return memcmp(a, b, pixel_size) == 0;
+	};
+
+	sprite.data.clear();
+
+	// Dirty rectangle
+	x1 = spec.x + spec.width;
+	y1 = spec.y + spec.height;
+	x2 = spec.x - 1;
+	y2 = spec.y - 1;
+
+	for (y=spec.y; y<spec.y + spec.height; y++) {
+		row = (const uint8_t *) buf.pixeladdr(spec.x, y);
+
+		for (x=0; x<spec.width; x++) {
+			if (visible(row + x * pixel_size)) {
+				x1 = MIN(x1, spec.x + x);
+				x2 = MAX(x2, spec.x + x);
+				y1 = MIN(y1, y);
+				y2 = MAX(y2, y);
+			}
+		}
+	}
+
+	// Fully transparent
+	if (x2 < x1) {
+		sprite.x = sprite.y = sprite.width = sprite.height = 0;
+		return;
+	}
+
+	sprite.x = x1;
+	sprite.y = y1;
+	sprite.width = x2 - x1 + 1;
+	sprite.height = y2 - y1 + 1;
+
+	auto put = [&](int16_t count, const uint8_t *pixels, int nbr_pixels) {
+		const uint8_t *c = (const uint8_t *) &count;
+
+		sprite.data.insert(sprite.data.end(), c, c + sizeof(count));
+		sprite.data.insert(sprite.data.end(), pixels, pixels + nbr_pixels * pixel_size);
+	};
+
+	// RLE, row by row
+	for (y=y1; y<=y2; y++) {
+		row = (const uint8_t *) buf.pixeladdr(x1, y);
+
+		for (x=0; x<sprite.width; ) {
+			p = row + x * pixel_size;
+
+			// Repeated pixel
+			for (n=1; (x + n < sprite.width) && (n < RUN_MAX) && same(p, p + n * pixel_size); n++);
+
+			if (n > 1) {
+				put(-n, p, 1);
+				x += n;
+				continue;
+			}
+
+			// Literal pixels, up to the next repeat
+			for (n=1; (x + n < sprite.width) && (n < RUN_MAX); n++) {
+				if ((x + n + 1 < sprite.width) && same(p + n * pixel_size, p + (n + 1) * pixel_size))
+					break;
+			}
+
+			put(n, p, n);
+			x += n;
+		}
+	}
+}
+
+
+bool OverlayCache::write(const Sprite &sprite, Entry &entry) {
+	entry.x = sprite.x;
+	entry.y = sprite.y;
+	entry.width = sprite.width;
+	entry.height = sprite.height;
+	entry.offset = pos_;
+	entry.size = sprite.data.size();
+
+	if (sprite.data.empty())
+		return true;
+
+	if (fwrite(sprite.data.data(), sprite.data.size(), 1, file_) != 1)
+		return false;
+
+	pos_ += sprite.data.size();
+
+	return true;
+}
+
+
+bool OverlayCache::setBase(const Sprite &sprite) {
+	return write(sprite, base_);
+}
+
+
+bool OverlayCache::append(const std::vector<Sprite> &sprites) {
+	int i;
+
+	Entry entry;
+
+	for (i=0; i<nbr_sprites_; i++) {
+		const Sprite &sprite = sprites[i];
+		Sprite &previous = previous_[i];
+
+		// Unchanged since previous frame
+		if (nbr_frames_ > 0
+			&& (sprite.x == previous.x) && (sprite.y == previous.y)
+			&& (sprite.width == previous.width) && (sprite.height == previous.height)
+			&& (sprite.data == previous.data)) {
+			index_.push_back(index_[index_.size() - nbr_sprites_]);
+			continue;
+		}
+
+		if (!write(sprite, entry))
+			return false;
+
+		index_.push_back(entry);
+
+		previous = sprite;
+	}
+
+	nbr_frames_++;
+
+	return true;
+}
+
+
+bool OverlayCache::close(void) {
+	bool success = false;
+
+	log_call();
+
+	if (file_ == NULL)
+		return false;
+
+	// Index is read in place (mmap), align it
+	while (pos_ % alignof(Entry)) {
+		if (fputc(0, file_) == EOF)
+			goto done;
+
+		pos_++;
+	}
+
+	// Base entry, then frames
+	if (fwrite(&base_, sizeof(base_), 1, file_) != 1)
+		goto done;
+
+	if (!index_.empty() && (fwrite(index_.data(), sizeof(Entry), index_.size(), file_) != index_.size()))
+		goto done;
+
+	// Complete header
+	if ((fseek(file_, offsetof(Header, nbr_frames), SEEK_SET) != 0)
+		|| (fwrite(&nbr_frames_, sizeof(nbr_frames_), 1, file_) != 1)
+		|| (fwrite(&pos_, sizeof(pos_), 1, file_) != 1))
+		goto done;
+
+	if (fclose(file_) != 0) {
+		file_ = NULL;
+		goto done;
+	}
+
+	file_ = NULL;
+
+	if (::rename((filename_ + ".tmp").c_str(), filename_.c_str()) != 0)
+		goto done;
+
+	success = true;
+
+done:
+	if (!success)
+		log_error("Write '%s' overlay cache failure", filename_.c_str());
+
+	return success;
+}
+
+
+bool OverlayCache::check(const Entry &entry, const OIIO::ROI &roi) const {
+	int x, y;
+	int16_t count;
+
+	const uint8_t *p, *end;
+
+	if (entry.size == 0)
+		return true;
+
+	if ((entry.width <= 0) || (entry.height <= 0)
+		|| (entry.offset < (int64_t) sizeof(Header)) || (entry.size < 0)
+		|| (entry.offset + entry.size > size_))
+		return false;
+
+	// Sprite out of frame
+	if ((entry.x < roi.xbegin) || (entry.y < roi.ybegin)
+		|| (entry.x + entry.width > roi.xend) || (entry.y + entry.height > roi.yend))
+		return false;
+
+	p = data_ + entry.offset;
+	end = p + entry.size;
+
+	for (y=0; y<entry.height; y++) {
+		for (x=0; x<entry.width; ) {
+			if (p + sizeof(count) > end)
+				return false;
+
+			memcpy(&count, p, sizeof(count));
+			p += sizeof(count);
+
+			// Runs don't cross rows
+			if ((count == 0) || (abs(count) > entry.width - x))
+				return false;
+
+			if (p + ((count > 0) ? count : 1) * pixel_size_ > end)
+				return false;
+
+			p += ((count > 0) ? count : 1) * pixel_size_;
+			x += abs(count);
+		}
+	}
+
+	return (p == end);
+}
+
+
+void OverlayCache::blend(OIIO::ImageBuf &buf, const Entry &entry) const {
+	int x, y;
+	int16_t count;
+
+	// Repeated pixel, blended by slices
+	uint64_t pixels[256];
+
+	// Transparent pixel (RGBA16 at most)
+	static const uint8_t zero[8] = { 0 };
+
+	// Entry is checked (see check)
+	const uint8_t *p = data_ + entry.offset;
+
+	if (entry.size == 0)
+		return;
+
+	for (y=entry.y; y<entry.y + entry.height; y++) {
+		uint8_t *dst = (uint8_t *) buf.pixeladdr(entry.x, y);
+
+		for (x=0; x<entry.width; ) {
+			memcpy(&count, p, sizeof(count));
+			p += sizeof(count);
+
+			// Literal pixels
+			if (count > 0) {
+				if (pixel_size_ == 4)
+					Blend::overRGBA8(dst, p, count);
+				else
+					Blend::overRGBA16((uint16_t *) dst, (const uint16_t *) p, count);
+
+				p += count * pixel_size_;
+			}
+			// Repeated pixel, transparent runs are skipped
+			else {
+				int i, n;
+
+				count = -count;
+
+				if (memcmp(p, zero, pixel_size_) != 0) {
+					n = MIN(count, (int) (sizeof(pixels) / pixel_size_));
+
+					for (i=0; i<n; i++)
+						memcpy((uint8_t *) pixels + i * pixel_size_, p, pixel_size_);
+
+					for (i=0; i<count; i+=n) {
+						n = MIN(count - i, n);
+
+						if (pixel_size_ == 4)
+							Blend::overRGBA8(dst + i * pixel_size_, (const uint8_t *) pixels, n);
+						else
+							Blend::overRGBA16((uint16_t *) (dst + i * pixel_size_), (const uint16_t *) pixels, n);
+					}
+				}
+
+				p += pixel_size_;
+			}
+
+			dst += count * pixel_size_;
+			x += count;
+		}
+	}
+}
+
+
+bool OverlayCache::blend(OIIO::ImageBuf &buf, int64_t index) const {
+	int i;
+
+	const Header *header = (const Header *) data_;
+	const Entry *entries = (const Entry *) (data_ + header->index);
+
+	if ((index < 0) || (index >= nbr_frames_))
+		return false;
+
+	// Corrupted or stale cache file: frame is drawn
+	if (!check(entries[0], buf.roi()))
+		return false;
+
+	for (i=0; i<nbr_sprites_; i++) {
+		if (!check(entries[1 + index * nbr_sprites_ + i], buf.roi()))
+			return false;
+	}
+
+	// Static layer
+	blend(buf, entries[0]);
+
+	// Widgets in layout order
+	for (i=0; i<nbr_sprites_; i++)
+		blend(buf, entries[1 + index * nbr_sprites_ + i]);
+
+	return true;
+}
+
@@ -0,0 +1,124 @@
+#ifndef __GPX2VIDEO__OVERLAYCACHE_H__
+#define __GPX2VIDEO__OVERLAYCACHE_H__
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+
+#include <OpenImageIO/imagebuf.h>
+
+
+// Overlay sequence cache
+//
+// Widgets output only depends on telemetry & frame time, so the overlay of
+// each frame can be rendered once, then blended by each video pass (codec
+// settings can change between passes).
+//
+// File layout (native endianness, mmap'ed by readers):
+//
+//   Header  | base sprite | frame sprites... | index
+//
+// The index holds a sprite entry by widget for each frame. A sprite is the
+// dirty rectangle of a widget tile (bounding box of non transparent pixels),
+// RLE compressed row by row: an int16 count, followed by 'count' literal
+// pixels if positive, or by a pixel repeated '-count' times if negative. A
+// sprite identical to the previous frame one shares its data.
+class OverlayCache {
+public:
+	struct Sprite {
+		int32_t x;
+		int32_t y;
+		int32_t width;
+		int32_t height;
+
+		std::vector<uint8_t> data;
+	};
+
+	virtual ~OverlayCache();
+
+	// Cache file of an overlay sequence key (see hash)
+	static std::string path(uint64_t key);
+
+	// FNV-1a hash, to build a key from layout, GPX, offset, frame rate...
+	static uint64_t hash(const void *data, size_t size, uint64_t seed=0xcbf29ce484222325ULL);
+	static uint64_t hash(const std::string &s, uint64_t seed=0xcbf29ce484222325ULL);
+	static uint64_t hashFile(const std::string &filename, uint64_t seed=0xcbf29ce484222325ULL);
+
+	// Read a cached sequence, NULL if missing or not matching output
+	static OverlayCache * open(const std::string &filename, int width, int height, int pixel_size);
+
+	// Write a sequence of 'nbr_sprites' widgets by frame (file is renamed at
+	// close, so that an aborted build isn't used)
+	static OverlayCache * create(const std::string &filename, int width, int height, int pixel_size, int nbr_sprites);
+
+	// Compress the non transparent area of buf (thread safe)
+	static void encode(const OIIO::ImageBuf &buf, Sprite &sprite);
+
+	// Writer side
+	bool setBase(const Sprite &sprite);
+	bool append(const std::vector<Sprite> &sprites);
+	bool close(void);
+
+	// Reader side
+	int64_t nbrFrames(void) const {
+		return nbr_frames_;
+	}
+
+	// Blend frame 'index' overlay over buf, false if not cached
+	bool blend(OIIO::ImageBuf &buf, int64_t index) const;
+
+private:
+	struct Header {
+		char magic[8];
+		uint32_t version;
+		uint32_t width;
+		uint32_t height;
+		uint32_t pixel_size;
+		uint32_t nbr_sprites;
+		uint32_t reserved;
+		int64_t nbr_frames;
+		int64_t index;
+	};
+
+	struct Entry {
+		int32_t x;
+		int32_t y;
+		int32_t width;
+		int32_t height;
+		int64_t offset;
+		int64_t size;
+	};
+
+	OverlayCache(const std::string &filename);
+
+	bool init(int width, int height, int pixel_size, int nbr_sprites);
+	bool load(int width, int height, int pixel_size);
+
+	bool write(const Sprite &sprite, Entry &entry);
+
+	// Sprite is in roi and its runs fill each row within its data
+	bool check(const Entry &entry, const OIIO::ROI &roi) const;
+	void blend(OIIO::ImageBuf &buf, const Entry &entry) const;
+
+	std::string filename_;
+
+	int pixel_size_;
+	int nbr_sprites_;
+	int64_t nbr_frames_;
+
+	// Writer
+	FILE *file_;
+	int64_t pos_;
+	Entry base_;
+	std::vector<Entry> index_;
+	std::vector<Sprite> previous_;
+
+	// Reader
+	int fd_;
+	uint8_t *data_;
+	int64_t size_;
+};
+
+#endif
+
@@ -0,0 +1,370 @@
+#include <iostream>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <math.h>
+
+extern "C" {
+#include <event2/event.h>
+}
+
+#include "log.h"
+#include "macros.h"
+#include "utils.h"
+#include "gpx.h"
+#include "map.h"
+#include "projection.h"
+#include "prefetch.h"
+
+
+Prefetch::Prefetch(GPX2Video &app, Cache *cache)
+	: Task(app)
+	, app_(app)
+	, cache_(cache)
+	, source_(app.settings().mapsource())
+	, nbr_running_(0)
+	, nbr_hits_(0)
+	, nbr_misses_(0)
+	, nbr_downloads_(0)
+	, nbr_notmodified_(0)
+	, nbr_failures_(0)
+	, nbr_bytes_(0) {
+	log_call();
+
+	max_running_ = MapSettings::getMaxConnections(source_);
+
+	evcurl_ = EVCurl::init(app.evbase());
+
+	evcurl_->setOption(CURLMOPT_MAXCONNECTS, (long) max_running_);
+	evcurl_->setOption(CURLMOPT_MAX_HOST_CONNECTIONS, (long) max_running_);
+
+	ev_timer_ = event_new(app.evbase(), -1, EV_PERSIST, timeout, this);
+}
+
+
+Prefetch::~Prefetch() {
+	log_call();
+
+	for (Tile *tile : tiles_)
+		delete tile;
+
+	event_free(ev_timer_);
+
+	delete evcurl_;
+}
+
+
+Prefetch * Prefetch::create(GPX2Video &app, Cache *cache) {
+	Prefetch *prefetch;
+
+	log_call();
+
+	prefetch = new Prefetch(app, cache);
+
+	prefetch->init();
+
+	return prefetch;
+}
+
+
+void Prefetch::init(void) {
+	DIR *dir;
+	struct dirent *entry;
+	struct stat st;
+
+	std::string path = app_.settings().gpxfile();
+
+	log_call();
+
+	// GPX file or directory of GPX files
+	if ((stat(path.c_str(), &st) == 0) && S_ISDIR(st.st_mode)) {
+		dir = opendir(path.c_str());
+
+		if (dir == NULL) {
+			log_error("Open '%s' directory failure", path.c_str());
+			return;
+		}
+
+		while ((entry = readdir(dir)) != NULL) {
+			size_t len = strlen(entry->d_name);
+
+			if ((len < 4) || strcasecmp(entry->d_name + len - 4, ".gpx"))
+				continue;
+
+			append(path + "/" + entry->d_name);
+		}
+
+		closedir(dir);
+	}
+	else
+		append(path);
+
+	// Dedupe against the existing cache
+	for (const std::tuple<int, int, int> &key : keys_) {
+		Tile *tile = new Tile(*this, std::get<0>(key), std::get<1>(key), std::get<2>(key));
+
+		if (tile->cached()) {
+			nbr_hits_++;
+			delete tile;
+			continue;
+		}
+
+		nbr_misses_++;
+		tiles_.push_back(tile);
+	}
+}
+
+
+bool Prefetch::append(const std::string &filename) {
+	int margin = app_.settings().mapmargin();
+	int zoom_min = app_.settings().mapzoom();
+	int zoom_max = app_.settings().mapzoommax();
+
+	GPXData::point p1, p2;
+
+	log_call();
+
+	GPX *gpx = GPX::open(filename);
+
+	if (gpx == NULL)
+		return false;
+
+	if (!gpx->getBoundingBox(&p1, &p2)) {
+		log_warn("No track point found in '%s'", filename.c_str());
+		delete gpx;
+		return false;
+	}
+
+	delete gpx;
+
+	if (zoom_max < zoom_min)
+		zoom_max = zoom_min;
+
+	zoom_min = MAX(zoom_min, MapSettings::getMinZoom(source_));
+	zoom_max = MIN(zoom_max, MapSettings::getMaxZoom(source_));
+
+	for (int zoom=zoom_min; zoom<=zoom_max; zoom++) {
+		int n = 1 << zoom;
+
+		// Tiles of the bounding box, with margin
+		int x1 = floor(Projection::lon2pixel(zoom, p1.lon) / TILESIZE) - margin;
+		int y1 = floor(Projection::lat2pixel(zoom, p1.lat) / TILESIZE) - margin;
+		int x2 = floor(Projection::lon2pixel(zoom, p2.lon) / TILESIZE) + margin;
+		int y2 = floor(Projection::lat2pixel(zoom, p2.lat) / TILESIZE) + margin;
+
+		x1 = MAX(x1, 0);
+		y1 = MAX(y1, 0);
+		x2 = MIN(x2, n - 1);
+		y2 = MIN(y2, n - 1);
+
+		for (int y=y1; y<=y2; y++) {
+			for (int x=x1; x<=x2; x++)
+				keys_.insert(std::make_tuple(zoom, x, y));
+		}
+	}
+
+	log_info("Prefetch '%s' (%d tiles)", filename.c_str(), (int) keys_.size());
+
+	return true;
+}
+
+
+bool Prefetch::start(void) {
+	struct timeval tv;
+
+	int rate = MapSettings::getRateLimit(source_);
+
+	log_call();
+
+	log_notice("Prefetch %d tiles from %s (%d in cache, %d to download)...",
+		(int) keys_.size(), MapSettings::getFriendlyName(source_).c_str(),
+		nbr_hits_, nbr_misses_);
+
+	// Rate limit, one request per tick
+	tv.tv_sec = 0;
+	tv.tv_usec = 1000000 / MAX(rate, 1);
+
+	event_add(ev_timer_, &tv);
+
+	return true;
+}
+
+
+bool Prefetch::run(void) {
+	log_call();
+
+	next();
+
+	return true;
+}
+
+
+bool Prefetch::stop(void) {
+	log_call();
+
+	event_del(ev_timer_);
+
+	printf("\n");
+
+	log_notice("Prefetch summary:");
+	log_notice("  Tiles     : %d", (int) keys_.size());
+	log_notice("  Hits      : %d", nbr_hits_);
+	log_notice("  Misses    : %d", nbr_misses_);
+	log_notice("  Downloads : %d (%.1f MB)", nbr_downloads_, nbr_bytes_ / (1024.0 * 1024.0));
+	log_notice("  Unchanged : %d", nbr_notmodified_);
+	log_notice("  Failures  : %d", nbr_failures_);
+
+	// Keep cache size bounded
+	if (app_.settings().cachesize() > 0)
+		TileCache::evict(cache_->path(), (uint64_t) app_.settings().cachesize() * 1024 * 1024);
+
+	return true;
+}
+
+
+void Prefetch::next(void) {
+	Tile *tile;
+
+	// Done
+	if (tiles_.empty()) {
+		if (nbr_running_ == 0) {
+			event_del(ev_timer_);
+			complete();
+		}
+
+		return;
+	}
+
+	// Concurrency limit
+	if (nbr_running_ >= max_running_)
+		return;
+
+	tile = tiles_.front();
+	tiles_.pop_front();
+
+	nbr_running_++;
+
+	if (tile->download() == false)
+		downloadComplete(tile, false);
+}
+
+
+void Prefetch::timeout(int sfd, short kind, void *data) {
+	Prefetch *prefetch = (Prefetch *) data;
+
+	(void) sfd;
+	(void) kind;
+
+	prefetch->next();
+}
+
+
+void Prefetch::downloadComplete(Prefetch::Tile *tile, bool success) {
+	Prefetch &prefetch = tile->prefetch();
+
+	prefetch.nbr_running_--;
+
+	if (success && !tile->cache().modified()) {
+		prefetch.nbr_notmodified_++;
+	}
+	else if (success) {
+		prefetch.nbr_downloads_++;
+		prefetch.nbr_bytes_ += tile->cache().size();
+	}
+	else {
+		log_error("\nDownload tile failure: %s", tile->uri().c_str());
+
+		prefetch.nbr_failures_++;
+	}
+
+	printf("\r  Download tile %d / %d (%d failures)",
+		prefetch.nbr_downloads_ + prefetch.nbr_notmodified_ + prefetch.nbr_failures_, prefetch.nbr_misses_, prefetch.nbr_failures_);
+	fflush(stdout);
+
+	delete tile;
+}
+
+
+Prefetch::Tile::Tile(Prefetch &prefetch, int zoom, int x, int y)
+	: prefetch_(prefetch)
+	, zoom_(zoom)
+	, x_(x)
+	, y_(y) {
+	uri_ = Map::buildURI(prefetch_.source_, zoom_, x_, y_);
+	path_ = Map::buildPath(prefetch_.source_, zoom_, x_, y_);
+	filename_ = Map::buildFilename(prefetch_.source_, zoom_, x_, y_);
+
+	cache_ = new TileCache(path_, filename_);
+}
+
+
+Prefetch::Tile::~Tile() {
+	delete cache_;
+}
+
+
+bool Prefetch::Tile::cached(void) {
+	// Stale tiles are revalidated
+	return cache_->fresh();
+}
+
+
+size_t Prefetch::Tile::downloadWrite(char *ptr, size_t size, size_t nmemb, void *userdata) {
+	Prefetch::Tile *tile = (Prefetch::Tile *) userdata;
+
+	if (ptr == NULL)
+		return 0;
+
+	return tile->cache_->write(ptr, size * nmemb);
+}
+
+
+void Prefetch::Tile::downloadComplete(EVCurlTask *evtaskh, CURLcode result, void *userdata) {
+	Prefetch::Tile *tile = (Prefetch::Tile *) userdata;
+
+	long code = 0;
+	bool success;
+
+	log_call();
+
+	evtaskh->getInfo(CURLINFO_RESPONSE_CODE, &code);
+
+	// Tile is saved only if fully downloaded (or not modified)
+	success = tile->cache_->commit(result, code)
+		&& (result == CURLE_OK) && ((code == 200) || (code == 304));
+
+	Prefetch::downloadComplete(tile, success);
+}
+
+
+bool Prefetch::Tile::download(void) {
+	EVCurlTask *evtaskh;
+
+	log_call();
+
+	if (::mkpath(path_, 0700) != 0)
+		return false;
+
+	// Download (conditional request if tile is cached)
+	evtaskh = prefetch_.evcurl()->download(uri_.c_str(), downloadComplete, this);
+
+	evtaskh->setOption(CURLOPT_WRITEFUNCTION, downloadWrite);
+	evtaskh->setOption(CURLOPT_WRITEDATA, this);
+
+	evtaskh->setOption(CURLOPT_FOLLOWLOCATION, 1L);
+
+	evtaskh->setHeader("User-Agent: gpx2video");
+
+	cache_->prepare(evtaskh);
+
+	evtaskh->perform();
+
+	return true;
+}
+
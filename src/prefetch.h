@@ -0,0 +1,113 @@
+#ifndef __GPX2VIDEO__PREFETCH_H__
+#define __GPX2VIDEO__PREFETCH_H__
+
+#include <string>
+#include <cstdio>
+#include <list>
+#include <set>
+#include <tuple>
+
+#include "evcurl.h"
+#include "tilecache.h"
+#include "mapsettings.h"
+#include "cache.h"
+#include "gpx2video.h"
+
+
+class Prefetch : public GPX2Video::Task {
+public:
+	class Tile {
+	public:
+		Tile(Prefetch &prefetch, int zoom, int x, int y);
+		virtual ~Tile();
+
+		Prefetch& prefetch(void) {
+			return prefetch_;
+		}
+		const std::string& uri(void) const {
+			return uri_;
+		}
+		const std::string& path(void) const {
+			return path_;
+		}
+		const std::string& filename(void) const {
+			return filename_;
+		}
+
+		bool cached(void);
+		bool download(void);
+
+		TileCache& cache(void) {
+			return *cache_;
+		}
+
+	protected:
+		static size_t downloadWrite(char *ptr, size_t size, size_t nmemb, void *userdata);
+		static void downloadComplete(EVCurlTask *evtaskh, CURLcode result, void *userdata);
+
+	private:
+		Prefetch &prefetch_;
+		int zoom_;
+		int x_, y_;
+		std::string uri_;
+		std::string path_;
+		std::string filename_;
+		TileCache *cache_;
+	};
+
+	virtual ~Prefetch();
+
+	static Prefetch * create(GPX2Video &app, Cache *cache);
+
+	bool start(void);
+	bool run(void);
+	bool stop(void);
+
+protected:
+	EVCurl *evcurl(void) {
+		return evcurl_;
+	}
+
+	void init(void);
+
+	// Append each tile of a GPX bounding box (with margin)
+	bool append(const std::string &filename);
+
+	// Submit next download (rate limited)
+	void next(void);
+
+	static void timeout(int sfd, short kind, void *data);
+	static void downloadComplete(Tile *tile, bool success);
+
+private:
+	Prefetch(GPX2Video &app, Cache *cache);
+
+	GPX2Video &app_;
+
+	Cache *cache_;
+
+	MapSettings::Source source_;
+
+	EVCurl *evcurl_;
+	struct event *ev_timer_;
+
+	// Union tile set (zoom, x, y)
+	std::set<std::tuple<int, int, int> > keys_;
+
+	// Tiles to download
+	std::list<Tile *> tiles_;
+
+	unsigned int nbr_running_;
+	unsigned int max_running_;
+
+	// Stats
+	unsigned int nbr_hits_;
+	unsigned int nbr_misses_;
+	unsigned int nbr_downloads_;
+	unsigned int nbr_notmodified_;
+	unsigned int nbr_failures_;
+	size_t nbr_bytes_;
+};
+
+#endif
+
@@ -0,0 +1,140 @@
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+
+#include "log.h"
+#include "utils.h"
+#include "profiler.h"
+
+
+thread_local Profiler *Profiler::current_ = NULL;
+
+
+Profiler::Profiler(const std::string &trace_file)
+	: trace_file_(trace_file)
+	, started_at_(Profiler::now())
+	, nbr_frames_(0) {
+}
+
+
+Profiler::~Profiler() {
+}
+
+
+Profiler * Profiler::create(const std::string &trace_file) {
+	Profiler *profiler = new Profiler(trace_file);
+
+	return profiler;
+}
+
+
+int Profiler::stage(const char *name, const std::string *label) {
+	std::string key = (label != NULL) ? std::string(name) + " " + *label : std::string(name);
+
+	auto it = index_.find(key);
+
+	if (it != index_.end())
+		return it->second;
+
+	Stage stage;
+
+	stage.name = key;
+	stage.calls = 0;
+	stage.current = 0;
+
+	// Stage wasn't run by previous frames
+	stage.frames.assign(nbr_frames_, 0);
+
+	stages_.push_back(stage);
+
+	index_[key] = stages_.size() - 1;
+
+	return stages_.size() - 1;
+}
+
+
+void Profiler::append(const char *name, const std::string *label, int64_t start, int64_t end) {
+	static std::atomic<int> threads(0);
+	static thread_local int thread = ++threads;
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	int i = stage(name, label);
+
+	stages_[i].calls++;
+	stages_[i].current += end - start;
+
+	if (!trace_file_.empty())
+		events_.push_back({ i, thread, start - started_at_, end - start });
+}
+
+
+void Profiler::frame(void) {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	for (Stage &stage : stages_) {
+		stage.frames.push_back(stage.current);
+		stage.current = 0;
+	}
+
+	nbr_frames_++;
+}
+
+
+void Profiler::dump(void) {
+	printf("%-32s %8s %10s %9s %9s %9s\n", "Stage", "Calls", "Total (s)", "p50 (ms)", "p95 (ms)", "max (ms)");
+
+	for (Stage &stage : stages_) {
+		int64_t total = 0;
+
+		std::vector<int64_t> frames = stage.frames;
+
+		if (frames.empty())
+			continue;
+
+		for (int64_t value : frames)
+			total += value;
+
+		std::sort(frames.begin(), frames.end());
+
+		printf("%-32s %8ld %10.3f %9.3f %9.3f %9.3f\n",
+			stage.name.c_str(),
+			stage.calls,
+			total / 1000000.0,
+			frames[(frames.size() - 1) * 50 / 100] / 1000.0,
+			frames[(frames.size() - 1) * 95 / 100] / 1000.0,
+			frames.back() / 1000.0);
+	}
+}
+
+
+bool Profiler::write(void) {
+	std::ofstream out;
+
+	if (trace_file_.empty())
+		return true;
+
+	out.open(trace_file_);
+
+	if (!out.is_open()) {
+		log_error("Open '%s' trace file failure", trace_file_.c_str());
+		return false;
+	}
+
+	out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [" << std::endl;
+
+	for (size_t i=0; i<events_.size(); i++) {
+		const Event &event = events_[i];
+
+		out << "{\"name\": \"" << escapeJSON(stages_[event.stage].name) << "\", \"cat\": \"gpx2video\", \"ph\": \"X\""
+			<< ", \"ts\": " << event.start << ", \"dur\": " << event.duration
+			<< ", \"pid\": 1, \"tid\": " << event.thread << "}" << ((i + 1 < events_.size()) ? "," : "") << std::endl;
+	}
+
+	out << "]}" << std::endl;
+
+	return out.good();
+}
+
@@ -0,0 +1,144 @@
+#ifndef __GPX2VIDEO__PROFILER_H__
+#define __GPX2VIDEO__PROFILER_H__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+
+// Per stage timers
+//
+// A stage is timed by PROFILE_SCOPE only while a profiler is attached to the
+// calling thread (a renderer attaches its own profiler while it processes a
+// frame, and to the pool threads rendering its widgets), so batch workers
+// don't share timers. Detached, a scope costs a thread local pointer test.
+//
+// Stage durations are summed by frame, then p50/p95/max are computed on the
+// frame values. Each scope can also be recorded as a Chrome 'trace_event'
+// (see chrome://tracing or https://ui.perfetto.dev).
+class Profiler {
+public:
+	class Attach {
+	public:
+		Attach(Profiler *profiler)
+			: previous_(current_) {
+			current_ = profiler;
+		}
+
+		~Attach() {
+			current_ = previous_;
+		}
+
+	private:
+		Profiler *previous_;
+	};
+
+	class Scope {
+	public:
+		Scope(const char *name)
+			: profiler_(current_) {
+			if (profiler_) {
+				name_ = name;
+				label_ = NULL;
+				start_ = Profiler::now();
+			}
+		}
+
+		// Stage 'name label', label is only read while profiling
+		Scope(const char *name, const std::string &label)
+			: profiler_(current_) {
+			if (profiler_) {
+				name_ = name;
+				label_ = &label;
+				start_ = Profiler::now();
+			}
+		}
+
+		~Scope() {
+			if (profiler_)
+				profiler_->append(name_, label_, start_, Profiler::now());
+		}
+
+	private:
+		Profiler *profiler_;
+
+		const char *name_;
+		const std::string *label_;
+
+		int64_t start_;
+	};
+
+	virtual ~Profiler();
+
+	static Profiler * create(const std::string &trace_file="");
+
+	static Profiler * current(void) {
+		return current_;
+	}
+
+	// Monotonic time in us
+	static int64_t now(void) {
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void append(const char *name, const std::string *label, int64_t start, int64_t end);
+
+	// Close current frame
+	void frame(void);
+
+	// Print per stage p50/p95/max by frame
+	void dump(void);
+
+	// Write Chrome trace file
+	bool write(void);
+
+private:
+	struct Stage {
+		std::string name;
+
+		int64_t calls;
+		int64_t current;
+
+		// Duration by frame (us)
+		std::vector<int64_t> frames;
+	};
+
+	struct Event {
+		int stage;
+		int thread;
+		int64_t start;
+		int64_t duration;
+	};
+
+	static thread_local Profiler *current_;
+
+	std::string trace_file_;
+
+	int64_t started_at_;
+	int64_t nbr_frames_;
+
+	std::vector<Stage> stages_;
+	std::map<std::string, int> index_;
+
+	std::vector<Event> events_;
+
+	// Stages can be timed by several threads
+	std::mutex mutex_;
+
+	Profiler(const std::string &trace_file);
+
+	int stage(const char *name, const std::string *label);
+};
+
+
+#define PROFILE_CONCAT_(a, b) a ## b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#define PROFILE_SCOPE(...) Profiler::Scope PROFILE_CONCAT(profile_scope_, __LINE__)(__VA_ARGS__)
+
+#endif
+
@@ -0,0 +1,36 @@
+#include <math.h>
+
+#include "projection.h"
+
+
+double Projection::lon2x(double lon) {
+	// x = (lon + 180) / 360
+	return (lon + 180.0) / 360.0;
+}
+
+
+double Projection::lat2y(double lat) {
+	double latrad = lat * M_PI / 180.0;
+
+	// the formula is some more notes
+	// http://manialabs.wordpress.com/2013/01/26/converting-latitude-and-longitude-to-map-tile-in-mercator-projection/
+	//
+	// y = 1/2 - atanh(sin(lat)) / 2PI
+	return 0.5 - atanh(sin(latrad)) / (2 * M_PI);
+}
+
+
+double Projection::size(int zoom) {
+	return (double) TILESIZE * (double) (1 << zoom);
+}
+
+
+double Projection::lon2pixel(int zoom, double lon) {
+	return lon2x(lon) * size(zoom);
+}
+
+
+double Projection::lat2pixel(int zoom, double lat) {
+	return lat2y(lat) * size(zoom);
+}
+
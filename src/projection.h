@@ -0,0 +1,24 @@
+#ifndef __GPX2VIDEO__PROJECTION_H__
+#define __GPX2VIDEO__PROJECTION_H__
+
+
+#define TILESIZE 256
+
+
+// Web Mercator projection (double precision, no integer truncation)
+class Projection {
+public:
+	// Normalized coordinates (0.0 .. 1.0)
+	static double lon2x(double lon);
+	static double lat2y(double lat);
+
+	// World size in pixels at zoom level
+	static double size(int zoom);
+
+	// World pixel coordinates at zoom level
+	static double lon2pixel(int zoom, double lon);
+	static double lat2pixel(int zoom, double lat);
+};
+
+#endif
+
@@ -1,18 +1,27 @@
 #include <iostream>
+#include <sstream>
+#include <iomanip>
 #include <memory>
+#include <chrono>
+
+#include <unistd.h>
 
 #include <OpenImageIO/imageio.h>
 #include <OpenImageIO/imagebuf.h>
 #include <OpenImageIO/imagebufalgo.h>
+#include <OpenImageIO/parallel.h>
 
 #include "layoutlib/Parser.h"
 #include "layoutlib/ReportCerr.h"
 
+#include "utils.h"
 #include "oiioutils.h"
+#include "ffmpegutils.h"
 #include "decoder.h"
 #include "audioparams.h"
 #include "videoparams.h"
 #include "encoder.h"
+#include "timesync.h"
 #include "widgets/gpx.h"
 #include "widgets/date.h"
 #include "widgets/distance.h"
@@ -30,10 +39,54 @@
 #include "renderer.h"
 
 
-Renderer::Renderer(GPX2Video &app)
+// Alpha capable codecs (overlay only output)
+static const struct {
+	const char *name;
+	AVCodecID codec_id;
+	AVPixelFormat pix_fmt;
+} overlay_codecs[] = {
+	{ "prores", AV_CODEC_ID_PRORES, AV_PIX_FMT_YUVA444P10LE },	// ProRes 4444
+	{ "qtrle",  AV_CODEC_ID_QTRLE,  AV_PIX_FMT_ARGB },			// Run length encoded
+	{ "ffv1",   AV_CODEC_ID_FFV1,   AV_PIX_FMT_BGRA },
+	{ "png",    AV_CODEC_ID_PNG,    AV_PIX_FMT_RGBA },			// Image sequence
+	{ NULL,     AV_CODEC_ID_NONE,   AV_PIX_FMT_NONE }
+};
+
+
+static int getOverlayCodec(const std::string &name, const std::string &filename) {
+	int i;
+
+	std::string codec = name;
+
+	// Default codec from output file extension
+	if (codec.empty()) {
+		std::string extension = filename.substr(filename.find_last_of(".") + 1);
+
+		if (extension == "mkv")
+			codec = "ffv1";
+		else if (extension == "png")
+			codec = "png";
+		else
+			codec = "prores";
+	}
+
+	for (i=0; overlay_codecs[i].name != NULL; i++) {
+		if (codec == overlay_codecs[i].name)
+			return i;
+	}
+
+	log_warn("Overlay codec '%s' unknown, use '%s'", codec.c_str(), overlay_codecs[0].name);
+
+	return 0;
+}
+
+
+Renderer::Renderer(GPX2Video &app, const GPX2Video::Settings &settings, MediaContainer *container)
 	: Task(app) 
-	, app_(app) {
-	container_ = NULL;
+	, app_(app)
+	, settings_(settings) {
+	gpx_ = NULL;
+	container_ = container;
 	decoder_audio_ = NULL;
 	decoder_video_ = NULL;
 	encoder_ = NULL;
@@ -42,24 +95,75 @@ Renderer::Renderer(GPX2Video &app)
 
 	frame_time_ = 0;
 	duration_ms_ = 0;
+	start_pts_ = 0;
+
+	width_ = 0;
+	height_ = 0;
+	scale_x_ = 1.0;
+	scale_y_ = 1.0;
+
+	overlay_only_ = false;
+	snapshot_ = false;
+	dedup_ = false;
+	skipped_ = false;
+	last_time_ = av_make_q(0, 1);
+
+	profiler_ = NULL;
+	cache_ = NULL;
+
+	timecode_ = 0;
+	timecode_ms_ = 0;
+
+	started_ms_ = 0;
+	display_at_ = 0;
+	report_at_ = 0;
+	report_frame_ = 0;
+
+	time_ = 0;
+	progress_ = true;
+	timesync_ = true;
 }
 
 
 Renderer::~Renderer() {
+	for (VideoWidget *widget : widgets_)
+		delete widget;
+
+	if (gpx_)
+		delete gpx_;
 	if (encoder_)
 		delete encoder_;
 	if (decoder_audio_)
 		delete decoder_audio_;
 	if (decoder_video_)
 		delete decoder_video_;
+	if (profiler_)
+		delete profiler_;
+	if (cache_)
+		delete cache_;
 }
 
 
 Renderer * Renderer::create(GPX2Video &app) {
-	Renderer *renderer = new Renderer(app);
+	Renderer *renderer;
+
+	layout::Layout *layout = Renderer::parse(app.settings().layoutfile());
+
+	renderer = Renderer::create(app, app.settings(), app.media(), layout);
+
+	// Layout is copied to widgets settings
+	if (layout)
+		delete layout;
+
+	return renderer;
+}
+
+
+Renderer * Renderer::create(GPX2Video &app, const GPX2Video::Settings &settings, MediaContainer *container, layout::Layout *layout) {
+	Renderer *renderer = new Renderer(app, settings, container);
 
 	renderer->init();
-	renderer->load();
+	renderer->load(layout);
 	renderer->computeWidgetsPosition();
 
 	return renderer;
@@ -67,20 +171,19 @@ Renderer * Renderer::create(GPX2Video &app) {
 
 
 void Renderer::init(void) {
+	int output_width, output_height;
+
 	time_t start_time;
 
 	log_call();
 
-	gpx_ = GPX::open(app_.settings().gpxfile(), app_.settings().telemetryFilter());
-
-	// Media
-	container_ = app_.media();
+	gpx_ = GPX::open(settings().gpxfile(), settings().telemetryFilter());
 
 	// Set start time in GPX stream
-	start_time = container_->startTime() + container_->timeOffset();
+	start_time = container_->startTime();
 	if (gpx_) {
 		gpx_->setStartTime(start_time);
-		gpx_->setTimeOffset(app_.settings().offset());
+		gpx_->setTimeOffset(settings().offset() + container_->timeOffset());
 		gpx_->retrieveFirst(data_);
 	}
 
@@ -88,24 +191,95 @@ void Renderer::init(void) {
 	VideoStreamPtr video_stream = container_->getVideoStream();
 	AudioStreamPtr audio_stream = container_->getAudioStream();
 
+	// Output size (--output-size, preview: scaled down, even size for the encoder)
+	output_width = video_stream->width();
+	output_height = video_stream->height();
+
+	if (settings().outputWidth() > 0) {
+		output_width = settings().outputWidth() & ~1;
+		output_height = (settings().outputHeight() > 0) ? settings().outputHeight() & ~1
+			: ((int64_t) video_stream->height() * output_width / video_stream->width()) & ~1;
+
+		log_notice("Output size %dx%d", output_width, output_height);
+	}
+
+	if ((settings().previewWidth() > 0) && (settings().previewWidth() < output_width)) {
+		output_height = ((int64_t) output_height * settings().previewWidth() / output_width) & ~1;
+		output_width = settings().previewWidth() & ~1;
+
+		log_notice("Preview %dx%d at %d fps", output_width, output_height, settings().previewRate());
+	}
+
+	// Rendering size: scaled down by the decoder, so that overlay is drawn at
+	// output size. Scaled up by the encoder color conversion, overlay is drawn
+	// at media size (no decode or blend of upscaled frames). Overlay only &
+	// snapshot are always drawn at output size.
+	width_ = output_width;
+	height_ = output_height;
+
+	if ((output_width > video_stream->width()) || (output_height > video_stream->height())) {
+		if ((app_.command() == GPX2Video::CommandVideo) || (app_.command() == GPX2Video::CommandBatch)) {
+			width_ = video_stream->width();
+			height_ = video_stream->height();
+		}
+	}
+
+	scale_x_ = (double) width_ / video_stream->width();
+	scale_y_ = (double) height_ / video_stream->height();
+
+	// Output codec (overlay only: alpha capable codec, RGBA frames)
+	AVCodecID codec_id = AV_CODEC_ID_H264;
+	AVPixelFormat pix_fmt = video_stream->pixelFormat();
+	VideoParams::Format format = video_stream->format();
+	int nb_channels = video_stream->nbChannels();
+	VideoParams::Interlacing interlacing = video_stream->interlacing();
+
+	overlay_only_ = (app_.command() == GPX2Video::CommandOverlay);
+	snapshot_ = (app_.command() == GPX2Video::CommandSnapshot);
+
+	if (overlay_only_) {
+		int i = getOverlayCodec(settings().overlayCodec(), settings().outputfile());
+
+		codec_id = overlay_codecs[i].codec_id;
+		pix_fmt = overlay_codecs[i].pix_fmt;
+		format = (FFmpegUtils::getCompatiblePixelFormat(pix_fmt) == AV_PIX_FMT_RGBA64) 
+			? VideoParams::FormatUnsigned16 : VideoParams::FormatUnsigned8;
+		nb_channels = VideoParams::RGBAChannelCount;
+		interlacing = VideoParams::InterlaceNone;
+
+		// Each image of a sequence is a frame
+		dedup_ = (codec_id != AV_CODEC_ID_PNG);
+
+		log_notice("Overlay only, %s codec", overlay_codecs[i].name);
+	}
+
 	// Audio & Video encoder settings
-	VideoParams video_params(video_stream->width(), video_stream->height(),
+	VideoParams video_params(output_width, output_height,
 		// av_make_q(1,  50), 
-		av_inv_q(video_stream->frameRate()),
-		video_stream->format(),
-		video_stream->nbChannels(),
+		(settings().previewWidth() > 0) ? av_make_q(1, settings().previewRate()) : av_inv_q(video_stream->frameRate()),
+		format,
+		nb_channels,
 		video_stream->pixelAspectRatio(),
-		video_stream->interlacing());
-	video_params.setPixelFormat(video_stream->pixelFormat());
+		interlacing);
+	video_params.setPixelFormat(pix_fmt);
 
 	EncoderSettings settings;
-	settings.setFilename(app_.settings().outputfile());
-	settings.setVideoParams(video_params, AV_CODEC_ID_H264);
-	settings.setVideoBitrate(4 * 1000 * 1000 * 8);
-	settings.setVideoMaxBitrate(2 * 1000 * 1000 * 16);
-	settings.setVideoBufferSize(4 * 1000 * 1000 / 2);
+	settings.setFilename(this->settings().outputfile());
+	settings.setVideoParams(video_params, codec_id);
+	settings.setFrameSize(width_, height_);
+	settings.setWriteBuffer((size_t) this->settings().writeBuffer() * 1024 * 1024);
+
+	if (!overlay_only_) {
+		settings.setVideoBitrate(4 * 1000 * 1000 * 8);
+		settings.setVideoMaxBitrate(2 * 1000 * 1000 * 16);
+		settings.setVideoBufferSize(4 * 1000 * 1000 / 2);
+
+		if (this->settings().previewWidth() > 0)
+			settings.setVideoPreset("ultrafast");
+	}
 
-	if (audio_stream) {
+	// Preview: frames are dropped, audio would be out of sync (no audio)
+	if (audio_stream && !overlay_only_ && !snapshot_ && (this->settings().previewWidth() <= 0)) {
 		AudioParams audio_params(audio_stream->sampleRate(),
 			audio_stream->channelLayout(),
 			audio_stream->format());
@@ -116,40 +290,40 @@ void Renderer::init(void) {
 
 	// Compute duration
 	duration_ms_ = video_stream->duration() * av_q2d(video_stream->timeBase()) * 1000;
-	duration_ms_ = MAX(duration_ms_, app_.settings().maxDuration());
+	duration_ms_ = MAX(duration_ms_, this->settings().maxDuration());
 
 	snprintf(duration_, sizeof(duration_), "%02d:%02d:%02d.%03d", 
 		(unsigned int) (duration_ms_ / 3600000), (unsigned int) ((duration_ms_ / 60000) % 60), (unsigned int) ((duration_ms_ / 1000) % 60), (unsigned int) (duration_ms_ % 1000));
 	duration_[sizeof(duration_) - 1] = '\0';
 
-	// Open & decode input media
-	decoder_video_ = Decoder::create();
-	decoder_video_->open(video_stream);
+	// Input media & output video (opened at start)
+	if (!overlay_only_) {
+		decoder_video_ = Decoder::create();
 
-	if (audio_stream) {
-		decoder_audio_ = Decoder::create();
-		decoder_audio_->open(audio_stream);
+		// Scaled down in the decoder (output size, preview)
+		decoder_video_->setSize(width_, height_);
+
+		// Preview: frames dropped to preview rate
+		if (this->settings().previewWidth() > 0) {
+			decoder_video_->setFrameRate(av_make_q(this->settings().previewRate(), 1));
+			decoder_video_->setFast(true);
+		}
+
+		if (settings.isAudioEnabled())
+			decoder_audio_ = Decoder::create();
 	}
 
-	// Open & encode output video
 	encoder_ = Encoder::create(settings);
-	encoder_->open();
 }
 
 
-bool Renderer::load(void) {
+layout::Layout * Renderer::parse(const std::string &filename) {
 	std::ifstream stream;
 
-	layout::Layout *root;
+	layout::Layout *root = NULL;
 //	layout::ReportCerr report;
 	layout::Parser parser(NULL); //&report);
 
-	std::list<layout::Map *> maps;
-	std::list<layout::Track *> tracks;
-	std::list<layout::Widget *> widgets;
-
-	std::string filename = app_.settings().layoutfile();
-
 	if (filename.empty()) {
 		log_warn("None layout file");
 		goto done;
@@ -159,7 +333,7 @@ bool Renderer::load(void) {
 
 	if (!stream.is_open()) {
 		log_error("Open '%s' layout file failure, please check that file is readable", filename.c_str());
-		goto failure;
+		goto done;
 	}
 
 	root = parser.parse(stream);
@@ -168,11 +342,24 @@ bool Renderer::load(void) {
 		log_error("Parsing of '%s' failed due to %s on line %d and column %d", 
 			filename.c_str(), parser.errorText().c_str(),
 			parser.errorLineNumber(), parser.errorColumnNumber());
-		goto failure;
+		goto done;
 	}
 
 	std::cout << "Parsing '" << filename << "' layout file" << std::endl;
 
+done:
+	return root;
+}
+
+
+bool Renderer::load(layout::Layout *root) {
+	std::list<layout::Map *> maps;
+	std::list<layout::Track *> tracks;
+	std::list<layout::Widget *> widgets;
+
+	if (root == NULL)
+		goto failure;
+
 	// Widgets
 	widgets = root->widgets().list();
 
@@ -227,7 +414,6 @@ bool Renderer::load(void) {
 		loadMap(map);
 	}
 
-done:
 	return true;
 
 failure:
@@ -259,32 +445,29 @@ bool Renderer::loadMap(layout::Map *m) {
 	}
 
 	// Open GPX file
-	GPX *gpx = GPX::open(app_.settings().gpxfile());
+	GPX *gpx = GPX::open(settings().gpxfile());
 
 	if (gpx == NULL) {
 		log_warn("Can't read GPS data, skip map widget");
 		return false;
 	}
 
-	// Media
-	MediaContainer *container = app_.media();
-
-	VideoStreamPtr video_stream = container->getVideoStream();
-
 	// Default size
 	//   2704x1520 => 800x500
 	//   1920x1080 => 560x350
-	width = (m->width() > 0) ? m->width() : 800 * video_stream->width() / 2704;
-	height = (m->height() > 0) ? m->height() : 500 * video_stream->height() / 1520;
+	width = (m->width() > 0) ? scaleX(m->width()) : 800 * width_ / 2704;
+	height = (m->height() > 0) ? scaleY(m->height()) : 500 * height_ / 1520;
 
 	// Default position
-	x = (m->x() > 0) ? m->x() : video_stream->width() - width - m->margin();
-	y = (m->y() > 0) ? m->y() : video_stream->height() - height - m->margin();
+	x = (m->x() > 0) ? scaleX(m->x()) : width_ - width - scale(m->margin());
+	y = (m->y() > 0) ? scaleY(m->y()) : height_ - height - scale(m->margin());
 
 	// Create map bounding box
 	GPXData::point p1, p2;
 	gpx->getBoundingBox(&p1, &p2);
 
+	delete gpx;
+
 	// Alignment
 	s = (const char *) m->align();
 
@@ -309,8 +492,8 @@ bool Renderer::loadMap(layout::Map *m) {
 	map->setAlign(align);
 	map->setPosition(x, y);
 	map->setSize(mapSettings.width(), mapSettings.height());
-	map->setMargin(m->margin());
-	map->setBorder(m->border());
+	map->setMargin(scale(m->margin()));
+	map->setBorder(scale(m->border()));
 	map->setBorderColor((const char *) m->borderColor());
 
 	// Append
@@ -336,32 +519,29 @@ bool Renderer::loadTrack(layout::Track *t) {
 	log_call();
 
 	// Open GPX file
-	GPX *gpx = GPX::open(app_.settings().gpxfile());
+	GPX *gpx = GPX::open(settings().gpxfile());
 
 	if (gpx == NULL) {
 		log_warn("Can't read GPS data, skip map widget");
 		return false;
 	}
 
-	// Media
-	MediaContainer *container = app_.media();
-
-	VideoStreamPtr video_stream = container->getVideoStream();
-
 	// Default size
 	//   2704x1520 => 800x500
 	//   1920x1080 => 560x350
-	width = (t->width() > 0) ? t->width() : 800 * video_stream->width() / 2704;
-	height = (t->height() > 0) ? t->height() : 500 * video_stream->height() / 1520;
+	width = (t->width() > 0) ? scaleX(t->width()) : 800 * width_ / 2704;
+	height = (t->height() > 0) ? scaleY(t->height()) : 500 * height_ / 1520;
 
 	// Default position
-	x = (t->x() > 0) ? t->x() : video_stream->width() - width - t->margin();
-	y = (t->y() > 0) ? t->y() : video_stream->height() - height - t->margin();
+	x = (t->x() > 0) ? scaleX(t->x()) : width_ - width - scale(t->margin());
+	y = (t->y() > 0) ? scaleY(t->y()) : height_ - height - scale(t->margin());
 
 	// Create map bounding box
 	GPXData::point p1, p2;
 	gpx->getBoundingBox(&p1, &p2);
 
+	delete gpx;
+
 	// Alignment
 	s = (const char *) t->align();
 
@@ -381,8 +561,8 @@ bool Renderer::loadTrack(layout::Track *t) {
 	track->setAlign(align);
 	track->setPosition(x, y);
 	track->setSize(trackSettings.width(), trackSettings.height());
-	track->setMargin(t->margin());
-	track->setBorder(t->border());
+	track->setMargin(scale(t->margin()));
+	track->setBorder(scale(t->border()));
 	track->setBorderColor((const char *) t->borderColor());
 	track->setBackgroundColor((const char *) t->backgroundColor());
 
@@ -464,15 +644,15 @@ bool Renderer::loadWidget(layout::Widget *w) {
 
 	// Widget settings
 	widget->setAlign(align);
-	widget->setPosition(w->x(), w->y());
+	widget->setPosition(scaleX(w->x()), scaleY(w->y()));
 	widget->setFormat((const char *) w->format());
-	widget->setSize(w->width(), w->height());
-	widget->setMargin(w->margin());
-	widget->setPadding(w->padding());
+	widget->setSize(scaleX(w->width()), scaleY(w->height()));
+	widget->setMargin(scale(w->margin()));
+	widget->setPadding(scale(w->padding()));
 	widget->setLabel((const char *) w->name());
 	widget->setTextColor((const char *) w->textColor());
-	widget->setTextShadow(w->textShadow());
-	widget->setBorder(w->border());
+	widget->setTextShadow(scale(w->textShadow()));
+	widget->setBorder(scale(w->border()));
 	widget->setBorderColor((const char *) w->borderColor());
 	widget->setBackgroundColor((const char *) w->backgroundColor());
 	if (unit != VideoWidget::UnitNone)
@@ -510,8 +690,6 @@ void Renderer::computeWidgetsPosition(void) {
 	int margintop, marginbottom;
 	int marginleft, marginright;
 
-	VideoStreamPtr video_stream = container_->getVideoStream();
-
 	// TopLeft, TopRight, BottomLeft, BottomRight
 	//-----------------------------------------------------------
 
@@ -524,18 +702,18 @@ void Renderer::computeWidgetsPosition(void) {
 			break;
 
 		case VideoWidget::AlignTopRight:
-			x = video_stream->width() - widget->margin() - widget->width();
+			x = width_ - widget->margin() - widget->width();
 			y = widget->margin();
 			break;
 
 		case VideoWidget::AlignBottomLeft:
 			x = widget->margin();
-			y = video_stream->height() - widget->margin() - widget->height();
+			y = height_ - widget->margin() - widget->height();
 			break;
 
 		case VideoWidget::AlignBottomRight:
-			x = video_stream->width() - widget->margin() - widget->width();
-			y = video_stream->height() - widget->margin() - widget->height();
+			x = width_ - widget->margin() - widget->width();
+			y = height_ - widget->margin() - widget->height();
 			break;
 
 		default:
@@ -573,7 +751,7 @@ void Renderer::computeWidgetsPosition(void) {
 	}
 
 	// Compute position for each widget
-	space = video_stream->height() - (height + margintop + marginbottom);
+	space = height_ - (height + margintop + marginbottom);
 	space = MAX(0, space);
 
 	// Set position (for 'left' align)
@@ -618,7 +796,7 @@ void Renderer::computeWidgetsPosition(void) {
 	}
 
 	// Compute position for each widget
-	space = video_stream->height() - (height + margintop + marginbottom);
+	space = height_ - (height + margintop + marginbottom);
 	space = MAX(0, space);
 
 	// Set position (for 'right' align)
@@ -627,7 +805,7 @@ void Renderer::computeWidgetsPosition(void) {
 		if (widget->align() != VideoWidget::AlignRight)
 			continue;
 
-		x = video_stream->width() - widget->margin() - widget->width();
+		x = width_ - widget->margin() - widget->width();
 		y = margintop + offset + widget->margin();
 
 		widget->setPosition(x, y);
@@ -663,7 +841,7 @@ void Renderer::computeWidgetsPosition(void) {
 	}
 
 	// Compute position for each widget
-	space = video_stream->width() - (width + marginleft + marginright);
+	space = width_ - (width + marginleft + marginright);
 	space = MAX(0, space);
 
 	// Set position (for 'top' align)
@@ -708,7 +886,7 @@ void Renderer::computeWidgetsPosition(void) {
 	}
 
 	// Compute position for each widget
-	space = video_stream->width() - (width + marginleft + marginright);
+	space = width_ - (width + marginleft + marginright);
 	space = MAX(0, space);
 
 	// Set position (for 'bottom' align)
@@ -718,7 +896,7 @@ void Renderer::computeWidgetsPosition(void) {
 			continue;
 
 		x = marginleft + offset + widget->margin();
-		y = video_stream->height() - widget->margin() - widget->height();
+		y = height_ - widget->margin() - widget->height();
 
 		widget->setPosition(x, y);
 
@@ -732,34 +910,106 @@ bool Renderer::start(void) {
 
 	time_t start_time;
 
+	TimeSync *timesync;
+
 	VideoStreamPtr video_stream = container_->getVideoStream();
 
 	log_call();
 
+	// Synchronize camera clock with GPS time
+	if (timesync_) {
+		timesync = TimeSync::create(app_, container_);
+		timesync->sync();
+		delete timesync;
+	}
+
+	// Open & decode input media (overlay only: media isn't decoded)
+	if (decoder_video_)
+		decoder_video_->open(container_->getVideoStream());
+
+	if (decoder_audio_)
+		decoder_audio_->open(container_->getAudioStream());
+
+	// Seek to the keyframe before start, decoders drop frames up to start
+	// (snapshot: always, media may have been read by time sync)
+	if ((settings().start() > 0) || snapshot_) {
+		AVRational start = av_make_q(settings().start(), 1000);
+
+		start_pts_ = video_stream->getTimeInTimeBaseUnits(start);
+
+		// Overlay only: frames are created from start, nothing to seek
+		if (!overlay_only_) {
+			if (container_->demuxer()->seek(video_stream->index(), start_pts_)) {
+				decoder_video_->seek(start);
+
+				if (decoder_audio_)
+					decoder_audio_->seek(start);
+			}
+			else
+				start_pts_ = 0;
+		}
+	}
+
+	// Open & encode output video (snapshot: image is written at first frame)
+	if (!snapshot_)
+		encoder_->open();
+
 	log_notice("Rendering...");
 
 	// Compute start time
-	start_time = container_->startTime() + container_->timeOffset();
+	start_time = container_->startTime();
 
-	// Update start time in GPX stream (start_time can change after sync step)
-	if (gpx_)
+	// Update time offset in GPX stream (offset can change after sync step)
+	if (gpx_) {
 		gpx_->setStartTime(start_time);
+		gpx_->setTimeOffset(settings().offset() + container_->timeOffset());
+
+		if (start_pts_ > 0)
+			gpx_->seek(data_, settings().start());
+		else
+			gpx_->retrieveFirst(data_);
+	}
 
 	started_at_ = now;
 
+	started_ms_ = Renderer::now();
+	report_at_ = started_ms_;
+
+	if (settings().profile())
+		profiler_ = Profiler::create(settings().traceFile());
+
 	// Create overlay buffer
-	overlay_ = new OIIO::ImageBuf(OIIO::ImageSpec(video_stream->width(), video_stream->height(), 
-		video_stream->nbChannels(), OIIOUtils::getOIIOBaseTypeFromFormat(video_stream->format())));
+	overlay_ = new OIIO::ImageBuf(OIIO::ImageSpec(width_, height_, 
+		encoder_->settings().videoParams().nbChannels(), 
+		OIIOUtils::getOIIOBaseTypeFromFormat(encoder_->settings().videoParams().format())));
 
-	// Prepare each widget, map...
-	for (VideoWidget *widget : widgets_)
+	// Prepare each widget, map... & its tile
+	for (VideoWidget *widget : widgets_) {
 		widget->prepare(overlay_);
+		widget->createTile(overlay_->spec().format);
+	}
+
+	// Render overlay sequence ahead, video pass only blends
+	if (gpx_ && settings().overlayCache() && !snapshot_)
+		cache_ = loadCache();
 
 	return true;
 }
 
 
 bool Renderer::run(void) {
+	if (process())
+		schedule();
+	else
+		complete();
+
+	return true;
+}
+
+
+bool Renderer::process(void) {
+	Profiler::Attach attach(profiler_);
+
 	FramePtr frame;
 
 	time_t start_time;
@@ -772,7 +1022,7 @@ bool Renderer::run(void) {
 	VideoStreamPtr video_stream = container_->getVideoStream();
 //	AudioStreamPtr audio_stream = container_->getAudioStream();
 
-	start_time = container_->startTime() + container_->timeOffset();
+	start_time = container_->startTime();
 
 	real_time = av_mul_q(av_make_q(frame_time_, 1), encoder_->settings().videoParams().timeBase());
 
@@ -784,8 +1034,11 @@ bool Renderer::run(void) {
 			encoder_->writeAudio(frame, real_time);
 	}
 
-	// Read video data
-	frame = decoder_video_->retrieveVideo(real_time);
+	// Read video data (overlay only: transparent frame)
+	if (overlay_only_)
+		frame = createFrame(real_time);
+	else
+		frame = decoder_video_->retrieveVideo(real_time);
 
 	if (frame == NULL)
 		goto done;
@@ -794,23 +1047,35 @@ bool Renderer::run(void) {
 	timecode_ms = timecode * av_q2d(video_stream->timeBase()) * 1000;
 
 	// Compute video time
-	app_.setTime(start_time + (timecode_ms / 1000));
+	time_ = start_time + ((container_->timeOffset() + timecode_ms) / 1000);
 
 	if (gpx_) {
 		// Read GPX data
 //		data_ = gpx_->retrieveData(timecode_ms);
 		gpx_->retrieveNext(data_, timecode_ms);
 
-		// Draw
-		this->draw(frame, data_);
+		// Draw (cached overlay if any)
+		if (!cache_ || !this->blend(frame, timecode))
+			this->draw(frame, data_);
 	}
 
-	// Max rendering duration
-	if (app_.settings().maxDuration() > 0) {
-		if (timecode_ms > app_.settings().maxDuration())
+	// Snapshot: a single frame is rendered
+	if (snapshot_) {
+		if (writeSnapshot(frame))
+			frame_time_++;
+
+		goto done;
+	}
+
+	// Max rendering duration (from start)
+	if (settings().maxDuration() > 0) {
+		if (timecode_ms - settings().start() > settings().maxDuration())
 			goto done;
 	}
 
+	timecode_ = timecode;
+	timecode_ms_ = timecode_ms;
+
 	// Dump frame info
 	{
 		char s[128];
@@ -818,7 +1083,9 @@ bool Renderer::run(void) {
 
 		time_t now = ::time(NULL);
 
-		localtime_r(&app_.time(), &time);
+		int64_t now_ms = Renderer::now();
+
+		localtime_r(&time_, &time);
 
 		strftime(s, sizeof(s), "%Y-%m-%d %H:%M:%S", &time);
 
@@ -826,9 +1093,14 @@ bool Renderer::run(void) {
 			printf("FRAME: %ld - PTS: %ld - TIMESTAMP: %ld ms - TIME: %s\n", 
 				frame_time_, timecode, timecode_ms, s);
 		}
-		else {
-			int percent = 100 * timecode_ms / duration_ms_;
-			int remaining = (timecode_ms > 0) ? (now - started_at_) * (duration_ms_ - timecode_ms) / timecode_ms : -1;
+		else if (progress_ && (now_ms - display_at_ >= 250)) {
+			// A few updates by second
+			int64_t elapsed_ms = timecode_ms - settings().start();
+
+			display_at_ = now_ms;
+
+			int percent = 100 * elapsed_ms / MAX(1, (int64_t) duration_ms_ - settings().start());
+			int remaining = (elapsed_ms > 0) ? (now - started_at_) * (duration_ms_ - timecode_ms) / elapsed_ms : -1;
 
 			printf("\r[FRAME %5ld] %02d:%02d:%02d.%03d / %s | %3d%% - Remaining time: %02d:%02d:%02d", 
 				frame_time_, 
@@ -839,35 +1111,51 @@ bool Renderer::run(void) {
 				); //label, buf, percent,
 			fflush(stdout);
 		}
+
+		// Machine readable progress
+		if ((settings().progressFd() >= 0) && (now_ms - report_at_ >= settings().progressInterval()))
+			report(false);
 	}
 
 	// Dump GPX data
 	if (gpx_ && app_.progressInfo())
 		data_.dump();
 
-	real_time = av_mul_q(av_make_q(timecode, 1), video_stream->timeBase());
+	// Output video starts at start
+	real_time = av_mul_q(av_make_q(timecode - start_pts_, 1), video_stream->timeBase());
 
-	encoder_->writeFrame(frame, real_time);
+	// Overlay only: an identical frame isn't encoded, previous frame lasts
+	skipped_ = dedup_ && last_frame_
+		&& !memcmp(frame->constData(), last_frame_->constData(), frame->linesizeBytes() * frame->height());
 
-	frame_time_++;
+	if (!skipped_)
+		encoder_->writeFrame(frame, real_time);
 
-	schedule();
+	if (dedup_) {
+		last_frame_ = frame;
+		last_time_ = real_time;
+	}
 
-	return true;
+	if (profiler_)
+		profiler_->frame();
 
-done:
-	complete();
+	frame_time_++;
 
 	return true;
+
+done:
+	return false;
 }
 
 
 bool Renderer::stop(void) {
 	int working;
 
+	Profiler::Attach attach(profiler_);
+
 	time_t now = ::time(NULL);
 
-	if (!app_.progressInfo())
+	if (!app_.progressInfo() && progress_)
 		printf("\n");
 
 	// Retrieve audio & video streams
@@ -882,31 +1170,345 @@ bool Renderer::stop(void) {
 		encoder_->settings().videoParams().width(), encoder_->settings().videoParams().height(),
 		(working / 3600), (working / 60) % 60, (working) % 60);
 
-	encoder_->close();
+	// Last frame ends the output at media duration
+	if (skipped_)
+		encoder_->writeFrame(last_frame_, last_time_);
+
+	last_frame_ = NULL;
+
+	if (!snapshot_)
+		encoder_->close();
+
+	if (settings().progressFd() >= 0)
+		report(true);
+
 	if (decoder_audio_)
 		decoder_audio_->close();
-	decoder_video_->close();
+	if (decoder_video_)
+		decoder_video_->close();
 
 	if (overlay_)
 		delete overlay_;
+	if (cache_)
+		delete cache_;
+
+	// Per stage timings (encoder flush is counted as a last frame)
+	if (profiler_) {
+		profiler_->frame();
+		profiler_->dump();
+		profiler_->write();
+	}
 
 	decoder_audio_ = NULL;
 	decoder_video_ = NULL;
 	overlay_ = NULL;
+	cache_ = NULL;
+
+	return true;
+}
+
+
+FramePtr Renderer::createFrame(AVRational time) {
+	int64_t timecode;
+
+	FramePtr frame;
+
+	VideoStreamPtr video_stream = container_->getVideoStream();
+
+	const VideoParams &params = encoder_->settings().videoParams();
+
+	// Timeline from container metadata only
+	timecode = start_pts_ + video_stream->getTimeInTimeBaseUnits(time);
+
+	if (timecode >= video_stream->duration())
+		goto done;
+
+	frame = Frame::create();
+	frame->setVideoParams(params);
+	frame->setTimestamp(timecode);
+
+	// Transparent canvas
+	frame->setData((uint8_t *) calloc(frame->linesizeBytes() * params.height(), sizeof(uint8_t)));
+
+done:
+	return frame;
+}
+
+
+OverlayCache * Renderer::loadCache(void) {
+	uint64_t key;
+
+	std::string filename;
+	std::ostringstream timeline;
+	std::ostringstream rendering;
+
+	OverlayCache *cache;
+
+	int pixel_size = overlay_->spec().pixel_bytes();
+
+	const AVRational &time_base = encoder_->settings().videoParams().timeBase();
+
+	// Overlay only depends on layout, telemetry & frame timeline
+	timeline << (settings().offset() + container_->timeOffset())
+		<< ":" << container_->startTime()
+		<< ":" << time_base.num << "/" << time_base.den
+		<< ":" << settings().start() << ":" << settings().maxDuration()
+		<< ":" << width_ << "x" << height_ << "x" << pixel_size;
+
+	// Every setting changing widgets output (telemetry filter, map...)
+	rendering << (int) settings().telemetryFilter()
+		<< ":" << (int) settings().mapsource()
+		<< ":" << settings().mapzoom() << ":" << settings().mapzoommax()
+		<< ":" << settings().mapfactor() << ":" << settings().mapmargin()
+		<< ":" << settings().previewWidth() << ":" << settings().previewRate();
+
+	key = OverlayCache::hashFile(settings().layoutfile());
+	key = OverlayCache::hashFile(settings().gpxfile(), key);
+	key = OverlayCache::hash(timeline.str(), key);
+	key = OverlayCache::hash(rendering.str(), key);
+
+	filename = OverlayCache::path(key);
+
+	if ((cache = OverlayCache::open(filename, width_, height_, pixel_size)) != NULL) {
+		log_notice("Overlay cache '%s' (%ld frames)", filename.c_str(), cache->nbrFrames());
+		return cache;
+	}
+
+	if (!buildCache(filename))
+		return NULL;
+
+	return OverlayCache::open(filename, width_, height_, pixel_size);
+}
+
+
+bool Renderer::buildCache(const std::string &filename) {
+	int64_t i;
+	int64_t timecode;
+	int64_t timecode_ms;
+
+	bool success = false;
+
+	OverlayCache *cache;
+	OverlayCache::Sprite base;
+
+	VideoStreamPtr video_stream = container_->getVideoStream();
+
+	const AVRational &time_base = encoder_->settings().videoParams().timeBase();
+
+	std::vector<VideoWidget *> widgets(widgets_.begin(), widgets_.end());
+	std::vector<OverlayCache::Sprite> sprites(widgets.size());
+
+	log_notice("Overlay cache rendering...");
+
+	cache = OverlayCache::create(filename, width_, height_, overlay_->spec().pixel_bytes(), widgets.size());
+
+	if (cache == NULL)
+		return false;
+
+	// Static layer
+	OverlayCache::encode(*overlay_, base);
+
+	if (!cache->setBase(base))
+		goto done;
+
+	// Same timeline as the video pass (see createFrame)
+	for (i=0; ; i++) {
+		timecode = start_pts_ + video_stream->getTimeInTimeBaseUnits(av_mul_q(av_make_q(i, 1), time_base));
+		timecode_ms = timecode * av_q2d(video_stream->timeBase()) * 1000;
+
+		if (timecode >= video_stream->duration())
+			break;
+
+		if ((settings().maxDuration() > 0) && (timecode_ms - settings().start() > settings().maxDuration()))
+			break;
+
+		time_ = container_->startTime() + ((container_->timeOffset() + timecode_ms) / 1000);
+
+		gpx_->retrieveNext(data_, timecode_ms);
+
+		// Widgets are rendered & compressed on the thread pool
+		OIIO::parallel_for(0, (int64_t) widgets.size(), [&](int64_t n) {
+			VideoWidget *widget = widgets[n];
+
+			widget->clearTile();
+			widget->setTime(time_);
+			widget->render(widget->tile(), data_);
+
+			OverlayCache::encode(*widget->tile(), sprites[n]);
+		});
+
+		if (!cache->append(sprites))
+			goto done;
+	}
+
+	success = cache->close();
+
+done:
+	delete cache;
+
+	// Video pass starts from start again
+	if (start_pts_ > 0)
+		gpx_->seek(data_, settings().start());
+	else
+		gpx_->retrieveFirst(data_);
+
+	return success;
+}
+
+
+bool Renderer::writeSnapshot(FramePtr frame) {
+	bool result = false;
+
+	const std::string &filename = settings().outputfile();
+
+	PROFILE_SCOPE("snapshot write");
+
+	OIIO::ImageBuf frame_buffer = frame->toImageBuf();
+	OIIO::ImageBuf rgb_buffer;
+
+	OIIO::ImageBuf *buf = &frame_buffer;
+
+	// Save
+	std::unique_ptr<OIIO::ImageOutput> out = OIIO::ImageOutput::create(filename);
+
+	if (!out) {
+		log_error("Snapshot failure, image format of '%s' unknown", filename.c_str());
+		goto error;
+	}
+
+	// JPEG...: alpha channel is dropped
+	if ((buf->spec().nchannels > 3) && !out->supports("alpha")) {
+		OIIO::ImageBufAlgo::channels(rgb_buffer, frame_buffer, 3, {});
+		buf = &rgb_buffer;
+	}
+
+	if (out->open(filename, buf->spec()) == false) {
+		log_error("Snapshot failure, can't open '%s' file", filename.c_str());
+		goto error;
+	}
+
+	result = out->write_image(buf->spec().format, buf->localpixels());
+
+	out->close();
+
+	if (!result)
+		log_error("Snapshot failure, can't write '%s' file", filename.c_str());
+
+error:
+	return result;
+}
+
+
+bool Renderer::blend(FramePtr frame, int64_t timecode) {
+	int64_t index;
+
+	PROFILE_SCOPE("cache blend");
+
+	VideoStreamPtr video_stream = container_->getVideoStream();
+
+	const AVRational &time_base = encoder_->settings().videoParams().timeBase();
+
+	index = llround((timecode - start_pts_) * av_q2d(video_stream->timeBase()) / av_q2d(time_base));
+
+	if ((index < 0) || (index >= cache_->nbrFrames()))
+		return false;
+
+	OIIO::ImageBuf frame_buffer = frame->toImageBuf();
+
+	if (frame_buffer.spec().pixel_bytes() != overlay_->spec().pixel_bytes())
+		return false;
+
+	if (!cache_->blend(frame_buffer, index))
+		return false;
+
+	frame->fromImageBuf(frame_buffer);
 
 	return true;
 }
 
 
+int64_t Renderer::now(void) {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+void Renderer::report(bool done) {
+	int64_t now = Renderer::now();
+
+	int64_t elapsed_ms = MAX(1, now - started_ms_);
+	int64_t interval_ms = MAX(1, now - report_at_);
+
+	int64_t output_ms = timecode_ms_ - settings().start();
+	int64_t total_ms = MAX(1, (int64_t) duration_ms_ - settings().start());
+
+	std::ostringstream out;
+
+	out << std::fixed << std::setprecision(2)
+		<< "{\"output\": \"" << escapeJSON(settings().outputfile()) << "\""
+		<< ", \"frame\": " << frame_time_
+		<< ", \"pts\": " << timecode_
+		<< ", \"time_ms\": " << timecode_ms_
+		<< ", \"fps\": " << (frame_time_ - report_frame_) * 1000.0 / interval_ms
+		<< ", \"avg_fps\": " << frame_time_ * 1000.0 / elapsed_ms
+		<< ", \"bitrate\": " << ((output_ms > 0) ? encoder_->bytes() * 8000 / output_ms : 0)
+		<< ", \"encoder_queue\": " << encoder_->pendingFrames()
+		<< ", \"writer_queue\": " << encoder_->pendingBytes()
+		<< ", \"rss\": " << rss()
+		<< ", \"percent\": " << (done ? 100 : MIN(100, 100 * MAX(0, output_ms) / total_ms))
+		<< ", \"eta\": " << (done ? 0 : (output_ms > 0) ? (elapsed_ms * (total_ms - output_ms) / output_ms) / 1000 : -1)
+		<< ", \"done\": " << (done ? "true" : "false")
+		<< "}" << std::endl;
+
+	std::string line = out.str();
+
+	// A line by write (atomic on pipes, batch jobs share the fd)
+	if (::write(settings().progressFd(), line.data(), line.size()) < 0)
+		log_warn("Write progress failure");
+
+	report_at_ = now;
+	report_frame_ = frame_time_;
+}
+
+
 void Renderer::draw(FramePtr frame, const GPXData &data) {
+	PROFILE_SCOPE("draw");
+
 	OIIO::ImageBuf frame_buffer = frame->toImageBuf();
 
 	// Draw overlay
-	OIIO::ImageBufAlgo::over(frame_buffer, *overlay_, frame_buffer, OIIO::ROI());
+	{
+		PROFILE_SCOPE("blend");
 
-	// Draw each widget, map...
-	for (VideoWidget *widget : widgets_)
-		widget->render(&frame_buffer, data);
+		Blend::over(frame_buffer, *overlay_);
+	}
+
+	// Render each widget, map... into its own tile, on the thread pool
+	{
+		PROFILE_SCOPE("widgets");
+
+		std::vector<VideoWidget *> widgets(widgets_.begin(), widgets_.end());
+
+		OIIO::parallel_for(0, (int64_t) widgets.size(), [&](int64_t i) {
+			VideoWidget *widget = widgets[i];
+
+			Profiler::Attach attach(profiler_);
+
+			PROFILE_SCOPE("widget", widget->name());
+
+			widget->clearTile();
+			widget->setTime(time_);
+			widget->render(widget->tile(), data);
+		});
+	}
+
+	// Composite tiles in layout order
+	{
+		PROFILE_SCOPE("composite");
+
+		for (VideoWidget *widget : widgets_)
+			Blend::over(frame_buffer, *widget->tile());
+	}
 
 	frame->fromImageBuf(frame_buffer);
 }
@@ -936,7 +1538,7 @@ void Renderer::add(OIIO::ImageBuf *frame, int x, int y, const char *picto, const
 	// Image over
 	dst.specmod().x = x;
 	dst.specmod().y = y;
-	OIIO::ImageBufAlgo::over(*frame, dst, *frame, OIIO::ROI());
+	Blend::over(*frame, dst);
 
 	delete buf;
 
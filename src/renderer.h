@@ -3,11 +3,13 @@
 
 #include <string>
 #include <vector>
+#include <algorithm>
 
 #include <OpenImageIO/imageio.h>
 #include <OpenImageIO/imagebuf.h>
 #include <OpenImageIO/imagebufalgo.h>
 
+#include "layoutlib/Layout.h"
 #include "layoutlib/Map.h"
 #include "layoutlib/Track.h"
 #include "layoutlib/Widget.h"
@@ -20,6 +22,8 @@
 #include "decoder.h"
 #include "encoder.h"
 #include "videowidget.h"
+#include "profiler.h"
+#include "overlaycache.h"
 #include "gpx2video.h"
 
 
@@ -28,6 +32,23 @@ public:
 	virtual ~Renderer();
 
 	static Renderer * create(GPX2Video &app); //, Map *map=NULL);
+	static Renderer * create(GPX2Video &app, const GPX2Video::Settings &settings, MediaContainer *container, layout::Layout *layout);
+
+	// Parse layout file (a parsed layout can be shared by several renderers)
+	static layout::Layout * parse(const std::string &filename);
+
+	const GPX2Video::Settings& settings(void) const {
+		return settings_;
+	}
+
+	void setProgress(bool enable) {
+		progress_ = enable;
+	}
+
+	// Skip time sync step if the media container is already synchronized
+	void setTimeSync(bool enable) {
+		timesync_ = enable;
+	}
 
 	void append(VideoWidget *widget);
 
@@ -35,11 +56,21 @@ public:
 	bool run(void);
 	bool stop(void);
 
+	// Render next frame, returns false once media is done
+	bool process(void);
+
+	// Number of frames rendered
+	int64_t nbrFrames(void) const {
+		return frame_time_;
+	}
+
 	void draw(FramePtr frame, const GPXData &data);
 
 private:
 	GPX2Video &app_;
 
+	GPX2Video::Settings settings_;
+
 	GPX *gpx_;
 	GPXData data_;
 
@@ -54,20 +85,96 @@ private:
 
 	time_t started_at_;
 
+	// Camera time of the current frame
+	time_t time_;
+
+	bool progress_;
+	bool timesync_;
+
 	char duration_[16];
 	unsigned int duration_ms_;
 
 	int64_t frame_time_ = 0;
 
-	Renderer(GPX2Video &app); //, Map *map);
+	// First frame timestamp (--start)
+	int64_t start_pts_;
+
+	// Output size, layout geometry is scaled for preview & output size
+	// (aspect ratio can change: x & y are scaled apart, margins & borders
+	// by the smaller factor)
+	int width_;
+	int height_;
+	double scale_x_;
+	double scale_y_;
+
+	int scaleX(int value) const {
+		return (int) (value * scale_x_ + 0.5);
+	}
+
+	int scaleY(int value) const {
+		return (int) (value * scale_y_ + 0.5);
+	}
+
+	int scale(int value) const {
+		return (int) (value * std::min(scale_x_, scale_y_) + 0.5);
+	}
+
+	// Overlay only output (transparent canvas, media isn't decoded)
+	bool overlay_only_;
+
+	// Snapshot: first frame is written as an image, nothing is encoded
+	bool snapshot_;
+
+	// Identical overlay frames aren't encoded again (variable frame rate)
+	bool dedup_;
+	bool skipped_;
+	FramePtr last_frame_;
+	AVRational last_time_;
+
+	// Stage timers (--profile)
+	Profiler *profiler_;
+
+	// Overlay sequence rendered ahead (--overlay-cache)
+	OverlayCache *cache_;
+
+	// Last frame PTS & timestamp
+	int64_t timecode_;
+	int64_t timecode_ms_;
+
+	// Monotonic times (in ms) of start, last display & last JSON report
+	int64_t started_ms_;
+	int64_t display_at_;
+	int64_t report_at_;
+	int64_t report_frame_;
+
+	// Monotonic time in ms
+	static int64_t now(void);
+
+	Renderer(GPX2Video &app, const GPX2Video::Settings &settings, MediaContainer *container); //, Map *map);
 
 	void init(void);
-	bool load(void);
+	bool load(layout::Layout *root);
 	bool loadMap(layout::Map *m);
 	bool loadTrack(layout::Track *t);
 	bool loadWidget(layout::Widget *w);
 	void computeWidgetsPosition(void);
 
+	// Transparent frame at 'time' from start, NULL once media duration is reached
+	FramePtr createFrame(AVRational time);
+
+	// Write composited frame to output image (PNG, JPEG... from extension)
+	bool writeSnapshot(FramePtr frame);
+
+	// Write a JSON progress line (--progress-fd)
+	void report(bool done);
+
+	// Open overlay sequence cache, render it first if missing
+	OverlayCache * loadCache(void);
+	bool buildCache(const std::string &filename);
+
+	// Blend cached overlay of frame at 'timecode', false if not cached
+	bool blend(FramePtr frame, int64_t timecode);
+
 	void add(OIIO::ImageBuf *frame, int x, int y, const char *picto, const char *label, const char *value, double divider=1.9);
 };
 
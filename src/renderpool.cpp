@@ -0,0 +1,124 @@
+#include "log.h"
+#include "macros.h"
+#include "renderpool.h"
+
+
+RenderPool::RenderPool(GPX2Video &app)
+	: Task(app)
+	, next_(0)
+	, max_workers_(1)
+	, nbr_workers_(0)
+	, nbr_failures_(0)
+	, abort_(false) {
+}
+
+
+RenderPool::~RenderPool() {
+	for (Item &item : items_) {
+		if (item.renderer)
+			delete item.renderer;
+		if (item.container)
+			delete item.container;
+	}
+}
+
+
+void RenderPool::append(Renderer *renderer, MediaContainer *container) {
+	Item item;
+
+	item.renderer = renderer;
+	item.container = container;
+
+	items_.push_back(item);
+}
+
+
+bool RenderPool::run(void) {
+	int i, n;
+
+	log_call();
+
+	n = MIN(MAX(1, max_workers_), (int) items_.size());
+
+	if (n == 0) {
+		complete();
+		return true;
+	}
+
+	// Last worker completes the task
+	nbr_workers_ = n;
+
+	for (i=0; i<n; i++)
+		workers_.push_back(std::thread(&RenderPool::work, this));
+
+	return true;
+}
+
+
+bool RenderPool::render(Renderer *renderer) {
+	if (!renderer->start())
+		return false;
+
+	while (!abort_ && renderer->process())
+		;
+
+	return true;
+}
+
+
+void RenderPool::work(void) {
+	size_t index;
+
+	for (;;) {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+
+			if (abort_ || (next_ >= items_.size()))
+				break;
+
+			index = next_++;
+		}
+
+		Item &item = items_[index];
+
+		if (item.renderer == NULL) {
+			nbr_failures_++;
+			continue;
+		}
+
+		if (!process(index, item.renderer))
+			nbr_failures_++;
+
+		item.renderer->stop();
+
+		// Release item (decoders, encoder & widget buffers)
+		delete item.renderer;
+
+		if (item.container)
+			delete item.container;
+
+		item.renderer = NULL;
+		item.container = NULL;
+	}
+
+	if (--nbr_workers_ == 0)
+		complete();
+}
+
+
+bool RenderPool::stop(void) {
+	log_call();
+
+	// Interrupted: current items stop at next frame
+	abort_ = true;
+
+	for (std::thread &worker : workers_) {
+		if (worker.joinable())
+			worker.join();
+	}
+
+	workers_.clear();
+
+	return true;
+}
+
@@ -0,0 +1,74 @@
+#ifndef __GPX2VIDEO__RENDERPOOL_H__
+#define __GPX2VIDEO__RENDERPOOL_H__
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+#include "media.h"
+#include "renderer.h"
+#include "gpx2video.h"
+
+
+// Renderers run by worker threads
+//
+// Subclasses append a renderer per item (NULL: item fails) when the task is
+// created, then 'nbr_workers' threads render items until none left. An item
+// (renderer & container) is released once rendered. Last worker completes
+// the task.
+class RenderPool : public GPX2Video::Task {
+public:
+	virtual ~RenderPool();
+
+	bool run(void);
+	bool stop(void);
+
+protected:
+	RenderPool(GPX2Video &app);
+
+	// Append an item, the pool owns renderer & container (can be NULL)
+	void append(Renderer *renderer, MediaContainer *container);
+
+	size_t size(void) const {
+		return items_.size();
+	}
+
+	int nbrFailures(void) const {
+		return nbr_failures_;
+	}
+
+	void setNbrWorkers(int nbr_workers) {
+		max_workers_ = nbr_workers;
+	}
+
+	// Renders item at index, returns false on failure
+	virtual bool process(size_t index, Renderer *renderer) = 0;
+
+	// Runs renderer until media is done (or pool is stopped)
+	bool render(Renderer *renderer);
+
+	// Worker thread, renders items until none left
+	void work(void);
+
+private:
+	struct Item {
+		Renderer *renderer;
+		MediaContainer *container;
+	};
+
+	std::vector<Item> items_;
+
+	std::mutex mutex_;
+	size_t next_;
+
+	int max_workers_;
+
+	std::vector<std::thread> workers_;
+	std::atomic<int> nbr_workers_;
+	std::atomic<int> nbr_failures_;
+	std::atomic<bool> abort_;
+};
+
+#endif
+
@@ -0,0 +1,182 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+
+#include "log.h"
+#include "macros.h"
+#include "decoder.h"
+#include "timesync.h"
+#include "snapshot.h"
+
+
+static int64_t now_ms(void) {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+Snapshot::Snapshot(GPX2Video &app)
+	: RenderPool(app)
+	, app_(app)
+	, layout_(NULL)
+	, container_(NULL)
+	, started_at_(0) {
+}
+
+
+Snapshot::~Snapshot() {
+	if (layout_)
+		delete layout_;
+	if (container_)
+		delete container_;
+}
+
+
+Snapshot * Snapshot::create(GPX2Video &app) {
+	Snapshot *snapshot = new Snapshot(app);
+
+	snapshot->init();
+
+	return snapshot;
+}
+
+
+void Snapshot::init(void) {
+	int n = 0;
+
+	size_t pos;
+
+	std::string name, extension;
+
+	TimeSync *timesync;
+
+	GPX2Video::Settings &settings = app_.settings();
+
+	log_call();
+
+	// Output name & extension (image format)
+	name = settings.outputfile();
+	pos = name.find_last_of('.');
+
+	if ((pos != std::string::npos) && (name.find_first_of('/', pos) == std::string::npos)) {
+		extension = name.substr(pos);
+		name = name.substr(0, pos);
+	}
+
+	// Shared resources: media is synchronized once, layout is parsed once,
+	// track is projected once
+	container_ = probe();
+
+	if (container_ == NULL) {
+		log_error("Probe '%s' media failure, skip snapshots", settings.mediafile().c_str());
+		return;
+	}
+
+	timesync = TimeSync::create(app_, container_);
+	timesync->sync();
+	delete timesync;
+
+	layout_ = Renderer::parse(settings.layoutfile());
+
+	app_.geometry();
+
+	// Create a renderer for each time (map download tasks are queued)
+	for (int time_ms : settings.snapshots()) {
+		Shot shot;
+
+		Renderer *renderer;
+		MediaContainer *container;
+
+		n++;
+
+		shot.time_ms = time_ms;
+		shot.outputfile = (settings.snapshots().size() > 1) ? name + "-" + std::to_string(n) + extension : settings.outputfile();
+
+		shots_.push_back(shot);
+
+		// Each snapshot seeks its own demux context (probe cache hit)
+		if ((container = probe()) == NULL) {
+			log_error("Probe '%s' media failure, skip snapshot", settings.mediafile().c_str());
+			append(NULL, NULL);
+			continue;
+		}
+
+		container->setTimeOffset(container_->timeOffset());
+
+		// Snapshot settings: output & start (each snapshot writes its own trace file)
+		GPX2Video::Settings shot_settings = settings;
+
+		shot_settings.setOutputfile(shot.outputfile);
+		shot_settings.setStart(time_ms);
+
+		if (!settings.traceFile().empty())
+			shot_settings.setTraceFile(settings.traceFile() + "." + std::to_string(n));
+
+		renderer = Renderer::create(app_, shot_settings, container, layout_);
+
+		// Media is already synchronized, workers share the console
+		renderer->setTimeSync(false);
+		renderer->setProgress(false);
+
+		append(renderer, container);
+	}
+
+	setNbrWorkers(std::thread::hardware_concurrency());
+}
+
+
+MediaContainer * Snapshot::probe(void) {
+	GPX2Video::Settings &settings = app_.settings();
+
+	if (settings.chapters())
+		return Decoder::probe(Demuxer::chapters(settings.mediafile()), settings.mmap());
+
+	return Decoder::probe(settings.mediafile(), settings.mmap());
+}
+
+
+bool Snapshot::start(void) {
+	log_call();
+
+	started_at_ = now_ms();
+
+	return true;
+}
+
+
+bool Snapshot::process(size_t index, Renderer *renderer) {
+	const Shot &shot = shots_[index];
+
+	log_notice("Snapshot %d/%d: render %02d:%02d:%02d.%03d to '%s'", (int) index + 1, (int) shots_.size(),
+		(shot.time_ms / 3600000), (shot.time_ms / 60000) % 60, (shot.time_ms / 1000) % 60, shot.time_ms % 1000,
+		shot.outputfile.c_str());
+
+	// Renders a single frame (nothing written if time is out of media)
+	render(renderer);
+
+	if (renderer->nbrFrames() == 0) {
+		log_error("Snapshot '%s' failure", shot.outputfile.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+
+bool Snapshot::stop(void) {
+	int64_t working;
+
+	log_call();
+
+	// Interrupted: current snapshot stops at next frame
+	RenderPool::stop();
+
+	working = now_ms() - started_at_;
+
+	printf("%d snapshots (%d failures) proceed in %d.%03d s\n",
+		(int) shots_.size(), nbrFailures(),
+		(int) (working / 1000), (int) (working % 1000));
+
+	return true;
+}
+
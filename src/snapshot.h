@@ -0,0 +1,60 @@
+#ifndef __GPX2VIDEO__SNAPSHOT_H__
+#define __GPX2VIDEO__SNAPSHOT_H__
+
+#include <string>
+#include <vector>
+
+#include "layoutlib/Layout.h"
+
+#include "media.h"
+#include "renderpool.h"
+
+
+// Snapshots of the media with telemetry overlay at given times
+//
+// Each time (--at) is rendered by its own renderer: keyframe seek, decode up
+// to time, GPX data seek, then the composited frame is written as an image.
+// Layout is parsed once, media is synchronized once. Each snapshot has its
+// own demux context (media probe is cached), snapshots are rendered by
+// worker threads.
+//
+// One time: output is written as is. Several times: '-1', '-2'... are
+// appended to output name (before extension).
+class Snapshot : public RenderPool {
+public:
+	struct Shot {
+		int time_ms;
+		std::string outputfile;
+	};
+
+	virtual ~Snapshot();
+
+	static Snapshot * create(GPX2Video &app);
+
+	bool start(void);
+	bool stop(void);
+
+protected:
+	void init(void);
+
+	// Open media (demux context) for a snapshot
+	MediaContainer * probe(void);
+
+	bool process(size_t index, Renderer *renderer);
+
+private:
+	GPX2Video &app_;
+
+	Snapshot(GPX2Video &app);
+
+	layout::Layout *layout_;
+	// Synchronized media (time offset of each snapshot)
+	MediaContainer *container_;
+
+	std::vector<Shot> shots_;
+
+	int64_t started_at_;
+};
+
+#endif
+
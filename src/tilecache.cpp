@@ -0,0 +1,385 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include "log.h"
+#include "macros.h"
+#include "tilecache.h"
+
+
+struct TileCacheFile {
+	std::string filename;
+	time_t mtime;
+	uint64_t size;
+};
+
+
+static void tilecache_scan(const std::string &path, std::vector<TileCacheFile> &files, uint64_t &total) {
+	DIR *dir;
+	struct dirent *entry;
+	struct stat st;
+
+	dir = opendir(path.c_str());
+
+	if (dir == NULL)
+		return;
+
+	while ((entry = readdir(dir)) != NULL) {
+		size_t len = strlen(entry->d_name);
+
+		if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+			continue;
+
+		std::string filename = path + "/" + entry->d_name;
+
+		if (stat(filename.c_str(), &st) != 0)
+			continue;
+
+		if (S_ISDIR(st.st_mode)) {
+			tilecache_scan(filename, files, total);
+			continue;
+		}
+
+		// Download in progress
+		if ((len > strlen(".part")) && !strcmp(entry->d_name + len - strlen(".part"), ".part"))
+			continue;
+
+		total += st.st_size;
+
+		// Metadata follows its tile
+		if ((len > strlen(TILECACHE_META_EXT))
+			&& !strcmp(entry->d_name + len - strlen(TILECACHE_META_EXT), TILECACHE_META_EXT))
+			continue;
+
+		files.push_back({ filename, st.st_mtime, (uint64_t) st.st_size });
+	}
+
+	closedir(dir);
+}
+
+
+TileCache::TileCache(const std::string &path, const std::string &filename)
+	: path_(path)
+	, filename_(filename)
+	, fetched_(0)
+	, max_age_(0)
+	, exists_(false)
+	, modified_(false)
+	, fp_(NULL)
+	, size_(0) {
+	load();
+}
+
+
+TileCache::~TileCache() {
+	std::string tmpfile = path_ + "/" + filename_ + ".part";
+
+	if (fp_) {
+		std::fclose(fp_);
+		unlink(tmpfile.c_str());
+	}
+}
+
+
+bool TileCache::exists(void) const {
+	return exists_;
+}
+
+
+bool TileCache::fresh(void) const {
+	if (!exists_)
+		return false;
+
+	return (time(NULL) - fetched_) < MAX(max_age_, (time_t) TILECACHE_MIN_AGE);
+}
+
+
+void TileCache::touch(void) {
+	std::string output = path_ + "/" + filename_;
+
+	// mtime is the LRU use stamp
+	utime(output.c_str(), NULL);
+}
+
+
+bool TileCache::load(void) {
+	struct stat st;
+
+	std::string line;
+	std::string output = path_ + "/" + filename_;
+	std::string meta = output + TILECACHE_META_EXT;
+
+	if (stat(output.c_str(), &st) != 0)
+		return false;
+
+	exists_ = (st.st_size > 0);
+
+	// Tile cached without metadata, assume it has been fetched at last use
+	fetched_ = st.st_mtime;
+
+	std::ifstream stream(meta);
+
+	if (!stream.is_open())
+		return false;
+
+	while (std::getline(stream, line)) {
+		size_t pos = line.find('=');
+
+		if (pos == std::string::npos)
+			continue;
+
+		std::string key = line.substr(0, pos);
+		std::string value = line.substr(pos + 1);
+
+		if (key == "etag")
+			etag_ = value;
+		else if (key == "last-modified")
+			last_modified_ = value;
+		else if (key == "fetched")
+			fetched_ = (time_t) strtoll(value.c_str(), NULL, 10);
+		else if (key == "max-age")
+			max_age_ = (time_t) strtoll(value.c_str(), NULL, 10);
+	}
+
+	return true;
+}
+
+
+bool TileCache::save(void) {
+	std::string meta = path_ + "/" + filename_ + TILECACHE_META_EXT;
+	std::string tmpfile = meta + ".part";
+
+	std::ofstream stream(tmpfile);
+
+	if (!stream.is_open())
+		return false;
+
+	stream << "etag=" << etag_ << std::endl;
+	stream << "last-modified=" << last_modified_ << std::endl;
+	stream << "fetched=" << (long long) fetched_ << std::endl;
+	stream << "max-age=" << (long long) max_age_ << std::endl;
+
+	stream.close();
+
+	return (rename(tmpfile.c_str(), meta.c_str()) == 0);
+}
+
+
+size_t TileCache::header(char *ptr, size_t size, size_t nmemb, void *userdata) {
+	TileCache *cache = (TileCache *) userdata;
+
+	size_t pos;
+	const char *s;
+
+	std::string line(ptr, size * nmemb);
+
+	// Strip CRLF
+	while (!line.empty() && ((line.back() == '\r') || (line.back() == '\n')))
+		line.pop_back();
+
+	// New tile content, previous validators are obsolete
+	if (!line.compare(0, 5, "HTTP/") && (line.find(" 200") != std::string::npos)) {
+		cache->etag_.clear();
+		cache->last_modified_.clear();
+		cache->max_age_ = 0;
+		goto done;
+	}
+
+	pos = line.find(':');
+
+	if (pos == std::string::npos)
+		goto done;
+
+	{
+		std::string key = line.substr(0, pos);
+		std::string value = line.substr(pos + 1);
+
+		value.erase(0, value.find_first_not_of(" \t"));
+
+		if (!strcasecmp(key.c_str(), "ETag"))
+			cache->etag_ = value;
+		else if (!strcasecmp(key.c_str(), "Last-Modified"))
+			cache->last_modified_ = value;
+		else if (!strcasecmp(key.c_str(), "Cache-Control")) {
+			if ((s = strstr(value.c_str(), "max-age=")) != NULL)
+				cache->max_age_ = (time_t) strtoll(s + strlen("max-age="), NULL, 10);
+		}
+	}
+
+done:
+	return size * nmemb;
+}
+
+
+void TileCache::prepare(EVCurlTask *evtaskh) {
+	char buf[128];
+	struct tm tm;
+
+	std::string line;
+
+	evtaskh->setOption(CURLOPT_HEADERFUNCTION, header);
+	evtaskh->setOption(CURLOPT_HEADERDATA, this);
+
+	if (!exists_)
+		return;
+
+	// Conditional request, server replies 304 if tile didn't change
+	if (!etag_.empty()) {
+		line = "If-None-Match: " + etag_;
+		evtaskh->setHeader(line.c_str());
+	}
+
+	if (!last_modified_.empty())
+		line = "If-Modified-Since: " + last_modified_;
+	else {
+		gmtime_r(&fetched_, &tm);
+		strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+
+		line = "If-Modified-Since: " + std::string(buf);
+	}
+
+	evtaskh->setHeader(line.c_str());
+}
+
+
+size_t TileCache::write(const char *ptr, size_t size) {
+	std::string tmpfile = path_ + "/" + filename_ + ".part";
+
+	// Open temporary tile file
+	if (fp_ == NULL) {
+		fp_ = std::fopen(tmpfile.c_str(), "w+");
+
+		if (fp_ == NULL)
+			return 0;
+	}
+
+	size = fwrite(ptr, 1, size, fp_);
+
+	size_ += size;
+
+	return size;
+}
+
+
+bool TileCache::commit(CURLcode result, long code) {
+	std::string output = path_ + "/" + filename_;
+	std::string tmpfile = output + ".part";
+
+	log_call();
+
+	if (fp_)
+		std::fclose(fp_);
+
+	fp_ = NULL;
+
+	// Not modified, keep cached tile
+	if ((result == CURLE_OK) && (code == 304) && exists_) {
+		unlink(tmpfile.c_str());
+
+		fetched_ = time(NULL);
+		modified_ = false;
+
+		save();
+		touch();
+
+		return true;
+	}
+
+	// Tile is replaced only if fully downloaded
+	if ((result == CURLE_OK) && (code == 200) && (size_ > 0)) {
+		if (rename(tmpfile.c_str(), output.c_str()) != 0)
+			goto failure;
+
+		fetched_ = time(NULL);
+		modified_ = true;
+		exists_ = true;
+
+		save();
+
+		return true;
+	}
+
+failure:
+	unlink(tmpfile.c_str());
+
+	// A stale tile is better than no tile
+	return exists_;
+}
+
+
+void TileCache::evict(const std::string &path, uint64_t budget) {
+	uint64_t total = 0;
+	unsigned int count = 0;
+
+	DIR *dir;
+	struct dirent *entry;
+	struct stat st;
+
+	std::vector<TileCacheFile> files;
+
+	log_call();
+
+	// Tiles only: '<source>/<zoom>/...' directories (cache also holds probe
+	// & overlay caches)
+	dir = opendir(path.c_str());
+
+	if (dir == NULL)
+		return;
+
+	while ((entry = readdir(dir)) != NULL) {
+		std::string filename = path + "/" + entry->d_name;
+
+		if (strspn(entry->d_name, "0123456789") != strlen(entry->d_name))
+			continue;
+
+		if ((stat(filename.c_str(), &st) != 0) || !S_ISDIR(st.st_mode))
+			continue;
+
+		tilecache_scan(filename, files, total);
+	}
+
+	closedir(dir);
+
+	if (total <= budget)
+		return;
+
+	// Least recently used first
+	std::sort(files.begin(), files.end(), [](const TileCacheFile &a, const TileCacheFile &b) {
+		return a.mtime < b.mtime;
+	});
+
+	for (const TileCacheFile &file : files) {
+		struct stat st;
+
+		std::string meta = file.filename + TILECACHE_META_EXT;
+
+		if (total <= budget)
+			break;
+
+		if (unlink(file.filename.c_str()) != 0)
+			continue;
+
+		total -= MIN(total, file.size);
+
+		if (stat(meta.c_str(), &st) == 0) {
+			if (unlink(meta.c_str()) == 0)
+				total -= MIN(total, (uint64_t) st.st_size);
+		}
+
+		count++;
+	}
+
+	log_info("Cache eviction: %u files removed (%.1f MB used)", count, total / (1024.0 * 1024.0));
+}
+
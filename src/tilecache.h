@@ -0,0 +1,83 @@
+#ifndef __GPX2VIDEO__TILECACHE_H__
+#define __GPX2VIDEO__TILECACHE_H__
+
+#include <string>
+#include <cstdio>
+#include <cstdint>
+
+#include <time.h>
+
+#include "evcurl.h"
+
+
+// Tiles aren't re-fetched before (OSM tile usage policy)
+#define TILECACHE_MIN_AGE (7 * 24 * 3600)
+
+// Metadata sidecar file extension
+#define TILECACHE_META_EXT ".meta"
+
+
+class TileCache {
+public:
+	TileCache(const std::string &path, const std::string &filename);
+	virtual ~TileCache();
+
+	const std::string& filename(void) const {
+		return filename_;
+	}
+
+	// Tile file is in cache (may be stale)
+	bool exists(void) const;
+
+	// Tile file is in cache and doesn't need revalidation
+	bool fresh(void) const;
+
+	// Update LRU use stamp
+	void touch(void);
+
+	// Set conditional request headers & metadata parser
+	void prepare(EVCurlTask *evtaskh);
+
+	// Append downloaded data (to a temporary file)
+	size_t write(const char *ptr, size_t size);
+
+	// Commit the response, returns false if tile isn't usable
+	bool commit(CURLcode result, long code);
+
+	size_t size(void) const {
+		return size_;
+	}
+
+	bool modified(void) const {
+		return modified_;
+	}
+
+	// Evict least recently used tiles until tile directories of cache 'path'
+	// fit budget (other files & downloads in progress are kept)
+	static void evict(const std::string &path, uint64_t budget);
+
+protected:
+	bool load(void);
+	bool save(void);
+
+	static size_t header(char *ptr, size_t size, size_t nmemb, void *userdata);
+
+private:
+	std::string path_;
+	std::string filename_;
+
+	// Validators
+	std::string etag_;
+	std::string last_modified_;
+	time_t fetched_;
+	time_t max_age_;
+
+	bool exists_;
+	bool modified_;
+
+	std::FILE *fp_;
+	size_t size_;
+};
+
+#endif
+
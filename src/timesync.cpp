@@ -1,4 +1,6 @@
-#include <byteswap.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -8,12 +10,16 @@ extern "C" {
 }
 
 #include "log.h"
+#include "macros.h"
 #include "timesync.h"
 
 
 
-TimeSync::TimeSync(GPX2Video &app, const ExtractorSettings &settings) 
-	: Extractor(app, settings) {
+TimeSync::TimeSync(GPX2Video &app, const ExtractorSettings &settings)
+	: Extractor(app, settings)
+	, ok_(false)
+	, n_(0)
+	, offset_(0) {
 }
 
 
@@ -21,146 +27,230 @@ TimeSync::~TimeSync() {
 }
 
 
-TimeSync * TimeSync::create(GPX2Video &app) {
+TimeSync * TimeSync::create(GPX2Video &app, MediaContainer *container) {
 	ExtractorSettings extractorSettings;
 	extractorSettings.setFormat(ExtractorSettings::FormatNone);
 
 	TimeSync *timesync = new TimeSync(app, extractorSettings);
 
-	timesync->init();
+	timesync->init(container);
 
 	return timesync;
 }
 
 
-bool TimeSync::start(void) {
-	bool result = false;
+int TimeSync::probe(ssize_t index, int64_t *offset) {
+	int result;
 
-	log_call();
+	int64_t timecode_ms;
+	int64_t camera_ms;
 
-	n_ = 0;
-	ok_ = false;
-	offset_ = 0;
+	AVPacket *packet = NULL;
 
-	log_notice("Time synchronization...");
+	std::vector<GPMF::Sample> samples;
 
-	// Open output stream
-    out_ = std::ofstream("/dev/null");
-       
-	if (!out_.is_open()) {
-		log_error("Open '/dev/null' failure");
-		goto done;
-	}
+	if (!(packet = av_packet_alloc()))
+		return -1;
 
-	// Open GoPro MET stream
-	if (open() != true) {
-		log_warn("Time synchronization failure!");
+	// Jump to packet (sample table only)
+	if (index >= 0)
+		next_ = index;
+
+	if ((result = getPacket(packet)) < 0)
 		goto done;
-	}
 
-	result = true;
+	// Only GPSF & GPSU of this packet are relevant
+	gpmf_.reset();
+	gpmf_.decode(packet->data, packet->size, samples);
+
+	n_++;
+
+	timecode_ms = packet->pts * av_q2d(avstream_->time_base) * 1000;
+	camera_ms = (int64_t) container_->startTime() * 1000 + timecode_ms;
+
+	result = ((gpmf_.fix() > 1) && (gpmf_.time() > 0)) ? 1 : 0;
+
+	if (result)
+		*offset = gpmf_.time() - camera_ms;
+
+	// Dump
+	if (app_.progressInfo()) {
+		printf("PACKET: %ld - PTS: %ld - TIMESTAMP: %ld ms - GPS FIX: %d - OFFSET: %ld ms\n",
+			(long) index, packet->pts, timecode_ms, gpmf_.fix(), result ? *offset : 0);
+	}
 
 done:
+	av_packet_free(&packet);
+
 	return result;
 }
 
 
-bool TimeSync::run(void) {
-	char s[128];
-
+ssize_t TimeSync::search(void) {
 	int result;
 
-	int offset = 0;
-	int start_time = 0;
+	int64_t offset;
 
-	time_t gps_t;
-	struct tm gps_time;
+	ssize_t lo, hi, mid;
+	ssize_t step;
 
-	time_t camera_t;
-	struct tm camera_time;
+	ssize_t n = index_.size();
 
-	const char *str;
+	if (n == 0)
+		return -1;
 
-	int64_t timecode, timecode_ms;
+	// Exponential search, lo is the last packet known without fix
+	lo = -1;
+	hi = 0;
+	step = 1;
 
-    AVPacket *packet = NULL;
+	for (;;) {
+		if ((result = probe(hi, &offset)) < 0)
+			return -1;
+		if (result)
+			break;
 
-	TimeSync::GPMD gpmd;
+		if (hi == n - 1)
+			return -1;
 
-	log_call();
+		lo = hi;
+		hi = MIN(hi + step, n - 1);
+		step *= 2;
+	}
 
-	// Get start time from metadata
-	start_time = container_->startTime();
+	// Binary search of the first packet with a fix in ]lo, hi]
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
 
-	if (!(packet = av_packet_alloc()))
-		goto done;
+		if ((result = probe(mid, &offset)) < 0)
+			return -1;
 
-	// Pull from stream
-	result = getPacket(packet);
+		if (result)
+			hi = mid;
+		else
+			lo = mid;
+	}
 
-	// Handle any errors that aren't EOF (EOF is handled later on)
-	if ((result < 0) && (result != AVERROR_EOF))
-		goto done;
+	return hi;
+}
 
-	if (result == AVERROR_EOF)
-		goto done;
 
-	// Stream timestamp
-	timecode = packet->pts;
-	timecode_ms = timecode * av_q2d(avstream_->time_base) * 1000;
+int64_t TimeSync::estimate(std::vector<int64_t> &offsets) {
+	int64_t median, mad;
+	int64_t sum = 0;
+	int64_t limit;
 
-	// Parsing stream packet
-	parse(gpmd, packet->data, packet->size, out_);
+	int64_t count = 0;
 
-	// Camera time
-	camera_t = start_time + (timecode_ms / 1000);
+	std::vector<int64_t> deviations;
 
-	gmtime_r(&camera_t, &camera_time);
+	std::sort(offsets.begin(), offsets.end());
 
-	strftime(s, sizeof(s), "%Y-%m-%d %H:%M:%S", &camera_time);
+	median = offsets[offsets.size() / 2];
 
-	// GPS time - format = 2021-12-08 08:55:46.039
-	str = gpmd.date.c_str();
+	for (int64_t offset : offsets)
+		deviations.push_back(std::llabs(offset - median));
 
-	memset(&gps_time, 0, sizeof(gps_time));
-	strptime(str, "%Y-%m-%d %H:%M:%S.", &gps_time);
+	std::sort(deviations.begin(), deviations.end());
 
-	gps_t = timegm(&gps_time);
+	mad = deviations[deviations.size() / 2];
 
-	// Offset in seconds
-	offset = gps_t - camera_t;
+	// Outliers rejection (GPS time lock jitter)
+	limit = MAX(3 * mad, (int64_t) 50);
 
-	// Dump
-	if (app_.progressInfo()) {
-		printf("PACKET: %d - PTS: %ld - TIMESTAMP: %ld ms - TIME: %s - GPS FIX: %d - GPS TIME: %s - OFFSET: %d\n", 
-			n_, timecode, timecode_ms, s, gpmd.fix, gpmd.date.c_str(), offset);
+	for (int64_t offset : offsets) {
+		if (std::llabs(offset - median) > limit)
+			continue;
+
+		sum += offset;
+		count++;
 	}
 
-	n_++;
+	return llround((double) sum / count);
+}
 
-	// We don't needd the packet anymore, so free it
-	av_packet_unref(packet);
 
-	packet = NULL;
+bool TimeSync::sync(void) {
+	int result;
 
-	// Fix ?
-	if (gpmd.fix > 1) {
-		ok_ = true;
-		offset_ = offset;
+	int64_t offset;
+
+	ssize_t first;
+
+	std::vector<int64_t> offsets;
+
+	log_call();
+
+	ok_ = false;
+	n_ = 0;
+
+	// Open GoPro MET stream
+	if (open() != true)
 		goto done;
+
+	if (!index_.empty()) {
+		// Jump to candidate packets thanks to the sample table
+		if ((first = search()) < 0)
+			goto done;
+
+		for (ssize_t i=first; i<(ssize_t) index_.size(); i++) {
+			if ((result = probe(i, &offset)) < 0)
+				break;
+			if (result)
+				offsets.push_back(offset);
+
+			if (offsets.size() >= TIMESYNC_NBR_SAMPLES)
+				break;
+
+			// GPS lost fix for too long
+			if ((i - first) > 4 * TIMESYNC_NBR_SAMPLES)
+				break;
+		}
+	}
+	else {
+		// No sample table, read packets in sequence
+		while (offsets.size() < TIMESYNC_NBR_SAMPLES) {
+			if ((result = probe(-1, &offset)) < 0)
+				break;
+			if (result)
+				offsets.push_back(offset);
+		}
 	}
 
-	if (result < 0)
+	if (offsets.empty())
 		goto done;
-//	}
 
-	schedule();
+	offset_ = estimate(offsets);
+	ok_ = true;
 
-	return true;
+	// Apply offset
+	container_->setTimeOffset(offset_);
 
 done:
-	if (packet != NULL)
-		av_packet_unref(packet);
+	close();
+
+	if (ok_)
+		log_notice("Video stream synchronized with success (offset: %d ms, %d packets read)", offset_, n_);
+	else
+		log_warn("Time synchronization failure!");
+
+	return ok_;
+}
+
+
+bool TimeSync::start(void) {
+	log_call();
+
+	log_notice("Time synchronization...");
+
+	return true;
+}
+
+
+bool TimeSync::run(void) {
+	log_call();
+
+	sync();
 
 	complete();
 
@@ -169,14 +259,7 @@ done:
 
 
 bool TimeSync::stop(void) {
-	if (ok_) {
-		log_notice("Video stream synchronized with success (offset: %d ms)", offset_);
-	
-		// Apply offset
-		container_->setTimeOffset(offset_);
-	}
-
-	close();
+	log_call();
 
 	return true;
 }
@@ -4,6 +4,8 @@
 #include <string>
 #include <vector>
 
+#include <sys/types.h>
+
 #include "media.h"
 #include "decoder.h"
 #include "gpx2video.h"
@@ -11,16 +13,37 @@
 #include "extractor.h"
 
 
+// Number of GPS fixes used to compute the time offset
+#define TIMESYNC_NBR_SAMPLES 9
+
+
 class TimeSync : public Extractor {
 public:
-	static TimeSync * create(GPX2Video &app);
+	static TimeSync * create(GPX2Video &app, MediaContainer *container=NULL);
 
 	virtual ~TimeSync();
 
+	// Synchronous call, applies offset (in ms) to the media container
+	bool sync(void);
+
+	const int& offset(void) const {
+		return offset_;
+	}
+
 	bool start(void);
 	bool run(void);
 	bool stop(void);
 
+protected:
+	// Read & decode GPMD packet at index position (-1: next packet)
+	// Returns 1 if GPS has a fix, 0 if not, < 0 on error
+	int probe(ssize_t index, int64_t *offset);
+
+	// First packet with a GPS fix (exponential then binary search)
+	ssize_t search(void);
+
+	static int64_t estimate(std::vector<int64_t> &offsets);
+
 private:
 	TimeSync(GPX2Video &app, const ExtractorSettings &settings);
 
@@ -28,8 +51,6 @@ private:
 
 	int n_;
 	int offset_;
-
-    std::ofstream out_;
 };
 
 #endif
@@ -19,15 +19,13 @@
 #include "utils.h"
 #include "log.h"
 #include "gpx.h"
+#include "projection.h"
+#include "trackgeometry.h"
 #include "oiioutils.h"
 #include "videoparams.h"
 #include "track.h"
 
 
-#define TILESIZE 256
-
-
-
 TrackSettings::TrackSettings() {
 	width_ = 320;
 	height_ = 240;
@@ -94,6 +92,8 @@ Track::Track(GPX2Video &app, const TrackSettings &settings, struct event_base *e
 
 	buf_ = NULL;
 	trackbuf_ = NULL;
+	trail_ = NULL;
+	geometry_ = NULL;
 
 	divider_ = 1.0;
 //	padding_ = 0;
@@ -103,6 +103,8 @@ Track::Track(GPX2Video &app, const TrackSettings &settings, struct event_base *e
 Track::~Track() {
 	log_call();
 
+	if (trail_ != NULL)
+		delete trail_;
 	if (trackbuf_ != NULL)
 		delete trackbuf_;
 	if (buf_)
@@ -137,40 +139,6 @@ void Track::setSize(int width, int height) {
 }
 
 
-int Track::lat2pixel(int zoom, float lat) {
-    float lat_m;
-    int pixel_y;
-
-    double latrad = lat * M_PI / 180.0;
-
-    lat_m = atanh(sin(latrad));
-
-    // the formula is some more notes
-    // http://manialabs.wordpress.com/2013/01/26/converting-latitude-and-longitude-to-map-tile-in-mercator-projection/
-    //
-    // pixel_y = -(2^zoom * TILESIZE * lat_m) / 2PI + (2^zoom * TILESIZE) / 2
-    pixel_y = -(int)( (lat_m * TILESIZE * (1 << zoom) ) / (2*M_PI)) +
-        ((1 << zoom) * (TILESIZE/2) );
-
-    return pixel_y;
-}
-
-
-int Track::lon2pixel(int zoom, float lon) {
-    int pixel_x;
-
-    double lonrad = lon * M_PI / 180.0;
-
-    // the formula is
-    //
-    // pixel_x = (2^zoom * TILESIZE * lon) / 2PI + (2^zoom * TILESIZE) / 2
-    pixel_x = (int)(( lonrad * TILESIZE * (1 << zoom) ) / (2*M_PI)) +
-        ( (1 << zoom) * (TILESIZE/2) );
-
-    return pixel_x;
-}
-
-
 void Track::init(void) {
 	int zoom;
 	int padding;
@@ -198,11 +166,11 @@ void Track::init(void) {
 	// +-------+-------+-------+ ..... +-------+
 
 	// lat/lon to pixel
-	px1_ = Track::lon2pixel(zoom, lon1);
-	py1_ = Track::lat2pixel(zoom, lat1);
+	px1_ = floor(Projection::lon2pixel(zoom, lon1));
+	py1_ = floor(Projection::lat2pixel(zoom, lat1));
 
-	px2_ = Track::lon2pixel(zoom, lon2);
-	py2_ = Track::lat2pixel(zoom, lat2);
+	px2_ = floor(Projection::lon2pixel(zoom, lon2));
+	py2_ = floor(Projection::lat2pixel(zoom, lat2));
 
 	// lat/lon to tile index
 	x1_ = floorf((float) px1_ / (float) TILESIZE);
@@ -231,19 +199,23 @@ void Track::init(void) {
 }
 
 
-void Track::path(OIIO::ImageBuf &outbuf, GPX *gpx, double divider) {
+void Track::path(OIIO::ImageBuf &outbuf, TrackGeometry *geometry, double divider) {
 	int zoom;
 	int stride;
 	unsigned char *data;
 
-	int x = 0, y = 0;
-
-	GPXData wpt;
+	double scale;
+	double x0, y0;
 
 	log_call();
 
 	zoom = settings().zoom();
 
+	// Projection
+	scale = Projection::size(zoom) * divider;
+	x0 = px1_ * divider;
+	y0 = py1_ * divider;
+
 	// Cairo buffer
 	OIIO::ImageBuf buf(outbuf.spec());
 
@@ -258,36 +230,17 @@ void Track::path(OIIO::ImageBuf &outbuf, GPX *gpx, double divider) {
 	cairo_set_line_width(cairo, 4.4); //40.96);
 	cairo_set_line_join(cairo, CAIRO_LINE_JOIN_ROUND);
 
-	// Draw each WPT
-	for (gpx->retrieveFirst(wpt); wpt.valid(); gpx->retrieveNext(wpt)) {
-		x = floorf((float) Track::lon2pixel(zoom, wpt.position().lon)) - px1_; // (x1_ * TILESIZE);
-		y = floorf((float) Track::lat2pixel(zoom, wpt.position().lat)) - py1_; // (y1_ * TILESIZE);
-
-		x *= divider;
-		y *= divider;
-
-		cairo_line_to(cairo, x, y);
-	}
+	// Draw simplified track
+	geometry->trace(cairo, scale, x0, y0);
 
-	// Cairo draw
-	cairo_stroke(cairo);
+	// Cairo draw (keep path for the second pass)
+	cairo_stroke_preserve(cairo);
 
 	// Path color
 	cairo_set_source_rgb(cairo, 0.9, 0.4, 0.2); // BGR #669df6
 	cairo_set_line_width(cairo, 3.0); //40.96);
 	cairo_set_line_join(cairo, CAIRO_LINE_JOIN_ROUND);
 
-	// Draw each WPT
-	for (gpx->retrieveFirst(wpt); wpt.valid(); gpx->retrieveNext(wpt)) {
-		x = floorf((float) Track::lon2pixel(zoom, wpt.position().lon)) - px1_; // (x1_ * TILESIZE);
-		y = floorf((float) Track::lat2pixel(zoom, wpt.position().lat)) - py1_; // (y1_ * TILESIZE);
-
-		x *= divider;
-		y *= divider;
-
-		cairo_line_to(cairo, x, y);
-	}
-
 	// Cairo draw
 	cairo_stroke (cairo);
 
@@ -302,7 +255,7 @@ void Track::path(OIIO::ImageBuf &outbuf, GPX *gpx, double divider) {
 		stride);
 
 	// Cairo over
-	OIIO::ImageBufAlgo::over(outbuf, buf, outbuf);
+	Blend::over(outbuf, buf);
 
 	// Release
 	cairo_surface_destroy(surface);
@@ -319,46 +272,45 @@ bool Track::load(void) {
 
 	int zoom = settings().zoom();
 
-	std::string filename = app_.settings().gpxfile();
-
-	GPXData wpt;
+	double x, y;
 
 	log_call();
 
 	// Resize map
 	trackbuf_ = new OIIO::ImageBuf(OIIO::ImageSpec(width, height, 4, OIIO::TypeDesc::UINT8)); //, OIIO::InitializePixels::No);
 
-	GPX *gpx = GPX::open(filename);
+	// Projection
+	scale_ = Projection::size(zoom) * divider_;
+	x0_ = px1_ * divider_;
+	y0_ = py1_ * divider_;
 
-	if (gpx != NULL) {
+	TrackGeometry *geometry = app_.geometry();
+
+	if ((geometry != NULL) && !geometry->empty()) {
 		// Draw path
-		path(*trackbuf_, gpx, divider_);
+		path(*trackbuf_, geometry, divider_);
 
 		// Compute begin
-		gpx->retrieveFirst(wpt);
-
-		x_start_ = floorf((float) Track::lon2pixel(zoom, wpt.position().lon)) - px1_; //(x1_ * TILESIZE);
-		y_start_ = floorf((float) Track::lat2pixel(zoom, wpt.position().lat)) - py1_; //(y1_ * TILESIZE);
+		geometry->pixel(0, scale_, x0_, y0_, &x, &y);
 
-		x_start_ *= divider_;
-		y_start_ *= divider_;
+		x_start_ = x;
+		y_start_ = y;
 
 		// Compute end
-		gpx->retrieveLast(wpt);
+		geometry->pixel(geometry->size() - 1, scale_, x0_, y0_, &x, &y);
+
+		x_end_ = x;
+		y_end_ = y;
 
-		x_end_ = floorf((float) Track::lon2pixel(zoom, wpt.position().lon)) - px1_; // (x1_ * TILESIZE);
-		y_end_ = floorf((float) Track::lat2pixel(zoom, wpt.position().lat)) - py1_; // (y1_ * TILESIZE);
+		// Trail layer over the path
+		trail_ = Trail::create(geometry, trackbuf_->spec().width, trackbuf_->spec().height, scale_, x0_, y0_);
 
-		x_end_ *= divider_;
-		y_end_ *= divider_;
+		geometry_ = geometry;
 	}
 	else {
-		log_warn("Can't open '%s' GPX data file", filename.c_str());
+		log_warn("Can't open '%s' GPX data file", app_.settings().gpxfile().c_str());
 	}
 
-	if (gpx != NULL)
-		delete gpx;
-
 	return (trackbuf_ != NULL);
 }
 
@@ -374,7 +326,20 @@ void Track::prepare(OIIO::ImageBuf *buf) {
 	// Image over
 	buf_->specmod().x = this->x();
 	buf_->specmod().y = this->y();
-	OIIO::ImageBufAlgo::over(*buf, *buf_, *buf, OIIO::ROI());
+	Blend::over(*buf, *buf_);
+}
+
+
+void Track::position(const GPXData &data, double *x, double *y) {
+	// Sub-pixel position interpolated between raw track points (telemetry
+	// filter: filtered position, as other widgets show)
+	if ((geometry_ != NULL) && (app_.settings().telemetryFilter() == TelemetrySettings::FilterNone)) {
+		geometry_->interpolate(data.timestamp(), scale_, x0_, y0_, x, y);
+		return;
+	}
+
+	*x = Projection::lon2x(data.position().lon) * scale_ - x0_;
+	*y = Projection::lat2y(data.position().lat) * scale_ - y0_;
 }
 
 
@@ -387,7 +352,7 @@ void Track::render(OIIO::ImageBuf *frame, const GPXData &data) {
 	int posX, posY;
 	int offsetX, offsetY;
 
-	int zoom = settings().zoom();
+	double px, py;
 
 	// Check track buffer
 	if (trackbuf_ == NULL) {
@@ -396,15 +361,14 @@ void Track::render(OIIO::ImageBuf *frame, const GPXData &data) {
 	}
 
 	// Current position
-	posX = floorf((float) Track::lon2pixel(zoom, data.position().lon)) - px1_;
-	posY = floorf((float) Track::lat2pixel(zoom, data.position().lat)) - py1_;
+	position(data, &px, &py);
 
-	posX *= divider_;
-	posY *= divider_;
+	posX = lround(px);
+	posY = lround(py);
 
 	// width x height of track
-	w = (px2_ - px1_) * divider_; // floorf((float) Track::lon2pixel(zoom, lon1)) - (x1_ * TILESIZE);
-	h = (py2_ - py1_) * divider_; // floorf((float) Track::lat2pixel(zoom, lat1)) - (y1_ * TILESIZE);
+	w = (px2_ - px1_) * divider_;
+	h = (py2_ - py1_) * divider_;
 
 	// Center track
 	offsetX = (width - w) / 2;
@@ -413,10 +377,18 @@ void Track::render(OIIO::ImageBuf *frame, const GPXData &data) {
 	// Image over
 	trackbuf_->specmod().x = x + offsetX;
 	trackbuf_->specmod().y = y + offsetY;
-	OIIO::ImageBufAlgo::over(*frame, *trackbuf_, *frame, OIIO::ROI(x, x + width, y, y + height));
+	Blend::over(*frame, *trackbuf_, OIIO::ROI(x, x + width, y, y + height));
+
+	// Draw trail
+	if (trail_ != NULL) {
+		OIIO::ImageBuf *trailbuf = trail_->buffer();
 
-	// Draw track
-	// ...
+		trail_->update(geometry_->lookup(data.timestamp()), px, py);
+
+		trailbuf->specmod().x = x + offsetX;
+		trailbuf->specmod().y = y + offsetY;
+		Blend::over(*frame, *trailbuf, OIIO::ROI(x, x + width, y, y + height));
+	}
 
 	// Draw picto
 	drawPicto(*frame, x + offsetX + x_start_, y + offsetY + y_start_, OIIO::ROI(x, x + width, y, y + height), "./assets/marker/start.png", 0.3);
@@ -429,17 +401,16 @@ void Track::render(OIIO::ImageBuf *frame, const GPXData &data) {
 bool Track::drawPicto(OIIO::ImageBuf &map, int x, int y, OIIO::ROI roi, const char *picto, double divider) {
 	bool result;
 
-	// Open picto
-	auto img = OIIO::ImageInput::open(picto);
-	const OIIO::ImageSpec& spec = img->spec();
-	OIIO::TypeDesc::BASETYPE type = (OIIO::TypeDesc::BASETYPE) spec.format.basetype;
+	OIIO::ImageBuf *img;
+
+	// Open & resize picto
+	if ((img = sprite(picto)) == NULL)
+		return false;
 
-	OIIO::ImageBuf buf = OIIO::ImageBuf(OIIO::ImageSpec(spec.width, spec.height, spec.nchannels, type));
-	img->read_image(type, buf.localpixels());
+	if ((img = sprite(picto, img->spec().width * divider, img->spec().height * divider)) == NULL)
+		return false;
 
-	// Resize picto
-	OIIO::ImageBuf dst(OIIO::ImageSpec(spec.width * divider, spec.height * divider, spec.nchannels, type));
-	OIIO::ImageBufAlgo::resize(dst, buf);
+	OIIO::ImageBuf dst(img->spec(), img->localpixels());
 
 	// Marker position
 	x -= dst.spec().width / 2;
@@ -448,7 +419,7 @@ bool Track::drawPicto(OIIO::ImageBuf &map, int x, int y, OIIO::ROI roi, const ch
 	// Image over
 	dst.specmod().x = x;
 	dst.specmod().y = y;
-	result = OIIO::ImageBufAlgo::over(map, dst, map, roi);
+	result = Blend::over(map, dst, roi);
 
 	if (!result)
 		log_error("ImageBufAlgo::over failure");
@@ -16,6 +16,8 @@
 
 #include "log.h"
 #include "gpx.h"
+#include "trackgeometry.h"
+#include "trail.h"
 #include "tracksettings.h"
 #include "videowidget.h"
 #include "gpx2video.h"
@@ -31,9 +33,6 @@ public:
 
 	void setSize(int width, int height);
 
-	static int lat2pixel(int zoom, float lat);
-	static int lon2pixel(int zoom, float lon);
-
 //	bool run(void) {
 //		log_call();
 //
@@ -41,7 +40,7 @@ public:
 //	}
 
 	// Draw track path
-	void path(OIIO::ImageBuf &outbuf, GPX *gpx, double divider=1.0);
+	void path(OIIO::ImageBuf &outbuf, TrackGeometry *geometry, double divider=1.0);
 
 	// Render track
 	void prepare(OIIO::ImageBuf *buf);
@@ -51,6 +50,9 @@ protected:
 	void init(void);
 	bool load(void);
 
+	// Current position in pixels
+	void position(const GPXData &data, double *x, double *y);
+
 private:
 	OIIO::ImageBuf *buf_;
 
@@ -65,6 +67,16 @@ private:
 
 	OIIO::ImageBuf *trackbuf_;
 
+	// Ridden so far layer
+	Trail *trail_;
+
+	// Shared projected track
+	TrackGeometry *geometry_;
+
+	// Projection (world size & origin in pixels)
+	double scale_;
+	double x0_, y0_;
+
 	double divider_;
 
 	// Bounding box
@@ -0,0 +1,223 @@
+#include <iostream>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include <math.h>
+
+#include "log.h"
+#include "projection.h"
+#include "trackgeometry.h"
+
+
+TrackGeometry::TrackGeometry() {
+	log_call();
+}
+
+
+TrackGeometry::~TrackGeometry() {
+	log_call();
+}
+
+
+TrackGeometry * TrackGeometry::create(GPX *gpx) {
+	TrackGeometry *geometry;
+
+	log_call();
+
+	geometry = new TrackGeometry();
+
+	geometry->init(gpx);
+
+	return geometry;
+}
+
+
+void TrackGeometry::init(GPX *gpx) {
+	struct point pt;
+
+	std::vector<GPXData::point> points;
+
+	log_call();
+
+	points_.clear();
+	times_.clear();
+	simplified_.clear();
+
+	if (gpx == NULL)
+		return;
+
+	// Read raw positions, projection occurs only once
+	gpx->getPoints(points);
+
+	if (points.empty())
+		return;
+
+	points_.reserve(points.size());
+	times_.reserve(points.size());
+
+	for (const GPXData::point &p : points) {
+		pt.x = Projection::lon2x(p.lon);
+		pt.y = Projection::lat2y(p.lat);
+
+		points_.push_back(pt);
+		times_.push_back((int64_t) p.time * 1000);
+	}
+}
+
+
+size_t TrackGeometry::lookup(int64_t timestamp) const {
+	return std::upper_bound(times_.begin(), times_.end(), timestamp) - times_.begin();
+}
+
+
+void TrackGeometry::pixel(size_t index, double scale, double x0, double y0, double *x, double *y) const {
+	const struct point &pt = points_[index];
+
+	*x = pt.x * scale - x0;
+	*y = pt.y * scale - y0;
+}
+
+
+void TrackGeometry::interpolate(int64_t timestamp, double scale, double x0, double y0, double *x, double *y) const {
+	double f;
+
+	size_t index = lookup(timestamp);
+
+	if (points_.empty()) {
+		*x = -x0;
+		*y = -y0;
+		return;
+	}
+
+	// Before the first or after the last point
+	if (index == 0) {
+		pixel(0, scale, x0, y0, x, y);
+		return;
+	}
+	if (index >= points_.size()) {
+		pixel(points_.size() - 1, scale, x0, y0, x, y);
+		return;
+	}
+
+	const struct point &p1 = points_[index - 1];
+	const struct point &p2 = points_[index];
+
+	f = (double) (timestamp - times_[index - 1]) / (double) (times_[index] - times_[index - 1]);
+
+	*x = (p1.x + (p2.x - p1.x) * f) * scale - x0;
+	*y = (p1.y + (p2.y - p1.y) * f) * scale - y0;
+}
+
+
+const std::vector<uint32_t>& TrackGeometry::simplify(double tolerance) {
+	size_t n = points_.size();
+
+	double tolerance2 = tolerance * tolerance;
+
+	std::vector<bool> keep;
+	std::vector<std::pair<uint32_t, uint32_t> > stack;
+
+	std::map<double, std::vector<uint32_t> >::iterator it = simplified_.find(tolerance);
+
+	if (it != simplified_.end())
+		return it->second;
+
+	log_call();
+
+	std::vector<uint32_t> &indexes = simplified_[tolerance];
+
+	if (n < 3) {
+		for (size_t i=0; i<n; i++)
+			indexes.push_back(i);
+
+		return indexes;
+	}
+
+	// Douglas-Peucker (iterative, deep tracks would overflow the stack)
+	keep.assign(n, false);
+	keep[0] = true;
+	keep[n-1] = true;
+
+	stack.push_back(std::make_pair(0, n-1));
+
+	while (!stack.empty()) {
+		uint32_t a = stack.back().first;
+		uint32_t b = stack.back().second;
+
+		uint32_t index = 0;
+		double dmax = 0;
+
+		stack.pop_back();
+
+		double ax = points_[a].x;
+		double ay = points_[a].y;
+		double dx = points_[b].x - ax;
+		double dy = points_[b].y - ay;
+		double len2 = dx * dx + dy * dy;
+
+		for (uint32_t i=a+1; i<b; i++) {
+			double px = points_[i].x - ax;
+			double py = points_[i].y - ay;
+			double d;
+
+			// Distance to the segment (and not to the line, tracks loop)
+			if (len2 > 0) {
+				double t = (px * dx + py * dy) / len2;
+
+				if (t < 0)
+					t = 0;
+				else if (t > 1)
+					t = 1;
+
+				px -= t * dx;
+				py -= t * dy;
+			}
+
+			d = px * px + py * py;
+
+			if (d > dmax) {
+				dmax = d;
+				index = i;
+			}
+		}
+
+		if (dmax > tolerance2) {
+			keep[index] = true;
+
+			if (index - a > 1)
+				stack.push_back(std::make_pair(a, index));
+			if (b - index > 1)
+				stack.push_back(std::make_pair(index, b));
+		}
+	}
+
+	for (size_t i=0; i<n; i++) {
+		if (keep[i])
+			indexes.push_back(i);
+	}
+
+	log_info("Track simplified from %d to %d points", (int) n, (int) indexes.size());
+
+	return indexes;
+}
+
+
+void TrackGeometry::trace(cairo_t *cairo, double scale, double x0, double y0, double tolerance) {
+	double x, y;
+
+	log_call();
+
+	if (points_.empty() || (scale <= 0))
+		return;
+
+	// Tolerance is given in pixels
+	const std::vector<uint32_t> &indexes = simplify(tolerance / scale);
+
+	for (uint32_t index : indexes) {
+		pixel(index, scale, x0, y0, &x, &y);
+
+		cairo_line_to(cairo, x, y);
+	}
+}
+
@@ -0,0 +1,64 @@
+#ifndef __GPX2VIDEO__TRACKGEOMETRY_H__
+#define __GPX2VIDEO__TRACKGEOMETRY_H__
+
+#include <map>
+#include <vector>
+#include <cstdint>
+
+#include <cairo.h>
+
+#include "gpx.h"
+
+
+// Track points projected once in the normalized Web Mercator space
+// (0.0 .. 1.0 on both axis, double precision). Map & Track widgets only
+// scale & translate this geometry, whatever the zoom level, the widget
+// size or the frame.
+class TrackGeometry {
+public:
+	virtual ~TrackGeometry();
+
+	static TrackGeometry * create(GPX *gpx);
+
+	size_t size(void) const {
+		return points_.size();
+	}
+
+	bool empty(void) const {
+		return points_.empty();
+	}
+
+	// Number of points recorded at or before timestamp (ms)
+	size_t lookup(int64_t timestamp) const;
+
+	// Pixel position of a point, scale is the world size in pixels and
+	// x0, y0 the world pixel position of the surface origin
+	void pixel(size_t index, double scale, double x0, double y0, double *x, double *y) const;
+
+	// Sub-pixel position at timestamp (ms), linear between two points
+	void interpolate(int64_t timestamp, double scale, double x0, double y0, double *x, double *y) const;
+
+	// Append the simplified polyline to the current cairo path
+	void trace(cairo_t *cairo, double scale, double x0, double y0, double tolerance=0.5);
+
+protected:
+	struct point {
+		double x, y;
+	};
+
+	void init(GPX *gpx);
+
+	const std::vector<uint32_t>& simplify(double tolerance);
+
+private:
+	TrackGeometry();
+
+	std::vector<struct point> points_;
+	std::vector<int64_t> times_;
+
+	// Douglas-Peucker result for each tolerance already requested
+	std::map<double, std::vector<uint32_t> > simplified_;
+};
+
+#endif
+
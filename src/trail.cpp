@@ -0,0 +1,145 @@
+#include <iostream>
+
+#include "log.h"
+#include "trail.h"
+
+
+Trail::Trail(TrackGeometry *geometry, double scale, double x0, double y0)
+	: geometry_(geometry)
+	, scale_(scale)
+	, x0_(x0)
+	, y0_(y0)
+	, surface_(NULL)
+	, cairo_(NULL)
+	, buf_(NULL)
+	, started_(false)
+	, index_(0)
+	, x_(0)
+	, y_(0) {
+	log_call();
+}
+
+
+Trail::~Trail() {
+	log_call();
+
+	if (buf_)
+		delete buf_;
+
+	if (cairo_)
+		cairo_destroy(cairo_);
+	if (surface_)
+		cairo_surface_destroy(surface_);
+}
+
+
+Trail * Trail::create(TrackGeometry *geometry, int width, int height, double scale, double x0, double y0) {
+	Trail *trail;
+
+	log_call();
+
+	trail = new Trail(geometry, scale, x0, y0);
+
+	trail->init(width, height);
+
+	return trail;
+}
+
+
+void Trail::init(int width, int height) {
+	log_call();
+
+	// Create the cairo persistent surface (transparent)
+	surface_ = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+
+	cairo_ = cairo_create(surface_);
+
+	setStyle();
+
+	// ARGB32 stride is always width * 4, so OIIO can use cairo data as is
+	buf_ = new OIIO::ImageBuf(OIIO::ImageSpec(width, height, 4, OIIO::TypeDesc::UINT8),
+		cairo_image_surface_get_data(surface_));
+}
+
+
+void Trail::setStyle(void) {
+	// Trail color
+	cairo_set_source_rgb(cairo_, 0.2, 0.4, 0.9); // BGR #e66633
+	cairo_set_line_width(cairo_, 3.0);
+	cairo_set_line_join(cairo_, CAIRO_LINE_JOIN_ROUND);
+	cairo_set_line_cap(cairo_, CAIRO_LINE_CAP_ROUND);
+}
+
+
+void Trail::update(size_t index, double x, double y) {
+	double px, py;
+
+	// Seek backward or first call
+	if (!started_ || (index < index_)) {
+		rebuild(index, x, y);
+		return;
+	}
+
+	// Rider didn't move
+	if ((index == index_) && (x == x_) && (y == y_))
+		return;
+
+	// Stroke only the new segment
+	cairo_move_to(cairo_, x_, y_);
+
+	for (size_t i=index_; i<index; i++) {
+		geometry_->pixel(i, scale_, x0_, y0_, &px, &py);
+
+		cairo_line_to(cairo_, px, py);
+	}
+
+	cairo_line_to(cairo_, x, y);
+	cairo_stroke(cairo_);
+
+	cairo_surface_flush(surface_);
+
+	index_ = index;
+	x_ = x;
+	y_ = y;
+}
+
+
+void Trail::rebuild(size_t index, double x, double y) {
+	double px, py;
+
+	log_call();
+
+	if (index > geometry_->size())
+		index = geometry_->size();
+
+	// Clear surface
+	cairo_save(cairo_);
+	cairo_set_operator(cairo_, CAIRO_OPERATOR_CLEAR);
+	cairo_paint(cairo_);
+	cairo_restore(cairo_);
+
+	// Draw the whole trail in one pass
+	for (size_t i=0; i<index; i++) {
+		geometry_->pixel(i, scale_, x0_, y0_, &px, &py);
+
+		cairo_line_to(cairo_, px, py);
+	}
+
+	if (index > 0) {
+		cairo_line_to(cairo_, x, y);
+		cairo_stroke(cairo_);
+	}
+
+	cairo_surface_flush(surface_);
+
+	started_ = true;
+	index_ = index;
+	x_ = x;
+	y_ = y;
+}
+
+
+OIIO::ImageBuf * Trail::buffer(void) {
+	return buf_;
+}
+
@@ -0,0 +1,54 @@
+#ifndef __GPX2VIDEO__TRAIL_H__
+#define __GPX2VIDEO__TRAIL_H__
+
+#include <cairo.h>
+
+#include <OpenImageIO/imagebuf.h>
+
+#include "trackgeometry.h"
+
+
+// "Ridden so far" layer. The trail is kept on a persistent cairo surface
+// (premultiplied ARGB) above the precomputed track raster, so each frame
+// only strokes the segment between the previous and the current position.
+class Trail {
+public:
+	virtual ~Trail();
+
+	static Trail * create(TrackGeometry *geometry, int width, int height, double scale, double x0, double y0);
+
+	// Extend trail up to point index, then to the current position
+	void update(size_t index, double x, double y);
+
+	// Redraw trail from the first point up to index (seek)
+	void rebuild(size_t index, double x, double y);
+
+	// Trail layer (shares the cairo surface memory)
+	OIIO::ImageBuf * buffer(void);
+
+protected:
+	void init(int width, int height);
+
+	void setStyle(void);
+
+private:
+	Trail(TrackGeometry *geometry, double scale, double x0, double y0);
+
+	TrackGeometry *geometry_;
+
+	double scale_;
+	double x0_, y0_;
+
+	cairo_surface_t *surface_;
+	cairo_t *cairo_;
+
+	OIIO::ImageBuf *buf_;
+
+	// Last stroked point index & position
+	bool started_;
+	size_t index_;
+	double x_, y_;
+};
+
+#endif
+
@@ -6,6 +6,7 @@
 #include <sys/stat.h>
 #include <errno.h>
 #include <dirent.h>
+#include <unistd.h>
 
 #include "utils.h"
 
@@ -105,3 +106,43 @@ void rmpath(std::string path) {
 
 	::remove(path.c_str());
 }
+
+
+std::string escapeJSON(const std::string &s) {
+	std::string result;
+
+	for (char c : s) {
+		// Control characters
+		if ((unsigned char) c < 0x20) {
+			char buf[8];
+
+			snprintf(buf, sizeof(buf), "\\u%04x", (unsigned char) c);
+			result += buf;
+			continue;
+		}
+
+		if ((c == '"') || (c == '\\'))
+			result += '\\';
+		result += c;
+	}
+
+	return result;
+}
+
+
+size_t rss(void) {
+	FILE *file;
+
+	unsigned long size = 0;
+	unsigned long resident = 0;
+
+	if ((file = ::fopen("/proc/self/statm", "r")) == NULL)
+		return 0;
+
+	if (fscanf(file, "%lu %lu", &size, &resident) != 2)
+		resident = 0;
+
+	::fclose(file);
+
+	return resident * sysconf(_SC_PAGESIZE);
+}
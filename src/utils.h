@@ -12,5 +12,10 @@ int mkpath(std::string &path, mode_t mode);
 
 void rmpath(std:: string path);
 
+std::string escapeJSON(const std::string &s);
+
+// Resident memory of the process (in bytes)
+size_t rss(void);
+
 #endif
 
@@ -1,5 +1,8 @@
 #include <iostream>
 #include <memory>
+#include <sstream>
+#include <map>
+#include <mutex>
 
 #include <OpenImageIO/imageio.h>
 #include <OpenImageIO/imagebuf.h>
@@ -9,6 +12,11 @@
 #include "videowidget.h"
 
 
+// Decoded & resized pictos, shared by every widget (and batch job)
+static std::mutex sprites_mutex;
+static std::map<std::string, OIIO::ImageBuf *> sprites;
+
+
 VideoWidget::Align VideoWidget::string2align(std::string &s) {
 	VideoWidget::Align align;
 
@@ -102,12 +110,89 @@ bool VideoWidget::hex2color(float color[4], std::string hex) {
 }
 
 
+OIIO::ImageBuf * VideoWidget::sprite(const std::string &filename) {
+	OIIO::ImageBuf *buf;
+
+	std::lock_guard<std::mutex> lock(sprites_mutex);
+
+	if (sprites.find(filename) != sprites.end())
+		return sprites[filename];
+
+	// Open image
+	auto img = OIIO::ImageInput::open(filename);
+
+	if (img == NULL) {
+		log_warn("Can't open '%s' picto", filename.c_str());
+		return NULL;
+	}
+
+	const OIIO::ImageSpec& spec = img->spec();
+	VideoParams::Format img_fmt = OIIOUtils::getFormatFromOIIOBaseType((OIIO::TypeDesc::BASETYPE) spec.format.basetype);
+	OIIO::TypeDesc::BASETYPE type = OIIOUtils::getOIIOBaseTypeFromFormat(img_fmt);
+
+	buf = new OIIO::ImageBuf(OIIO::ImageSpec(spec.width, spec.height, spec.nchannels, type)); //, OIIO::InitializePixels::No);
+	img->read_image(type, buf->localpixels());
+
+	sprites[filename] = buf;
+
+	return buf;
+}
+
+
+OIIO::ImageBuf * VideoWidget::sprite(const std::string &filename, int width, int height) {
+	OIIO::ImageBuf *buf;
+	OIIO::ImageBuf *src;
+
+	std::ostringstream stream;
+
+	if ((src = sprite(filename)) == NULL)
+		return NULL;
+
+	stream << filename << "@" << width << "x" << height;
+
+	std::lock_guard<std::mutex> lock(sprites_mutex);
+
+	if (sprites.find(stream.str()) != sprites.end())
+		return sprites[stream.str()];
+
+	// Resize picto
+	buf = new OIIO::ImageBuf(OIIO::ImageSpec(width, height, src->spec().nchannels, src->spec().format)); //, OIIO::InitializePixels::No);
+	OIIO::ImageBufAlgo::resize(*buf, *src);
+
+	sprites[stream.str()] = buf;
+
+	return buf;
+}
+
+
 void VideoWidget::createBox(OIIO::ImageBuf **buf, int width, int height) {
 	// Create an image buffer with static render
 	*buf = new OIIO::ImageBuf(OIIO::ImageSpec(width, height, 4, OIIO::TypeDesc::UINT8));
 }
 
 
+void VideoWidget::createTile(OIIO::TypeDesc type) {
+	OIIO::ImageSpec spec(width(), height(), 4, type);
+
+	if (tile_)
+		delete tile_;
+
+	// Same coordinates as the frame
+	spec.x = x();
+	spec.y = y();
+
+	tile_ = new OIIO::ImageBuf(spec);
+}
+
+
+void VideoWidget::clearTile(void) {
+	const OIIO::ImageSpec &spec = tile_->spec();
+
+	// Transparent
+	memset(tile_->localpixels(), 0, spec.image_bytes());
+}
+
+
 void VideoWidget::drawBorder(OIIO::ImageBuf *buf) {
 	int i;
 	int width, height;
@@ -151,14 +236,13 @@ void VideoWidget::drawImage(OIIO::ImageBuf *buf, int x, int y, const char *name,
 
 	int width, height;
 
+	OIIO::ImageBuf *img;
+
 	// Open image
-	auto img = OIIO::ImageInput::open(name);
-	const OIIO::ImageSpec& spec = img->spec();
-	VideoParams::Format img_fmt = OIIOUtils::getFormatFromOIIOBaseType((OIIO::TypeDesc::BASETYPE) spec.format.basetype);
-	OIIO::TypeDesc::BASETYPE type = OIIOUtils::getOIIOBaseTypeFromFormat(img_fmt);
+	if ((img = sprite(name)) == NULL)
+		return;
 
-	OIIO::ImageBuf *b = new OIIO::ImageBuf(OIIO::ImageSpec(spec.width, spec.height, spec.nchannels, type)); //, OIIO::InitializePixels::No);
-	img->read_image(type, b->localpixels());
+	const OIIO::ImageSpec& spec = img->spec();
 
 	// Ratio
 	ratio = spec.width / spec.height;
@@ -182,15 +266,15 @@ void VideoWidget::drawImage(OIIO::ImageBuf *buf, int x, int y, const char *name,
 	}
 
 	// Resize picto
-	OIIO::ImageBuf d(OIIO::ImageSpec(width, height, spec.nchannels, type)); //, OIIO::InitializePixels::No);
-	OIIO::ImageBufAlgo::resize(d, *b);
+	if ((img = sprite(name, width, height)) == NULL)
+		return;
+
+	// Image over (wraps the shared sprite pixels)
+	OIIO::ImageBuf d(img->spec(), img->localpixels());
 
-	// Image over
 	d.specmod().x = x;
 	d.specmod().y = y;
-	OIIO::ImageBufAlgo::over(*buf, d, *buf, OIIO::ROI());
-
-	delete b;
+	Blend::over(*buf, d);
 }
 
 
@@ -12,6 +12,7 @@
 
 #include "log.h"
 #include "gpx.h"
+#include "blend.h"
 #include "gpx2video.h"
 
 
@@ -49,6 +50,9 @@ public:
 
 	virtual ~VideoWidget() {
 		log_call();
+
+		if (tile_)
+			delete tile_;
 	}
 
 	Align& align(void) {
@@ -169,6 +173,15 @@ public:
 		return hex2color(bgcolor_, color);
 	}
 
+	// Camera time of the frame being rendered
+	const time_t& time(void) const {
+		return time_;
+	}
+
+	void setTime(const time_t &time) {
+		time_ = time;
+	}
+
 	virtual bool run(void) {
 		log_call();
 
@@ -177,7 +190,20 @@ public:
 		return true;
 	}
 
+	// Tile of the widget rectangle (data window at x, y), cleared by
+	// clearTile before each render
+	OIIO::ImageBuf * tile(void) {
+		return tile_;
+	}
+
+	void createTile(OIIO::TypeDesc type);
+	void clearTile(void);
+
+	// Static render into the overlay buffer
 	virtual void prepare(OIIO::ImageBuf *buf) = 0;
+
+	// Dynamic render into the widget tile, widgets are rendered concurrently
+	// so render must only change the widget own state
 	virtual void render(OIIO::ImageBuf *buf, const GPXData &data) = 0;
 
 	static Align string2align(std::string &s);
@@ -189,6 +215,7 @@ protected:
 	VideoWidget(GPX2Video &app, std::string name)  
 		: GPX2Video::Task(app)
 		, app_(app) 
+		, tile_(NULL)
 		, name_(name) {
 		log_call();
 
@@ -204,8 +231,13 @@ protected:
 		setBorder(0);
 		setBorderColor("#00000000");
 		setBackgroundColor("#00000000");
+		setTime(0);
 	}
 
+	// Sprite cache, each picto is decoded (and resized) once per process
+	static OIIO::ImageBuf * sprite(const std::string &filename);
+	static OIIO::ImageBuf * sprite(const std::string &filename, int width, int height);
+
 	void createBox(OIIO::ImageBuf **buf, int width, int height);
 
 	void drawBorder(OIIO::ImageBuf *buf);
@@ -235,6 +267,10 @@ protected:
 	float bordercolor_[4];
 	float bgcolor_[4];
 
+	time_t time_;
+
+	OIIO::ImageBuf *tile_;
+
 private:
 	std::string name_;
 };
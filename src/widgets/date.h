@@ -37,7 +37,7 @@ public:
 		// Image over
 		buf_->specmod().x = this->x();
 		buf_->specmod().y = this->y();
-		OIIO::ImageBufAlgo::over(*buf, *buf_, *buf, OIIO::ROI());
+		Blend::over(*buf, *buf_);
 	}
 
 	void render(OIIO::ImageBuf *buf, const GPXData &data) {
@@ -49,7 +49,7 @@ public:
 
 		// Don't use gps time, but camera time!
 		// Indeed, with garmin devices, gpx time has an offset.
-		localtime_r(&app_.time(), &time);
+		localtime_r(&this->time(), &time);
 
 		strftime(s, sizeof(s), format().c_str(), &time);
 
@@ -35,7 +35,7 @@ public:
 		// Image over
 		buf_->specmod().x = this->x();
 		buf_->specmod().y = this->y();
-		OIIO::ImageBufAlgo::over(*buf, *buf_, *buf, OIIO::ROI());
+		Blend::over(*buf, *buf_);
 	}
 
 	void render(OIIO::ImageBuf *buf, const GPXData &data) {
@@ -0,0 +1,151 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <OpenImageIO/imageio.h>
+#include <OpenImageIO/imagebuf.h>
+#include <OpenImageIO/imagebufalgo.h>
+
+#include "src/blend.h"
+
+
+// Sprite over a frame, at an offset & partly out of the frame
+#define FRAME_WIDTH 333
+#define FRAME_HEIGHT 97
+
+#define SPRITE_X 211
+#define SPRITE_Y -13
+#define SPRITE_WIDTH 157
+#define SPRITE_HEIGHT 71
+
+
+template <typename T>
+static void fill_frame(OIIO::ImageBuf &buf, unsigned int max) {
+	int x, y, c;
+
+	for (y=buf.ybegin(); y<buf.yend(); y++) {
+		for (x=buf.xbegin(); x<buf.xend(); x++) {
+			T *p = (T *) buf.pixeladdr(x, y);
+
+			for (c=0; c<4; c++)
+				p[c] = rand() % (max + 1);
+		}
+	}
+}
+
+
+// Premultiplied sprite, with transparent & opaque pixels
+template <typename T>
+static void fill_sprite(OIIO::ImageBuf &buf, unsigned int max) {
+	int x, y, c;
+
+	for (y=buf.ybegin(); y<buf.yend(); y++) {
+		for (x=buf.xbegin(); x<buf.xend(); x++) {
+			T *p = (T *) buf.pixeladdr(x, y);
+
+			unsigned int alpha = rand() % (max + 1);
+
+			if ((x % 7) == 0)
+				alpha = 0;
+			else if ((x % 11) == 0)
+				alpha = max;
+
+			for (c=0; c<3; c++)
+				p[c] = rand() % (alpha + 1);
+
+			p[3] = alpha;
+		}
+	}
+}
+
+
+template <typename T>
+static int compare(const OIIO::ImageBuf &a, const OIIO::ImageBuf &b, unsigned int tolerance) {
+	int x, y, c;
+	int errors = 0;
+
+	for (y=a.ybegin(); y<a.yend(); y++) {
+		for (x=a.xbegin(); x<a.xend(); x++) {
+			const T *p = (const T *) a.pixeladdr(x, y);
+			const T *q = (const T *) b.pixeladdr(x, y);
+
+			for (c=0; c<4; c++) {
+				if ((unsigned int) abs((int) p[c] - (int) q[c]) > tolerance)
+					errors++;
+			}
+		}
+	}
+
+	return errors;
+}
+
+
+template <typename T>
+static int test(OIIO::TypeDesc type, unsigned int max, unsigned int tolerance) {
+	int k;
+	int errors = 0;
+
+	OIIO::ROI roi(SPRITE_X + 10, FRAME_WIDTH, 0, FRAME_HEIGHT);
+
+	OIIO::ImageBuf frame(OIIO::ImageSpec(FRAME_WIDTH, FRAME_HEIGHT, 4, type));
+	OIIO::ImageBuf sprite(OIIO::ImageSpec(SPRITE_WIDTH, SPRITE_HEIGHT, 4, type));
+
+	sprite.specmod().x = SPRITE_X;
+	sprite.specmod().y = SPRITE_Y;
+
+	fill_frame<T>(frame, max);
+	fill_sprite<T>(sprite, max);
+
+	// Reference
+	OIIO::ImageBuf expected = frame;
+	OIIO::ImageBufAlgo::over(expected, sprite, expected, OIIO::ROI());
+
+	OIIO::ImageBuf expected_roi = frame;
+	OIIO::ImageBufAlgo::over(expected_roi, sprite, expected_roi, roi);
+
+	// Each kernel supported by the CPU
+	for (k=Blend::KernelScalar; k<Blend::KernelCount; k++) {
+		int n;
+
+		if (!Blend::setKernel((Blend::Kernel) k))
+			continue;
+
+		OIIO::ImageBuf result = frame;
+		Blend::over(result, sprite);
+
+		n = compare<T>(result, expected, tolerance);
+
+		OIIO::ImageBuf result_roi = frame;
+		Blend::over(result_roi, sprite, roi);
+
+		n += compare<T>(result_roi, expected_roi, tolerance);
+
+		printf("RGBA%d %-6s: %s (%d errors)\n", (int) (8 * sizeof(T)),
+			Blend::getFriendlyName((Blend::Kernel) k), n ? "FAILED" : "OK", n);
+
+		errors += n;
+	}
+
+	Blend::setKernel(Blend::KernelAuto);
+
+	return errors;
+}
+
+
+int main(int argc, char *argv[]) {
+	int errors = 0;
+
+	(void) argc;
+	(void) argv;
+
+	srand(1);
+
+	// 8 bits results are the ones of ImageBufAlgo::over
+	errors += test<uint8_t>(OIIO::TypeDesc::UINT8, 255, 0);
+
+	// ImageBufAlgo::over computes in float, not precise enough for 16 bits
+	errors += test<uint16_t>(OIIO::TypeDesc::UINT16, 65535, 1);
+
+	return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+